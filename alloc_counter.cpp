@@ -0,0 +1,83 @@
+#include "alloc_counter.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<uint64_t> g_allocations{0};
+std::atomic<uint64_t> g_allocated_bytes{0};
+
+inline void countAllocation(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    g_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+}  // namespace
+
+uint64_t AllocationCounter::allocations() {
+    return g_allocations.load(std::memory_order_relaxed);
+}
+
+uint64_t AllocationCounter::allocatedBytes() {
+    return g_allocated_bytes.load(std::memory_order_relaxed);
+}
+
+#ifdef __GLIBC__
+
+// glibc lets an executable interpose the malloc family; forward to the real
+// allocator and count there, so C code and operator new are both covered.
+extern "C" {
+void* __libc_malloc(std::size_t size);
+void* __libc_calloc(std::size_t count, std::size_t size);
+void* __libc_realloc(void* ptr, std::size_t size);
+
+void* malloc(std::size_t size) {
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+void* calloc(std::size_t count, std::size_t size) {
+    countAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, std::size_t size) {
+    countAllocation(size);
+    return __libc_realloc(ptr, size);
+}
+}
+
+#define FART_COUNT_NEW(size) ((void)0)
+
+#else
+
+#define FART_COUNT_NEW(size) countAllocation(size)
+
+#endif
+
+void* operator new(std::size_t size) {
+    FART_COUNT_NEW(size);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    FART_COUNT_NEW(size);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
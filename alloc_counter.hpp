@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+
+// Process-wide heap allocation counters for the benchmark and the allocation
+// tests. Linking alloc_counter.cpp into an executable replaces the global
+// operator new (and on glibc also malloc, calloc and realloc) with counting
+// versions; it must never be linked into fart itself.
+class AllocationCounter {
+public:
+    static uint64_t allocations();
+    static uint64_t allocatedBytes();
+};
+
+// Counts the allocations made between construction and a call to count()
+class AllocationScope {
+public:
+    AllocationScope() : start_(AllocationCounter::allocations()) {}
+
+    uint64_t count() const { return AllocationCounter::allocations() - start_; }
+
+private:
+    uint64_t start_;
+};
@@ -1,6 +1,11 @@
 #include "argument_parser.hpp"
+#include "file_filter.hpp"
+#include "regex_engine.hpp"
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
 #include <iomanip>
+#include <stdexcept>
 
 ArgumentParser::ArgumentParser() {
     initializeArguments();
@@ -12,6 +17,7 @@ ArgumentParser::ParseResult ArgumentParser::parse(int argc, char* argv[], FartCo
     
     auto& options = config.getOptions();
     bool parsing_options = true;
+    std::vector<std::string> arguments;
     
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
@@ -24,7 +30,35 @@ ArgumentParser::ParseResult ArgumentParser::parse(int argc, char* argv[], FartCo
             
             if (arg.length() > 2 && arg.substr(0, 2) == "--") {
                 std::string long_option = arg.substr(2);
-                auto parse_result = parseLongOption(long_option, options);
+                std::string value;
+                bool has_value = false;
+                
+                auto equals = long_option.find('=');
+                if (equals != std::string::npos) {
+                    value = long_option.substr(equals + 1);
+                    long_option.erase(equals);
+                    has_value = true;
+                }
+                
+                auto definition = long_options_.find(long_option);
+                if (definition != long_options_.end()) {
+                    ValueKind kind = definition->second->value_kind;
+                    if (kind == ValueKind::NONE && has_value) {
+                        result.success = false;
+                        result.error_message = "Option --" + long_option + " does not take a value";
+                        return result;
+                    }
+                    if (kind == ValueKind::REQUIRED && !has_value) {
+                        if (i + 1 >= argc) {
+                            result.success = false;
+                            result.error_message = "Option --" + long_option + " requires a value";
+                            return result;
+                        }
+                        value = argv[++i];
+                    }
+                }
+                
+                auto parse_result = parseLongOption(long_option, value, options);
                 if (!parse_result.success) {
                     return parse_result;
                 }
@@ -42,7 +76,17 @@ ArgumentParser::ParseResult ArgumentParser::parse(int argc, char* argv[], FartCo
                 }
             }
         } else {
-            if (!config.hasWildcard()) {
+            arguments.push_back(arg);
+        }
+    }
+    
+    // --merge may come after the result logs it applies to
+    if (options.merge) {
+        config.setMergeFiles(arguments);
+    } else {
+        for (const auto& arg : arguments) {
+            // The file list takes the place of the wildcard
+            if (!config.hasWildcard() && options.files_from.empty()) {
                 config.setWildcard(arg);
             } else if (!config.hasFindString()) {
                 config.setFindString(arg);
@@ -56,7 +100,83 @@ ArgumentParser::ParseResult ArgumentParser::parse(int argc, char* argv[], FartCo
         }
     }
     
-    if (options.help || !config.hasWildcard()) {
+    if (options.version) {
+        return result;
+    }
+    
+    // A worker gets everything else from its coordinator
+    if (!options.worker.empty()) {
+        if (!options.serve_work.empty()) {
+            result.success = false;
+            result.error_message = "Option --worker conflicts with --serve-work";
+        }
+        return result;
+    }
+    
+    if (!options.serve_work.empty()) {
+        result.success = false;
+        if (!options.emit_results.empty()) {
+            result.error_message = "Option --serve-work conflicts with --emit-results";
+        } else if (config.getWildcard() == "-") {
+            result.error_message = "Option --serve-work cannot read stdin";
+        } else if (options.filename_mode && config.hasReplaceString()) {
+            result.error_message = "Option --serve-work cannot rename files";
+        } else {
+            result.success = true;
+        }
+        if (!result.success) {
+            return result;
+        }
+    }
+    
+    if (!options.files_from.empty()) {
+        result.success = false;
+        if (!options.serve_work.empty() || options.watch || options.merge) {
+            result.error_message = std::string("Option --files-from conflicts with ") +
+                (options.merge ? "--merge" : options.watch ? "--watch" : "--serve-work");
+        } else if (!config.hasFindString() && !options.help) {
+            result.error_message = "Option --files-from needs a find_string";
+        } else {
+            result.success = true;
+        }
+        if (!result.success) {
+            return result;
+        }
+    }
+    
+    if (options.watch) {
+        result.success = false;
+        if (!options.serve_work.empty() || options.merge) {
+            result.error_message = options.merge ? "Option --watch conflicts with --merge"
+                                                 : "Option --watch conflicts with --serve-work";
+        } else if (!options.emit_results.empty()) {
+            result.error_message = "Option --watch conflicts with --emit-results";
+        } else if (config.getWildcard() == "-") {
+            result.error_message = "Option --watch cannot read stdin";
+        } else if (config.hasWildcard() && !config.hasFindString()) {
+            result.error_message = "Option --watch needs a find_string";
+        } else if (options.filename_mode && config.hasReplaceString()) {
+            result.error_message = "Option --watch cannot rename files";
+        } else {
+            result.success = true;
+        }
+        if (!result.success) {
+            return result;
+        }
+    }
+    
+    if (options.merge) {
+        if (options.shard_count || !options.emit_results.empty()) {
+            result.success = false;
+            result.error_message = options.shard_count ? "Option --merge conflicts with --shard"
+                                                       : "Option --merge conflicts with --emit-results";
+        } else if (options.help || config.getMergeFiles().empty()) {
+            result.show_help = true;
+        }
+        return result;
+    }
+    
+    if (options.help || (!config.hasWildcard() && options.files_from.empty())) {
         result.show_help = true;
     }
     
@@ -66,6 +186,22 @@ ArgumentParser::ParseResult ArgumentParser::parse(int argc, char* argv[], FartCo
         return result;
     }
     
+    if (options.search_archives && (config.hasReplaceString() || options.remove || options.filename_mode)) {
+        result.success = false;
+        result.error_message = "Option --search-archives only works when searching file contents";
+        return result;
+    }
+    
+    if (options.regex && config.hasFindString()) {
+        try {
+            RegexEngine(config.getFindString(), options.ignore_case);
+        } catch (const std::invalid_argument& e) {
+            result.success = false;
+            result.error_message = std::string("Invalid regular expression: ") + e.what();
+            return result;
+        }
+    }
+    
     if (options.remove && config.hasFindString()) {
         config.setReplaceString("");
     }
@@ -97,8 +233,15 @@ void ArgumentParser::showUsage() const {
             std::cout << "    ";
         }
         
-        std::cout << " --" << std::left << std::setw(14) << arg.long_option 
-                  << arg.description << "\n";
+        std::string label = arg.long_option;
+        if (arg.value_kind == ValueKind::OPTIONAL) {
+            label += "[=" + arg.value_name + "]";
+        } else if (arg.value_kind == ValueKind::REQUIRED) {
+            label += " " + arg.value_name;
+        }
+        
+        std::cout << " --" << std::left << std::setw(14) << label 
+                  << (label.length() < 14 ? "" : " ") << arg.description << "\n";
     }
     
     std::cout << std::endl;
@@ -111,9 +254,22 @@ void ArgumentParser::showVersion() const {
 void ArgumentParser::initializeArguments() {
     argument_definitions_ = {
         {'h', "help", "Show this help message (ignores other options)", nullptr},
+        {' ', "version", "Show version information", nullptr},
         {'q', "quiet", "Suppress output to stdio / stderr", nullptr},
         {'V', "verbose", "Show more information", nullptr},
         {'r', "recursive", "Process sub-folders recursively", nullptr},
+        {'L', "follow", "Walk symbolically linked folders; each file and folder is processed once", nullptr},
+        {' ', "files-from", "Process the files listed in file (- for stdin) instead of wildcard", nullptr,
+            ValueKind::REQUIRED, "file"},
+        {'0', "null", "File names in --files-from end with NUL, not newline", nullptr},
+        {' ', "type", "Only process files of type name (cpp, py, js, ...; comma separated)", nullptr,
+            ValueKind::REQUIRED, "name"},
+        {' ', "min-filesize", "Skip files smaller than size (suffixes K, M, G)", nullptr,
+            ValueKind::REQUIRED, "size"},
+        {' ', "max-filesize", "Skip files larger than size (suffixes K, M, G)", nullptr,
+            ValueKind::REQUIRED, "size"},
+        {' ', "newer-than", "Skip files not changed within age (30m, 12h, 2d) or since file", nullptr,
+            ValueKind::REQUIRED, "age"},
         {'c', "count", "Only show filenames, match counts and totals", nullptr},
         {'i', "ignore-case", "Case insensitive text comparison", nullptr},
         {'v', "invert", "Print lines NOT containing the find string", nullptr},
@@ -122,20 +278,39 @@ void ArgumentParser::initializeArguments() {
         {'f', "filename", "Find (and replace) filename instead of contents", nullptr},
         {'B', "binary", "Also search (and replace) in binary files (CAUTION)", nullptr},
         {'C', "c-style", "Allow C-style extended characters (\\xFF\\0\\t\\n\\r\\\\ etc.)", nullptr},
+        {'E', "regex", "Find string is a regular expression; $1..$9 in replace_string", nullptr},
         {' ', "cvs", "Skip cvs dirs; execute \"cvs edit\" before changing files", nullptr},
+        {' ', "vcs-edit", "Execute \"<cmd> <files>\" in batches before changing files", nullptr,
+            ValueKind::REQUIRED, "cmd"},
         {' ', "svn", "Skip svn dirs", nullptr},
         {' ', "git", "Skip git dirs (default)", nullptr},
+        {' ', "gitignore", "Skip what .gitignore and .ignore files ignore", nullptr},
         {' ', "remove", "Remove all occurences of the find_string", nullptr},
         {'a', "adapt", "Adapt the case of replace_string to found string", nullptr},
+        {' ', "shard", "Only process the files of shard K of N (1 <= K <= N)", nullptr,
+            ValueKind::REQUIRED, "K/N"},
+        {' ', "emit-results", "Write per-file match counts to file, for --merge", nullptr,
+            ValueKind::REQUIRED, "file"},
+        {' ', "merge", "Print the summary of the result files given instead of wildcard", nullptr},
+        {' ', "serve-work", "Walk the tree and hand out the files to --worker processes", nullptr,
+            ValueKind::REQUIRED, "addr"},
+        {' ', "worker", "Process files handed out by --serve-work at addr", nullptr,
+            ValueKind::REQUIRED, "addr"},
+        {' ', "watch", "After the first run, process files again as they change", nullptr},
+        {' ', "io-uring", "Read many small files at once through io_uring (Linux)", nullptr},
+        {' ', "no-cache-pollution", "Drop each file from the page cache once it is read", nullptr},
+        {' ', "search-archives", "Search the files inside tar archives (.tar, .tar.gz, ...)", nullptr},
         {'b', "backup", "Make a backup of each changed file", nullptr},
-        {'p', "preview", "Do not change the files but print the changes", nullptr}
+        {'p', "preview", "Do not change the files but print the changes", nullptr},
+        {' ', "stats", "Print counters and phase timings to stderr (text or json)", nullptr,
+            ValueKind::OPTIONAL, "json"}
     };
     
     for (auto& arg : argument_definitions_) {
         if (arg.short_option != ' ') {
             short_options_[arg.short_option] = arg.flag_ptr;
         }
-        long_options_[arg.long_option] = arg.flag_ptr;
+        long_options_[arg.long_option] = &arg;
     }
 }
 
@@ -159,6 +334,8 @@ ArgumentParser::ParseResult ArgumentParser::parseShortOptions(const std::string&
             case 'q': config_options.quiet = true; break;
             case 'V': config_options.verbose = true; break;
             case 'r': config_options.recursive = true; break;
+            case 'L': config_options.follow = true; break;
+            case '0': config_options.null_data = true; break;
             case 'c': config_options.count = true; break;
             case 'i': config_options.ignore_case = true; break;
             case 'v': config_options.invert = true; break;
@@ -167,6 +344,7 @@ ArgumentParser::ParseResult ArgumentParser::parseShortOptions(const std::string&
             case 'f': config_options.filename_mode = true; break;
             case 'B': config_options.binary = true; break;
             case 'C': config_options.c_style = true; break;
+            case 'E': config_options.regex = true; break;
             case 'a': config_options.adapt_case = true; break;
             case 'b': config_options.backup = true; break;
             case 'p': config_options.preview = true; break;
@@ -176,7 +354,7 @@ ArgumentParser::ParseResult ArgumentParser::parseShortOptions(const std::string&
     return result;
 }
 
-ArgumentParser::ParseResult ArgumentParser::parseLongOption(const std::string& option, FartConfig::Options& config_options) {
+ArgumentParser::ParseResult ArgumentParser::parseLongOption(const std::string& option, const std::string& value, FartConfig::Options& config_options) {
     ParseResult result;
     result.success = true;
     
@@ -187,6 +365,7 @@ ArgumentParser::ParseResult ArgumentParser::parseLongOption(const std::string& o
     }
     
     if (option == "help") { config_options.help = true; result.show_help = true; }
+    else if (option == "version") { config_options.version = true; }
     else if (option == "quiet") { config_options.quiet = true; }
     else if (option == "verbose") { config_options.verbose = true; }
     else if (option == "recursive") { config_options.recursive = true; }
@@ -198,13 +377,79 @@ ArgumentParser::ParseResult ArgumentParser::parseLongOption(const std::string& o
     else if (option == "filename") { config_options.filename_mode = true; }
     else if (option == "binary") { config_options.binary = true; }
     else if (option == "c-style") { config_options.c_style = true; }
+    else if (option == "regex") { config_options.regex = true; }
     else if (option == "cvs") { config_options.cvs = true; }
+    else if (option == "vcs-edit") { config_options.vcs_edit = value; }
     else if (option == "svn") { config_options.svn = true; }
     else if (option == "git") { config_options.git = true; }
     else if (option == "remove") { config_options.remove = true; }
     else if (option == "adapt") { config_options.adapt_case = true; }
+    else if (option == "shard") {
+        unsigned index = 0, count = 0;
+        char extra;
+        if (std::sscanf(value.c_str(), "%u/%u%c", &index, &count, &extra) != 2 || index < 1 || index > count) {
+            result.error_message = "Invalid value for --shard: " + value + " (expected K/N with 1 <= K <= N)";
+            result.success = false;
+            return result;
+        }
+        config_options.shard_index = index - 1;
+        config_options.shard_count = count;
+    }
+    else if (option == "emit-results") { config_options.emit_results = value; }
+    else if (option == "merge") { config_options.merge = true; }
+    else if (option == "serve-work") { config_options.serve_work = value; }
+    else if (option == "worker") { config_options.worker = value; }
+    else if (option == "watch") { config_options.watch = true; }
+    else if (option == "files-from") { config_options.files_from = value; }
+    else if (option == "null") { config_options.null_data = true; }
+    else if (option == "gitignore") { config_options.gitignore = true; }
+    else if (option == "follow") { config_options.follow = true; }
+    else if (option == "io-uring") { config_options.io_uring = true; }
+    else if (option == "no-cache-pollution") { config_options.no_cache_pollution = true; }
+    else if (option == "search-archives") { config_options.search_archives = true; }
+    else if (option == "min-filesize" || option == "max-filesize") {
+        uint64_t size;
+        if (!FileFilter::parseSize(value, size)) {
+            result.error_message = "Invalid value for --" + option + ": " + value + " (expected a size such as 10M)";
+            result.success = false;
+            return result;
+        }
+        (option == "min-filesize" ? config_options.min_filesize : config_options.max_filesize) = size;
+    }
+    else if (option == "newer-than") {
+        int64_t time;
+        if (!FileFilter::parseNewerThan(value, time)) {
+            result.error_message = "Invalid value for --newer-than: " + value + " (expected an age such as 2d, or a file)";
+            result.success = false;
+            return result;
+        }
+        config_options.newer_than = value;
+    }
+    else if (option == "type") {
+        size_t start = 0;
+        while (start <= value.size()) {
+            size_t end = std::min(value.find(',', start), value.size());
+            std::string type = value.substr(start, end - start);
+            if (!FileFilter::typePatterns(type)) {
+                result.error_message = "Unknown type for --type: " + type + " (known: " + FileFilter::typeNames() + ")";
+                result.success = false;
+                return result;
+            }
+            config_options.types.push_back(type);
+            start = end + 1;
+        }
+    }
     else if (option == "backup") { config_options.backup = true; }
     else if (option == "preview") { config_options.preview = true; }
+    else if (option == "stats") {
+        if (!value.empty() && value != "text" && value != "json") {
+            result.error_message = "Invalid value for --stats: " + value;
+            result.success = false;
+            return result;
+        }
+        config_options.stats = true;
+        config_options.stats_json = (value == "json");
+    }
     
     return result;
 }
@@ -7,11 +7,24 @@
 
 class ArgumentParser {
 public:
+    enum class ValueKind {
+        NONE,
+        OPTIONAL,   // only as --option=value
+        REQUIRED    // --option=value or --option value
+    };
+    
     struct ArgumentDefinition {
         char short_option;
         std::string long_option;
         std::string description;
         bool* flag_ptr;
+        ValueKind value_kind;
+        std::string value_name;
+        
+        ArgumentDefinition(char short_opt, std::string long_opt, std::string desc, bool* flag,
+                           ValueKind kind = ValueKind::NONE, std::string value = "")
+            : short_option(short_opt), long_option(std::move(long_opt)), description(std::move(desc)),
+              flag_ptr(flag), value_kind(kind), value_name(std::move(value)) {}
     };
     
     ArgumentParser();
@@ -31,13 +44,13 @@ public:
 private:
     std::vector<ArgumentDefinition> argument_definitions_;
     std::map<char, bool*> short_options_;
-    std::map<std::string, bool*> long_options_;
+    std::map<std::string, const ArgumentDefinition*> long_options_;
     
     void initializeArguments();
     
     ParseResult parseShortOptions(const std::string& options, FartConfig::Options& config_options);
     
-    ParseResult parseLongOption(const std::string& option, FartConfig::Options& config_options);
+    ParseResult parseLongOption(const std::string& option, const std::string& value, FartConfig::Options& config_options);
     
     bool isValidOption(char option) const;
     
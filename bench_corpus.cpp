@@ -0,0 +1,159 @@
+#include "bench_corpus.hpp"
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <vector>
+
+CorpusGenerator::CorpusGenerator(uint64_t seed) : rng_(seed) {}
+
+std::string CorpusGenerator::generateText(const TextOptions& options) {
+    int matches = 0;
+    return generateText(options, matches);
+}
+
+std::string CorpusGenerator::generateText(const TextOptions& options, int& matches) {
+    std::string out;
+    out.reserve(options.bytes + options.line_length + options.needle.size());
+    std::bernoulli_distribution has_needle(options.match_density);
+
+    matches = 0;
+    while (out.size() < options.bytes) {
+        size_t line_start = out.size();
+        bool needle_placed = options.needle.empty() || !has_needle(rng_);
+        size_t needle_at = std::uniform_int_distribution<size_t>(0, options.line_length)(rng_);
+
+        while (out.size() - line_start < options.line_length) {
+            if (!needle_placed && out.size() - line_start >= needle_at) {
+                if (options.as_word && out.size() > line_start) {
+                    out += ' ';
+                }
+                appendNeedle(out, options.needle, options.mixed_case);
+                needle_placed = true;
+                matches++;
+            }
+            if (out.size() > line_start) {
+                out += ' ';
+            }
+            appendWord(out);
+        }
+        if (!needle_placed) {
+            out += ' ';
+            appendNeedle(out, options.needle, options.mixed_case);
+            matches++;
+        }
+        out += '\n';
+    }
+
+    return out;
+}
+
+std::string CorpusGenerator::generateBinary(size_t bytes) {
+    std::string out(bytes, '\0');
+    std::uniform_int_distribution<int> byte(0, 255);
+    for (auto& c : out) {
+        c = static_cast<char>(byte(rng_));
+    }
+    return out;
+}
+
+CorpusGenerator::TreeInfo CorpusGenerator::generateTree(const std::filesystem::path& root,
+                                                         const TreeOptions& options) {
+    TreeInfo info;
+
+    std::vector<std::filesystem::path> dirs = {root};
+    std::filesystem::create_directories(root);
+
+    std::vector<std::filesystem::path> level = {root};
+    for (int d = 0; d < options.depth; ++d) {
+        std::vector<std::filesystem::path> next;
+        for (const auto& parent : level) {
+            for (int i = 0; i < options.dirs_per_level; ++i) {
+                // Appended, since "d" + std::string trips a false -Wrestrict in GCC 12 at -O2
+                auto dir = parent / std::string("d").append(std::to_string(d)).append("_").append(std::to_string(i));
+                std::filesystem::create_directories(dir);
+                next.push_back(dir);
+                info.directories++;
+            }
+        }
+        dirs.insert(dirs.end(), next.begin(), next.end());
+        level = std::move(next);
+    }
+
+    std::bernoulli_distribution is_binary(options.binary_fraction);
+    std::uniform_int_distribution<size_t> pick_dir(0, dirs.size() - 1);
+
+    for (int i = 0; i < options.files; ++i) {
+        size_t size = pickFileSize(options.min_file_size, options.max_file_size);
+        std::string content;
+        bool binary = is_binary(rng_);
+
+        if (binary) {
+            content = generateBinary(size);
+            info.binary_files++;
+        } else {
+            TextOptions text;
+            text.bytes = size;
+            text.line_length = options.line_length;
+            text.match_density = options.match_density;
+            text.needle = options.needle;
+            int matches = 0;
+            content = generateText(text, matches);
+            info.matches += matches;
+            info.text_bytes += content.size();
+        }
+
+        auto path = dirs[pick_dir(rng_)] / std::string("f").append(std::to_string(i)).append(options.extension);
+        std::ofstream file(path, std::ios::binary);
+        file.write(content.data(), static_cast<std::streamsize>(content.size()));
+
+        info.files++;
+        info.total_bytes += content.size();
+    }
+
+    return info;
+}
+
+std::string CorpusGenerator::makeNeedle(size_t length) {
+    static const char alphabet[] = "uvwxyz";
+    std::string needle;
+    needle.reserve(length);
+    for (size_t i = 0; i < length; ++i) {
+        needle += alphabet[(i * 7 + i / 6) % 6];
+    }
+    return needle;
+}
+
+void CorpusGenerator::appendWord(std::string& out) {
+    std::uniform_int_distribution<int> length(2, 9);
+    std::uniform_int_distribution<int> letter('a', 't');
+    int n = length(rng_);
+    for (int i = 0; i < n; ++i) {
+        out += static_cast<char>(letter(rng_));
+    }
+}
+
+void CorpusGenerator::appendNeedle(std::string& out, const std::string& needle, bool mixed_case) {
+    if (!mixed_case) {
+        out += needle;
+        return;
+    }
+
+    int variant = std::uniform_int_distribution<int>(0, 2)(rng_);
+    for (size_t i = 0; i < needle.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(needle[i]);
+        if (variant == 1 || (variant == 2 && i == 0)) {
+            out += static_cast<char>(std::toupper(c));
+        } else {
+            out += static_cast<char>(std::tolower(c));
+        }
+    }
+}
+
+size_t CorpusGenerator::pickFileSize(size_t min_size, size_t max_size) {
+    if (max_size <= min_size) {
+        return min_size;
+    }
+    std::uniform_real_distribution<double> exponent(std::log(static_cast<double>(min_size)),
+                                                    std::log(static_cast<double>(max_size)));
+    return static_cast<size_t>(std::exp(exponent(rng_)));
+}
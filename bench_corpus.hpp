@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <random>
+#include <filesystem>
+
+// Deterministic synthetic input for benchmarks and comparison runs.
+// The filler text only uses the letters a-t, the needles only u-z, so the
+// number of matches is exactly the number of needles that were inserted.
+class CorpusGenerator {
+public:
+    struct TextOptions {
+        size_t bytes = 1 << 20;
+        size_t line_length = 80;
+        double match_density = 0.01;     // fraction of lines containing the needle
+        std::string needle = "uvwxyz";
+        bool mixed_case = false;         // insert needle as lower/UPPER/Title case
+        bool as_word = true;             // surround needle with spaces
+    };
+
+    struct TreeOptions {
+        int files = 100;
+        int depth = 2;
+        int dirs_per_level = 4;
+        size_t min_file_size = 1024;
+        size_t max_file_size = 64 * 1024;  // sizes are log-uniform in [min, max]
+        size_t line_length = 80;
+        double binary_fraction = 0.0;
+        double match_density = 0.01;
+        std::string needle = "uvwxyz";
+        std::string extension = ".txt";
+    };
+
+    struct TreeInfo {
+        int files = 0;
+        int binary_files = 0;
+        int directories = 0;
+        int matches = 0;
+        uint64_t total_bytes = 0;
+        uint64_t text_bytes = 0;
+    };
+
+    explicit CorpusGenerator(uint64_t seed = 0x46415254);
+
+    std::string generateText(const TextOptions& options);
+
+    std::string generateText(const TextOptions& options, int& matches);
+
+    std::string generateBinary(size_t bytes);
+
+    TreeInfo generateTree(const std::filesystem::path& root, const TreeOptions& options);
+
+    static std::string makeNeedle(size_t length);
+
+private:
+    std::mt19937_64 rng_;
+
+    void appendWord(std::string& out);
+
+    void appendNeedle(std::string& out, const std::string& needle, bool mixed_case);
+
+    size_t pickFileSize(size_t min_size, size_t max_size);
+};
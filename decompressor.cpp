@@ -0,0 +1,161 @@
+#include "decompressor.hpp"
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef FART_ZLIB
+#include <zlib.h>
+#endif
+#ifdef FART_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+constexpr size_t INPUT_SIZE = 64 * 1024;
+
+}  // namespace
+
+struct Decompressor::State {
+    std::vector<char> input = std::vector<char>(INPUT_SIZE);
+    size_t input_pos = 0;
+    size_t input_end = 0;
+    bool input_done = false;
+    bool finished = false;  // a frame or member ended; more may follow
+    bool padding = false;   // zeros after the last gzip member
+#ifdef FART_ZLIB
+    z_stream zlib{};
+#endif
+#ifdef FART_ZSTD
+    ZSTD_DStream* zstd = nullptr;
+#endif
+};
+
+Decompressor::Format Decompressor::detect(std::string_view head) {
+    if (head.size() >= 2 && head[0] == '\x1f' && head[1] == '\x8b') {
+        return Format::GZIP;
+    }
+    if (head.size() >= 4 && head.substr(0, 4) == std::string_view("\x28\xb5\x2f\xfd", 4)) {
+        return Format::ZSTD;
+    }
+    return Format::NONE;
+}
+
+bool Decompressor::supported(Format format) {
+    switch (format) {
+#ifdef FART_ZLIB
+    case Format::GZIP:
+        return true;
+#endif
+#ifdef FART_ZSTD
+    case Format::ZSTD:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+Decompressor::Decompressor(Format format, Source source)
+    : format_(format), source_(std::move(source)), state_(std::make_unique<State>()) {
+    if (!supported(format)) {
+        throw std::runtime_error("unsupported compression format");
+    }
+#ifdef FART_ZLIB
+    // 16 + MAX_WBITS: a gzip header, not a bare zlib stream
+    if (format_ == Format::GZIP && inflateInit2(&state_->zlib, 16 + MAX_WBITS) != Z_OK) {
+        throw std::runtime_error("could not start decompression");
+    }
+#endif
+#ifdef FART_ZSTD
+    if (format_ == Format::ZSTD && !(state_->zstd = ZSTD_createDStream())) {
+        throw std::runtime_error("could not start decompression");
+    }
+#endif
+}
+
+Decompressor::~Decompressor() {
+#ifdef FART_ZLIB
+    if (format_ == Format::GZIP) {
+        inflateEnd(&state_->zlib);
+    }
+#endif
+#ifdef FART_ZSTD
+    if (format_ == Format::ZSTD) {
+        ZSTD_freeDStream(state_->zstd);
+    }
+#endif
+}
+
+size_t Decompressor::read(char* buffer, size_t size) {
+#if !defined(FART_ZLIB) && !defined(FART_ZSTD)
+    (void)buffer;
+    (void)size;
+#endif
+    State& state = *state_;
+    while (true) {
+        if (state.input_pos == state.input_end && !state.input_done) {
+            state.input_end = source_(state.input.data(), state.input.size());
+            state.input_pos = 0;
+            state.input_done = state.input_end == 0;
+        }
+        if (state.input_pos == state.input_end && state.input_done) {
+            // Input may end only where a member or frame did
+            if (!state.finished) {
+                throw std::runtime_error("unexpected end of compressed data");
+            }
+            return 0;
+        }
+
+        size_t produced = 0;
+#ifdef FART_ZLIB
+        if (format_ == Format::GZIP && state.finished && (state.padding || state.input[state.input_pos] == '\0')) {
+            // Zeros after a complete member are padding (tape blocks, some
+            // writers), which gzip -d ignores too; nothing may follow them
+            state.padding = true;
+            while (state.input_pos < state.input_end && state.input[state.input_pos] == '\0') {
+                state.input_pos++;
+            }
+            if (state.input_pos < state.input_end) {
+                throw std::runtime_error("corrupt gzip data: garbage after padding");
+            }
+            continue;
+        }
+        if (format_ == Format::GZIP) {
+            z_stream& zlib = state.zlib;
+            if (state.finished) {
+                // Concatenated gzip members, as rotated logs often are
+                inflateReset(&zlib);
+                state.finished = false;
+            }
+            zlib.next_in = reinterpret_cast<Bytef*>(state.input.data() + state.input_pos);
+            zlib.avail_in = static_cast<uInt>(state.input_end - state.input_pos);
+            zlib.next_out = reinterpret_cast<Bytef*>(buffer);
+            zlib.avail_out = static_cast<uInt>(size);
+            int status = inflate(&zlib, Z_NO_FLUSH);
+            if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+                throw std::runtime_error(std::string("corrupt gzip data") + (zlib.msg ? ": " + std::string(zlib.msg) : ""));
+            }
+            state.input_pos = state.input_end - zlib.avail_in;
+            state.finished = status == Z_STREAM_END;
+            produced = size - zlib.avail_out;
+        }
+#endif
+#ifdef FART_ZSTD
+        if (format_ == Format::ZSTD) {
+            ZSTD_inBuffer in = {state.input.data(), state.input_end, state.input_pos};
+            ZSTD_outBuffer out = {buffer, size, 0};
+            size_t hint = ZSTD_decompressStream(state.zstd, &out, &in);
+            if (ZSTD_isError(hint)) {
+                throw std::runtime_error(std::string("corrupt zstd data: ") + ZSTD_getErrorName(hint));
+            }
+            state.input_pos = in.pos;
+            state.finished = hint == 0;
+            produced = out.pos;
+        }
+#endif
+        if (produced > 0) {
+            return produced;
+        }
+    }
+}
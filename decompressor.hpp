@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string_view>
+
+// Stream decompression of gzip and zstd files, so grep mode searches a
+// rotated log as the text it holds. The format is told by the magic bytes;
+// each is available only when fart was built with its library (the CMake
+// options FART_ZLIB and FART_ZSTD), otherwise such files stay binary.
+class Decompressor {
+public:
+    enum class Format { NONE, GZIP, ZSTD };
+
+    // Reads up to size compressed bytes; 0 at the end of the input
+    using Source = std::function<size_t(char* buffer, size_t size)>;
+
+    // Format of a file starting with head (its first few bytes)
+    static Format detect(std::string_view head);
+    static bool supported(Format format);
+
+    Decompressor(Format format, Source source);
+    ~Decompressor();
+
+    Decompressor(const Decompressor&) = delete;
+    Decompressor& operator=(const Decompressor&) = delete;
+
+    // Up to size decompressed bytes; 0 at the end. Throws std::runtime_error
+    // on corrupt or truncated input.
+    size_t read(char* buffer, size_t size);
+
+private:
+    struct State;
+
+    Format format_;
+    Source source_;
+    std::unique_ptr<State> state_;
+};
@@ -36,7 +36,7 @@
 // * CVS-compatible file renaming
 // * don't use temp file, unless needed
 // * invert-mode for FART
-// * rename folders
+// * rename folders													done
 // * allow use of wildmat() on WIN32 too (but case-insensitive)
 // * UNICODE version
 
@@ -44,6 +44,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 
 #include "fart_shared.h"
 
@@ -69,8 +70,12 @@
 
 #else // _WIN32
 
-#include <unistd.h>						// for fork,execlp
-#include <sys/wait.h>					// for wait
+#include <unistd.h>						// for fork,execvp
+#include <sys/wait.h>					// for waitpid
+#include <sys/stat.h>					// for fstatat
+#include <fcntl.h>						// for open(O_DIRECTORY)
+
+extern char **environ;
 
 # define _DIR_SEPARATOR		'/'
 # define DIR_CURRENT		"./"
@@ -83,6 +88,7 @@
 // Output strings (eventually customizable)
 static const char __temp_file[16] = "_fart.~";
 static const char __backup_suffix[16] = ".bak";			// fart.cpp.bak
+static const char __staged_suffix[16] = ".fart~";			// fart.cpp.fart~
 static const char __linenumber[16] = "[%4i]";				// [   2]
 static const char __filename[16] = "%s\n";				// fart.cpp
 static const char __filename_count[16] = "%s [%i]\n";		// fart.cpp [2]
@@ -109,6 +115,12 @@ bool	_Names = false;
 bool	_Binary = false;
 bool	_CStyle = false;
 bool	_Remove = false;
+bool	_VcsEdit = false;
+bool	_FilesFrom = false;
+bool	_Null = false;
+bool	RenameFolders = false;			// also pass matching folders to the file function
+const char* VcsCommand = "cvs edit";
+const char* FilesFrom = NULL;
 
 struct argument_t
 {
@@ -124,6 +136,8 @@ struct argument_t
 //	{ &_Options, ' ', "", "No more options after this" },			// --
 	// find options
 	{ &_SubDir, 'r', "recursive", "Process sub-folders recursively" },
+	{ &_FilesFrom, ' ', "files-from", "Process the files listed in file (- for stdin) instead of wildcard (--files-from=file)" },
+	{ &_Null, '0', "null", "File names in --files-from end with NUL, not newline" },
 #ifdef _WIN32
 	{ &_SubDir, 's', "subdir", NULL },
 #endif
@@ -139,6 +153,7 @@ struct argument_t
 	{ &_CStyle, 'C', "c-style", "Allow C-style extended characters (\\xFF\\0\\t\\n\\r\\\\ etc.)" },
 	// fart specific options
 	{ &_CVS, ' ', "cvs", "Skip cvs dirs; execute \"cvs edit\" before changing files" },
+	{ &_VcsEdit, ' ', "vcs-edit", "Execute \"<cmd> <files>\" in batches before changing files (--vcs-edit=cmd)" },
 	{ &_SVN, ' ', "svn", "Skip svn dirs" },
 	{ &_GIT, ' ', "git", "Skip git dirs (default)" },
 	{ &_Remove, ' ', "remove", "Remove all occurences of the find_string" },
@@ -163,20 +178,26 @@ char	FindString[MAXSTRING];
 int		ReplaceLength = 0;
 char	ReplaceString[MAXSTRING];
 
-char	ReplaceStringLwr[MAXSTRING], ReplaceStringUpr[MAXSTRING];
+char	ReplaceStringLwr[MAXSTRING], ReplaceStringUpr[MAXSTRING], ReplaceStringTtl[MAXSTRING];
 
 char	fart_buf[MAXSTRING];
 
+#define READ_BLOCK	65536						// Input is read in blocks this size
+
 // Macro's for output to stderr, first flush stdout and later stderr
 #define ERRPRINTF( s ) fflush(stdout),fprintf( stderr, s ),fflush(stderr)
 #define ERRPRINTF1( s, a ) fflush(stdout),fprintf( stderr, s, a ),fflush(stderr)
 #define ERRPRINTF2( s, a, b ) fflush(stdout),fprintf( stderr, s, a, b ),fflush(stderr)
+#define ERRPRINTF3( s, a, b, c ) fflush(stdout),fprintf( stderr, s, a, b, c ),fflush(stderr)
 
 ///////////////////////////////////////////////////////////////////////////////
 // Callback function for 'for_all_files' and 'for_all_files_recursive'
 
 typedef int (*file_func_t)( const char* dir, const char* file );
 
+// Directory listings and paths of the walk; released after each directory
+arena_t	walk_arena = { NULL, NULL };
+
 ///////////////////////////////////////////////////////////////////////////////
 
 inline bool _iswordchar( char c )
@@ -217,7 +238,7 @@ int cstyle( char *buffer )
 			case '6':
 			case '7':
 			{
-				int x, n=0;
+				unsigned x; int n=0;
 				sscanf(cur,"%3o%n",&x,&n);
 				cur += n-1;
 				*buffer++ = (char)x;
@@ -225,7 +246,7 @@ int cstyle( char *buffer )
 			}
 			case 'x':								// hexadecimal
 			{
-				int x, n=0;
+				unsigned x; int n=0;
 				sscanf(cur+1,"%2x%n",&x,&n);
 				if (n>0)
 				{
@@ -233,10 +254,11 @@ int cstyle( char *buffer )
 					*buffer++ = (char)x;
 					break;
 				}
-				// seep through
 			}
+			// fall through
 			default:
 				ERRPRINTF1( "Warning: unrecognized character escape sequence: \\%c\n", *cur );
+				// fall through
 			case '\\':
 			case '\?':
 			case '\'':
@@ -256,21 +278,139 @@ int cstyle( char *buffer )
 ///////////////////////////////////////////////////////////////////////////////
 // Prepares a line for text comparison
 
-const char* get_compare_buf( const char *in )
+const char* get_compare_buf( const char *in, size_t len )
 {
-static char compare_buf[MAXSTRING];
+static char *compare_buf = NULL;
+static size_t compare_size = 0;
 
 	if (_IgnoreCase)
 	{
 		// Copy the text into an extra buffer (used just for comparison)
-		strcpy( compare_buf, in );
+		if (len>=compare_size)
+		{
+			size_t size = compare_size?compare_size:MAXSTRING;
+			while (size<=len)
+				size *= 2;
+			char *buf = (char*)realloc( compare_buf, size );
+			if (!buf)
+			{
+				ERRPRINTF( "Error: out of memory\n" );
+				exit(-1);
+			}
+			compare_buf = buf;
+			compare_size = size;
+		}
+		memcpy( compare_buf, in, len );
+		compare_buf[len] = '\0';
 		// Compare lowercase (assume FindString already is lowercase)
-		strlwr( compare_buf );
+		memlwr( compare_buf, len );
 		return compare_buf;
 	}
 	return in;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Block reader: hands out lines of any length (including the '\n', if any).
+// Lines are not NUL-terminated and may contain NUL characters.
+
+struct line_reader_t
+{
+	FILE		*f;
+	char		*block;							// READ_BLOCK bytes of input
+	size_t		block_pos, block_len;
+	char		*line;							// for lines spanning blocks
+	size_t		line_size;
+	const char	*text;							// the current line
+	size_t		length;
+};
+
+void reader_open( line_reader_t *r, FILE *f )
+{
+	memset( r, 0, sizeof(*r) );
+	r->f = f;
+	r->block = (char*)malloc( READ_BLOCK );
+	if (!r->block)
+	{
+		ERRPRINTF( "Error: out of memory\n" );
+		exit(-1);
+	}
+}
+
+void reader_close( line_reader_t *r )
+{
+	free( r->block );
+	free( r->line );
+}
+
+// Reads as much as is available, so pipes are processed while they are written
+size_t reader_fill( line_reader_t *r )
+{
+#ifdef _WIN32
+	return fread( r->block, 1, READ_BLOCK, r->f );
+#else
+	ssize_t got;
+	do
+		got = read( fileno(r->f), r->block, READ_BLOCK );
+	while (got<0 && errno==EINTR);
+	return got>0?(size_t)got:0;
+#endif
+}
+
+// Appends to the line buffer, growing it as needed
+void reader_append( line_reader_t *r, const char *data, size_t len )
+{
+	if (r->length+len>r->line_size)
+	{
+		size_t size = r->line_size?r->line_size:READ_BLOCK;
+		while (size<r->length+len)
+			size *= 2;
+		char *line = (char*)realloc( r->line, size );
+		if (!line)
+		{
+			ERRPRINTF( "Error: out of memory\n" );
+			exit(-1);
+		}
+		r->line = line;
+		r->line_size = size;
+	}
+	memcpy( r->line+r->length, data, len );
+	r->length += len;
+	r->text = r->line;
+}
+
+// Returns 'false' at the end of the input
+bool read_line( line_reader_t *r )
+{
+	r->length = 0;
+	for (;;)
+	{
+		if (r->block_pos==r->block_len)
+		{
+			r->block_pos = 0;
+			r->block_len = reader_fill(r);
+			if (!r->block_len)
+				return r->length>0;				// last line without '\n'
+		}
+
+		const char *start = r->block + r->block_pos;
+		size_t avail = r->block_len - r->block_pos;
+		const char *nl = (const char*)memchr( start, '\n', avail );
+		size_t len = nl?(size_t)(nl-start)+1:avail;
+		r->block_pos += len;
+
+		if (nl && !r->length)
+		{
+			// The whole line is inside the block: no need to copy it
+			r->text = start;
+			r->length = len;
+			return true;
+		}
+		reader_append( r, start, len );
+		if (nl)
+			return true;
+	}
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -306,37 +446,34 @@ bool is_wildcard( const char* wc )
 ///////////////////////////////////////////////////////////////////////////////
 // Method that prints a string with CR/LF temporarily cut off
 
-void puts_nocrlf( char *_buf )
+void puts_nocrlf( const char *_buf, size_t nl )
 {
-	int nl = strlen(_buf);
-
 	while (nl>0 && (_buf[nl-1]=='\r' || _buf[nl-1]=='\n')) nl--;
 
-	char o = _buf[nl];
-	_buf[nl] = '\0';				// chop off the CR/LF
-	puts(_buf);						// to stdout
-	_buf[nl] = o;					// restore
+	fwrite( _buf, 1, nl, stdout );	// to stdout, CR/LF chopped off
+	putchar( '\n' );
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 // Returns the number of times the find string occurs in the input string
 
-int findtext_line_count( const char *_line )
+int findtext_line_count( const char *_line, size_t len )
 {
-	const char *line = get_compare_buf(_line);
+	const char *line = get_compare_buf(_line,len);
+	const char *end = line + len;
 
 	int count = 0;
 	const char *cur = line;
 	const char *t;
-	while ((t = strstr( cur, FindString )))
+	while ((t = _memmem( cur, end-cur, FindString, FindLength )))
 	{
 		cur = t + FindLength;
 		if (_WholeWord)
 		{
 			if (t>line && _iswordchar(t[-1]))
 				continue;
-			if (_iswordchar(t[FindLength]))
+			if (cur<end && _iswordchar(*cur))
 				continue;
 		}
 		count++;
@@ -349,7 +486,7 @@ int findtext_line_count( const char *_line )
 
 const char* findtext_line( const char* _line )
 {
-	const char *line = get_compare_buf(_line);
+	const char *line = get_compare_buf(_line,strlen(_line));
 
 	// Find the string in this line (FindString is lower case if _IgnoreCase)
 	const char *cur = line;
@@ -379,15 +516,15 @@ int _findtext( FILE* f, const char *filename )
 	bool first = true;						// first occurence in this file?
 	int ln=0;								// line number
 
-	while (!feof(f))
+	line_reader_t reader;
+	reader_open( &reader, f );
+	while (read_line( &reader ))
 	{
 		ln++;
-		if (!fgets( fart_buf, MAXSTRING, f ))
-			break;
 
 //		char *t = findtext_line( fart_buf );
 		// no need to know the exact occurence, just count
-		int t = findtext_line_count( fart_buf );
+		int t = findtext_line_count( reader.text, reader.length );
 
 		if (_Invert)
 		{
@@ -427,8 +564,9 @@ int _findtext( FILE* f, const char *filename )
 		if (_Numbers)
 			printf( __linenumber, ln );
 
-		puts_nocrlf( fart_buf );
+		puts_nocrlf( reader.text, reader.length );
 	}
+	reader_close( &reader );
 	return this_find_count;
 }
 
@@ -455,6 +593,9 @@ const char* pre_fart( const char* test )
 		else
 		if (i==ANALYZECASE_LOWER)
 			replacement = ReplaceStringLwr;
+		else
+		if (i==ANALYZECASE_TITLE)
+			replacement = ReplaceStringTtl;
 	}
 
 	// double-check to see whether anything will really changed
@@ -470,7 +611,7 @@ const char* pre_fart( const char* test )
 
 int fart_line( const char *_line, char *farted )
 {
-	const char *compare_buf = get_compare_buf(_line);
+	const char *compare_buf = get_compare_buf(_line,strlen(_line));
 
 	farted[0]='\0';
 
@@ -599,19 +740,21 @@ int _fart( FILE *f1, FILE *f2, const char* in )
 	int ln=0;
 
 	// Process input file while data available
-	while (!feof(f1))
+	line_reader_t reader;
+	reader_open( &reader, f1 );
+	while (read_line( &reader ))
 	{
 		ln++;
-		if (!fgets( fart_buf, MAXSTRING, f1 ))
-			break;
 
-		const char* b = get_compare_buf(fart_buf);
+		const char* line = reader.text;
+		const char* b = get_compare_buf(line,reader.length);
+		const char* end = b + reader.length;
 
 		bool first_line=true;
 		const char* bp = b;
 		while (1)
 		{
-			const char *t = strstr(bp,FindString);
+			const char *t = _memmem(bp,end-bp,FindString,FindLength);
 
 			// Check for word boundary
 			if (t && _WholeWord)
@@ -620,7 +763,7 @@ int _fart( FILE *f1, FILE *f2, const char* in )
 				if (t>bp && _iswordchar(t[-1]))
 					t = NULL;
 				else
-				if (_iswordchar(t[FindLength]))
+				if (t+FindLength<end && _iswordchar(t[FindLength]))
 					t = NULL;
 			}
 
@@ -628,16 +771,16 @@ int _fart( FILE *f1, FILE *f2, const char* in )
 			{
 				// find_string not found
 				if (f2)
-					fputs( fart_buf+(bp-b), f2 );
+					fwrite( line+(bp-b), 1, end-bp, f2 );
 				break;
 			}
 
 			// Adapt the replace_string to the actually found string
-			const char *replacement = pre_fart( fart_buf+(t-b) );
+			const char *replacement = pre_fart( line+(t-b) );
 			if (!replacement)
 			{
 				if (f2)
-					fputs( fart_buf+(bp-b), f2 );
+					fwrite( line+(bp-b), 1, end-bp, f2 );
 				break;
 			}
 
@@ -646,7 +789,9 @@ int _fart( FILE *f1, FILE *f2, const char* in )
 			// First occurence in this file?
 			if (first)
 			{
-				TotalFileCount++;
+				// Replaced files are counted once the original is replaced
+				if (_Preview)
+					TotalFileCount++;
 				first = false;
 				// Print the filename
 				if (!_Count && !_Quiet && in)
@@ -687,7 +832,7 @@ int _fart( FILE *f1, FILE *f2, const char* in )
 //			if (!f2)
 
 			// Write the text before the find_string
-			fwrite( fart_buf+(bp-b), 1, t-bp, f2 );
+			fwrite( line+(bp-b), 1, t-bp, f2 );
 			// Write the replace_string instead of the find_string
 			fwrite( replacement, 1, ReplaceLength, f2 );
 
@@ -698,9 +843,232 @@ int _fart( FILE *f1, FILE *f2, const char* in )
 			replace = true;
 		}
 	}
+	reader_close( &reader );
 	return replace?this_find_count:0;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// Replace the original file by the farted one (with backup if asked)
+
+bool replace_file( const char* in, const char* temp )
+{
+	bool ok = true;
+	if (_Backup)
+	{
+		// Append ".bak" to filename
+		char *backup = strdup2(in,__backup_suffix);
+		// Remove old backup, if any. Rename original file to backup-filename
+		if (remove( backup )!=0 && errno!=ENOENT)
+			ERRPRINTF1( "Error: could not remove: %s\n", backup ), ok = false;
+		else
+		if (rename( in, backup )!=0)
+			ERRPRINTF1( "Error: could not backup: %s\n", in ), ok = false;
+		free(backup);
+	}
+	else
+	{
+		// Remove original file
+		if (remove( in )!=0)
+			ERRPRINTF1( "Error: file is read only: %s\n", in ), ok = false;
+	}
+	// Rename temporary file to original filename
+	//  (will fail if we could not rename/remove the original file)
+	if (ok && rename( temp, in )!=0)
+		ok = false;
+
+	// Remove temporary file
+	// (either nothing has changed, or we failed to rename/remove the original file)
+	remove( temp );
+	return ok;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// Version control hook: "cvs edit" (or any --vcs-edit command) runs on batches
+// of changed files. The farted files are staged next to the originals and
+// replace them once the command for their batch has succeeded. While one
+// batch's command runs, the next batch is being collected.
+
+struct vcs_batch_t
+{
+	char	**files;						// original, staged, original, ...
+	int		*counts;						// occurences per file
+	int		num, size;
+	size_t	bytes;							// argument-list bytes used
+};
+
+char		**vcs_argv = NULL;				// command words; NULL when inactive
+int			vcs_argc = 0;
+size_t		vcs_limit = 0;					// argument-list bytes per batch
+vcs_batch_t	vcs_pending, vcs_running;
+#ifdef _WIN32
+intptr_t	vcs_process = -1;
+#else
+pid_t		vcs_process = -1;
+#endif
+
+bool vcs_init( const char* command )
+{
+	// Split the command into words, in place; double quotes group words
+	char *words = strdup(command);
+	vcs_argv = (char**)malloc( (strlen(command)/2+2)*sizeof(char*) );
+	if (!words || !vcs_argv)
+		return false;
+	char *out = words;
+	bool quoted = false, in_word = false;
+	for (const char *c=command;*c;c++)
+	{
+		if (*c=='"')
+			quoted = !quoted;
+		else
+		if (!quoted && (*c==' ' || *c=='\t'))
+		{
+			if (in_word)
+				*out++ = '\0', in_word = false;
+			continue;
+		}
+		if (!in_word)
+			vcs_argv[vcs_argc++] = out, in_word = true;
+		if (*c!='"')
+			*out++ = *c;
+	}
+	*out = '\0';
+	if (!vcs_argc)
+		return false;
+
+	// Leave room for the environment and the command itself
+	const size_t margin = 4096;
+#ifdef _WIN32
+	vcs_limit = 32767 - margin;					// CreateProcess limit
+#else
+	long arg_max = sysconf(_SC_ARG_MAX);
+	size_t used = margin;
+	for (char **env = environ;*env;env++)
+		used += strlen(*env) + 1 + sizeof(char*);
+	for (int t=0;t<vcs_argc;t++)
+		used += strlen(vcs_argv[t]) + 1 + sizeof(char*);
+	vcs_limit = arg_max>0 && (size_t)arg_max>2*used ? (size_t)arg_max-used : margin;
+	if (vcs_limit>(1<<20))
+		vcs_limit = 1<<20;
+#endif
+	return true;
+}
+
+// Waits for the running command; commits (or discards) its batch
+void vcs_wait()
+{
+	vcs_batch_t *b = &vcs_running;
+	if (!b->num)
+		return;
+
+	bool ok = vcs_process!=-1;
+	if (ok)
+	{
+		int status = 0;
+#ifdef _WIN32
+		ok = _cwait( &status, vcs_process, 0 )!=-1 && status==0;
+#else
+		while (waitpid( vcs_process, &status, 0 )==-1 && errno==EINTR)
+			;
+		ok = WIFEXITED(status) && WEXITSTATUS(status)==0;
+#endif
+		vcs_process = -1;
+	}
+	if (!ok)
+		ERRPRINTF2( "Error: %s failed; %i file(s) left unchanged\n", vcs_argv[0], b->num );
+
+	for (int t=0;t<b->num;t++)
+	{
+		char *in = b->files[t*2], *staged = b->files[t*2+1];
+		if (!ok)
+			remove( staged );
+		else
+		if (replace_file( in, staged ))
+		{
+			TotalFindCount += b->counts[t];
+			TotalFileCount++;
+		}
+		free( in );
+		free( staged );
+	}
+	b->num = 0;
+	b->bytes = 0;
+}
+
+// Starts the command on the pending batch (after finishing the running one)
+void vcs_launch()
+{
+	vcs_wait();
+
+	vcs_batch_t t = vcs_running;
+	vcs_running = vcs_pending;
+	vcs_pending = t;
+	if (!vcs_running.num)
+		return;
+
+	char **argv = (char**)malloc( (vcs_argc+vcs_running.num+1)*sizeof(char*) );
+	if (!argv)
+		return;									// vcs_wait reports the failure
+	memcpy( argv, vcs_argv, vcs_argc*sizeof(char*) );
+	for (int f=0;f<vcs_running.num;f++)
+		argv[vcs_argc+f] = vcs_running.files[f*2];
+	argv[vcs_argc+vcs_running.num] = NULL;
+
+	if (_Verbose)
+		ERRPRINTF2( "FART: %s on %i file(s)\n", vcs_argv[0], vcs_running.num );
+
+	// The command shares our stdout
+	fflush(stdout);
+#ifdef _WIN32
+	vcs_process = _spawnvp( _P_NOWAIT, argv[0], argv );
+#else
+	vcs_process = fork();
+	if (vcs_process==0)
+	{
+		// child process; execute the command (will not return)
+		execvp( argv[0], argv );
+		_exit(127);
+	}
+#endif
+	free(argv);
+}
+
+void vcs_add( const char* in, const char* staged, int count )
+{
+	vcs_batch_t *b = &vcs_pending;
+	size_t bytes = strlen(in) + 1 + sizeof(char*);
+	if (b->num && b->bytes+bytes>vcs_limit)
+		vcs_launch();
+
+	if (b->num==b->size)
+	{
+		int size = b->size?b->size*2:64;
+		char **files = (char**)realloc( b->files, size*2*sizeof(char*) );
+		int *counts = (int*)realloc( b->counts, size*sizeof(int) );
+		if (files) b->files = files;
+		if (counts) b->counts = counts;
+		if (!files || !counts)
+		{
+			ERRPRINTF( "Error: out of memory\n" );
+			exit(-1);
+		}
+		b->size = size;
+	}
+	b->files[b->num*2] = strdup(in);
+	b->files[b->num*2+1] = strdup(staged);
+	b->counts[b->num++] = count;
+	b->bytes += bytes;
+}
+
+void vcs_finish()
+{
+	if (!vcs_argv)
+		return;
+	vcs_launch();
+	vcs_wait();
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 // Find and replace text in file (uses temporary file)
@@ -724,12 +1092,15 @@ bool fart( const char* in )
 		return false;
 	}
 
-	// Open temporary file for writing
-	FILE *f2 = fopen(__temp_file,"wb");
+	// Open temporary file for writing; staged next to the original for the vcs hook
+	char *staged = vcs_argv && !_Preview ? strdup2(in,__staged_suffix) : NULL;
+	const char *temp = staged?staged:__temp_file;
+	FILE *f2 = fopen(temp,"wb");
 	if (!f2)
 	{
 		ERRPRINTF( "Error: unable to create temporary file\n" );
 		fclose(f1);
+		free(staged);
 		return false;
 	}
 
@@ -747,68 +1118,43 @@ bool fart( const char* in )
 
 	if (this_find_count && !_Preview)
 	{
-		TotalFindCount += this_find_count;
-		if (_CVS)
+		if (staged)
 		{
-			if (_Verbose)
-				ERRPRINTF1( "FART: cvs edit %s\n", in );
-#ifdef _WIN32
-			// win32: check for read-only first?
-			_spawnlp( _P_WAIT, "cvs", "cvs", "edit", in, NULL );
-#else
-			if (fork()==0)
-			{
-				// child process; execute "cvs edit" (will not return)
-				execlp( "cvs", "cvs", "edit", in, NULL );
-			}
-			wait(NULL);
-#endif
-			// TODO: check return code; stop on failure
+			// Replaced after the vcs command has run on its batch
+			vcs_add( in, staged, this_find_count );
+			free(staged);
+			return true;
 		}
-
-		if (_Backup)
+		if (replace_file( in, temp ))
 		{
-			// Append ".bak" to filename
-			char *backup = strdup2(in,__backup_suffix);
-			// Remove old backup. Rename original file to backup-filename
-			if (remove( backup )!=0)
-				ERRPRINTF1( "Error: could not remove: %s\n", backup );
-			else
-			if (rename( in, backup )!=0)
-				ERRPRINTF1( "Error: could not backup: %s\n", in );
-			free(backup);
-		}
-		else
-		{
-			// Remove original file
-			if (remove( in )!=0)
-				ERRPRINTF1( "Error: file is read only: %s\n", in );
+			TotalFindCount += this_find_count;
+			TotalFileCount++;
 		}
-		// Rename temporary file to original filename
-		//  (will fail if we could not rename/remove the original file)
-		rename( __temp_file, in );
 	}
 
-	// Remove temporary file
-	// (either nothing has changed, or we failed to rename/remove the original file)
-	remove( __temp_file );
+	// Remove temporary file (nothing has changed)
+	remove( temp );
+	free(staged);
 
 	return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
-// Search for files matching a wildcard
-// FIXME: when fart'ing filenames, we might process a file twice!
+// Search for files matching any of the wildcards in a set
 
-int for_all_files( const char *dir, const char* wc, file_func_t _ff )
+int for_all_files( const char *dir, const globset_t* wc, file_func_t _ff )
 {
-	char ** spul = find_files(dir,wc,FINDFILES_FILES);
+	arena_mark_t mark = arena_mark(&walk_arena);
+	char ** spul = find_files(&walk_arena,dir,wc,FINDFILES_FILES);
 	if (!spul)
+	{
+		arena_release(&walk_arena,mark);
 		return 0;
+	}
 
 	if (_Verbose)
-		ERRPRINTF2( "FART: processing %s,%s\n",dir,wc);
+		ERRPRINTF1( "FART: processing %s\n",dir);
 
 	int count = 0;
 	for (int t=0;spul[t];t++)
@@ -817,10 +1163,10 @@ static char prog[] = "|/-||";
 static int progress = 0;
 		fprintf(stderr,"%c\r",prog[progress]); if (!prog[++progress]) progress=0;
 		count += _ff( dir, spul[t] );
-		free( spul[t] );
 	}
 
-	free(spul);
+	// Names and table go in one shot
+	arena_release(&walk_arena,mark);
 	return count;
 }
 
@@ -828,17 +1174,21 @@ static int progress = 0;
 ///////////////////////////////////////////////////////////////////////////////
 // Recurse through directory and search for files matching a wildcard
 
-int for_all_files_recursive( const char *dir, const char* wc, file_func_t _ff )
+int for_all_files_recursive( const char *dir, const globset_t* wc, file_func_t _ff )
 {
 	// First, process the current directory
 	int count = for_all_files(dir,wc,_ff);
 
 	// Now we recurse into folders
-	char ** spul = find_files(dir,WILDCARD_ALL,FINDFILES_DIRS);
+	arena_mark_t mark = arena_mark(&walk_arena);
+	char ** spul = find_files(&walk_arena,dir,NULL,FINDFILES_DIRS);
 	if (!spul)
+	{
+		arena_release(&walk_arena,mark);
 		return 0;
+	}
 
-	for (int t=0;spul[t];free(spul[t]),t++)
+	for (int t=0;spul[t];t++)
 	{
 		// Skip "."
 		if (!strcmp(spul[t],"."))
@@ -869,11 +1219,17 @@ int for_all_files_recursive( const char *dir, const char* wc, file_func_t _ff )
 			continue;
 		}
 
-		char *_path = strdup3(dir,spul[t],DIR_SEPARATOR);
-		count += for_all_files_recursive(_path,wc,_ff);
-		free(_path);
+		arena_mark_t path_mark = arena_mark(&walk_arena);
+		char *_path = arena_strdup3(&walk_arena,dir,spul[t],DIR_SEPARATOR);
+		if (_path)
+			count += for_all_files_recursive(_path,wc,_ff);
+		arena_release(&walk_arena,path_mark);
+
+		// When renaming, matching folders are renamed too (after their contents)
+		if (RenameFolders && globset_match(wc,spul[t],NULL))
+			count += _ff( dir, spul[t] );
 	}
-	free(spul);
+	arena_release(&walk_arena,mark);
 	return count;
 }
 
@@ -900,7 +1256,7 @@ int print_files( const char* dir, const char* file )
 
 ///////////////////////////////////////////////////////////////////////////////
 
-int for_all_files_smart( const char* dir, const char* file, file_func_t _ff )
+int for_all_files_smart( const char* dir, const globset_t* file, file_func_t _ff )
 {
 //	if (!is_wildcard(file) && !_SubDir)
 //		return _ff(dir,file);
@@ -914,52 +1270,154 @@ int for_all_files_smart( const char* dir, const char* file, file_func_t _ff )
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
-int for_all_wildcards( char *wildcard, file_func_t _ff )
+int for_all_wildcards( const char *wildcard, file_func_t _ff )
 {
-	int count = 0;
-	while (1)
+	arena_mark_t mark = arena_mark(&walk_arena);
+
+	// Count the pieces; the copy gets each piece NUL-terminated in place
+	int num = 1;
+	for (const char *c=wildcard;*c;c++)
+		num += *c==_WILDCARD_SEPARATOR;
+	char *copy = arena_strdup3(&walk_arena,wildcard,"","");
+	const char **dirs = (const char**)arena_alloc(&walk_arena,num*sizeof(char*));
+	const char **files = (const char**)arena_alloc(&walk_arena,num*sizeof(char*));
+	const char **patterns = (const char**)arena_alloc(&walk_arena,num*sizeof(char*));
+	if (!copy || !dirs || !files || !patterns)
+	{
+		ERRPRINTF( "Error: out of memory\n" );
+		arena_release(&walk_arena,mark);
+		return 0;
+	}
+
+	// First split every wildcard into a directory and a file pattern
+	int n = 0;
+	for (char *piece=copy;piece;n++)
 	{
-		char *wc_sep = strchr(wildcard,_WILDCARD_SEPARATOR);
+		char *wc_sep = strchr(piece,_WILDCARD_SEPARATOR);
 		if (wc_sep)
-			*wc_sep = '\0';
+			*wc_sep++ = '\0';
 
-		char *dir_sep = strrchr(wildcard,_DIR_SEPARATOR);
+		char *dir_sep = strrchr(piece,_DIR_SEPARATOR);
 #ifdef _DRIVE_SEPARATOR
 		if (!dir_sep)
-			dir_sep = strchr(wildcard,_DRIVE_SEPARATOR);
+			dir_sep = strchr(piece,_DRIVE_SEPARATOR);
 #endif
 		if (dir_sep)
 		{
 			dir_sep++;					// points to filename after slash
 			if (*dir_sep)				// filename available?
 			{
-				char *path = strdup(wildcard);
-				path[dir_sep - wildcard] = '\0';
-				count += for_all_files_smart( path, dir_sep, _ff );
-				free(path);
+				char *path = (char*)arena_alloc(&walk_arena,dir_sep-piece+1);
+				if (!path)
+					break;
+				memcpy( path, piece, dir_sep-piece );
+				path[dir_sep-piece] = '\0';
+				dirs[n] = path;
+				files[n] = dir_sep;
 			}
 			else
 			{
 				// No wildcard, assume ALL
-				count += for_all_files_smart( wildcard, WILDCARD_ALL, _ff );
+				dirs[n] = piece;
+				files[n] = WILDCARD_ALL;
 			}
 		}
 		else
-		if (strcmp(wildcard,".")==0)
-			count += for_all_files_smart( DIR_CURRENT, WILDCARD_ALL, _ff );
+		if (strcmp(piece,".")==0)
+			dirs[n] = DIR_CURRENT, files[n] = WILDCARD_ALL;
 		else
-		if (strcmp(wildcard,"..")==0)
-			count += for_all_files_smart( DIR_PARENT, WILDCARD_ALL, _ff );
+		if (strcmp(piece,"..")==0)
+			dirs[n] = DIR_PARENT, files[n] = WILDCARD_ALL;
 		else
-			count += for_all_files_smart( DIR_CURRENT, wildcard, _ff );
+			dirs[n] = DIR_CURRENT, files[n] = piece;
+
+		piece = wc_sep;					// next piece, if any
+	}
 
-		// No separator found? Finished.
-		if (!wc_sep)
+	// Then walk each directory once, matching all of its patterns at the same time
+	int count = 0;
+	for (int t=0;t<n;t++)
+	{
+		int np = 0, u;
+		for (u=0;u<t && strcmp(dirs[u],dirs[t]);u++)
+			;
+		if (u<t)
+			continue;					// walked already
+		for (u=t;u<n;u++)
+			if (strcmp(dirs[u],dirs[t])==0)
+				patterns[np++] = files[u];
+
+		globset_t *set = globset_compile( patterns, np, FILENAME_FOLDCASE );
+		if (!set)
+		{
+			ERRPRINTF( "Error: out of memory\n" );
 			break;
+		}
+		count += for_all_files_smart( dirs[t], set, _ff );
+		globset_free( set );
+	}
 
-		*wc_sep = _WILDCARD_SEPARATOR;		// restore
-		wildcard = wc_sep + 1;				// next piece
+	arena_release(&walk_arena,mark);
+	return count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Call the file function for every file named in a list (--files-from), as
+// soon as its name has been read; "-" reads the list from stdin
+
+int for_all_listed_files( const char *list, file_func_t _ff )
+{
+	FILE *f = strcmp(list,"-")==0 ? stdin : fopen(list,"rb");
+	if (!f)
+	{
+		ERRPRINTF1( "Error: could not open file list %s\n", list );
+		return 0;
 	}
+
+	const int sep = _Null ? '\0' : '\n';
+	size_t size = 256, len = 0;
+	char *name = (char*)malloc(size);
+	int count = 0;
+	int c;
+	do
+	{
+		c = getc(f);
+		if (c!=EOF && c!=sep)
+		{
+			if (len+1==size)
+			{
+				char *bigger = (char*)realloc(name,size*=2);
+				if (!bigger)
+					break;
+				name = bigger;
+			}
+			name[len++] = (char)c;
+			continue;
+		}
+		if (!_Null && len && name[len-1]=='\r')
+			len--;
+		if (!len)
+			continue;
+		name[len] = '\0';
+		len = 0;
+
+		// Split into directory and file name, as the walk does
+		char *dir_sep = strrchr(name,_DIR_SEPARATOR);
+		if (dir_sep)
+		{
+			char file[MAXSTRING];
+			strncpy( file, dir_sep+1, sizeof(file)-1 );
+			file[sizeof(file)-1] = '\0';
+			dir_sep[1] = '\0';
+			count += _ff( name, file );
+		}
+		else
+			count += _ff( "", name );
+	} while (c!=EOF);
+
+	free(name);
+	if (f!=stdin)
+		fclose(f);
 	return count;
 }
 
@@ -996,9 +1454,20 @@ void options_short( const char *options )
 
 void options_long( const char *option )
 {
+	// Only --vcs-edit and --files-from take a value (--vcs-edit=cmd)
+	const char *value = strchr(option,'=');
+	size_t len = value?(size_t)(value-option):strlen(option);
 	for (int tt=0;arguments[tt].state;tt++)
-		if (strcmp(arguments[tt].option_long,option)==0)
+		if (strncmp(arguments[tt].option_long,option,len)==0 && !arguments[tt].option_long[len])
 		{
+			bool *state = arguments[tt].state;
+			if ((state==&_VcsEdit || state==&_FilesFrom)!=(value!=NULL))
+				break;
+			if (state==&_VcsEdit)
+				VcsCommand = value+1;
+			else
+			if (state==&_FilesFrom)
+				FilesFrom = value+1;
 			*arguments[tt].state = true;
 			if (_Verbose)
 				ERRPRINTF1( "FART: --%s\n", arguments[tt].option_long );
@@ -1074,6 +1543,22 @@ void parse_options( int argc, char* argv[] )
 		ERRPRINTF1( "Error: redundant argument \"%s\".\n", argv[t] );
 		_Help = true;
 	}
+
+	// The file list takes the place of the wildcard; shift the strings down
+	if (_FilesFrom && HasWildCard)
+	{
+		if (ReplaceLength)
+		{
+			ERRPRINTF1( "Error: redundant argument \"%s\".\n", ReplaceString );
+			_Help = true;
+		}
+		ReplaceLength = FindLength;
+		memcpy( ReplaceString, FindString, FindLength+1 );
+		FindLength = strlen(WildCard);
+		memcpy( FindString, WildCard, FindLength+1 );
+		WildCard[0] = '\0';
+		HasWildCard = false;
+	}
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1085,7 +1570,7 @@ int findtext_file_path( const char* dir, const char* file )
 
 	if (_Names)
 	{
-		int count = findtext_line_count(file);
+		int count = findtext_line_count(file,strlen(file));
 		if (_Invert) count = !count;
 		if (count)
 		{
@@ -1105,6 +1590,257 @@ int findtext_file_path( const char* dir, const char* file )
 	return 1;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// Filenames are renamed after the walk, so a renamed file is never visited
+// twice and cannot clobber a file that has not been looked at yet. Within a
+// folder, a name claimed twice goes to neither file, chains (a=>b, b=>c) are
+// renamed back to front and cycles (a=>b, b=>a) go through a temporary name.
+// Folders are done deepest first, so their paths stay valid until everything
+// in them has been renamed.
+
+#define RENAME_PLANNED	0
+#define RENAME_CHAIN	1
+#define RENAME_DONE		2
+#define RENAME_CLASH	3
+
+struct rename_t
+{
+	const char	*dir;						// folder, including separator
+	const char	*from, *to;
+	int			count;						// occurences in the name
+	int			depth;						// separators in dir
+	int			next;						// rename that must vacate 'to' first, or -1
+	int			state;						// RENAME_*
+};
+
+arena_t		rename_arena = { NULL, NULL };	// names live until the plan has run
+rename_t	*renames = NULL;
+int			rename_num = 0, rename_size = 0;
+
+int name_compare( const char* n1, const char* n2 )
+{
+	return FILENAME_FOLDCASE?stricmp(n1,n2):strcmp(n1,n2);
+}
+
+void rename_add( const char* dir, const char* from, const char* to, int count )
+{
+	if (rename_num==rename_size)
+	{
+		int size = rename_size?rename_size*2:64;
+		rename_t *r = (rename_t*)realloc( renames, size*sizeof(rename_t) );
+		if (!r)
+		{
+			ERRPRINTF( "Error: out of memory\n" );
+			exit(-1);
+		}
+		renames = r;
+		rename_size = size;
+	}
+
+	rename_t *r = &renames[rename_num];
+	// The files of a folder arrive together; they share its name
+	if (rename_num && strcmp(renames[rename_num-1].dir,dir)==0)
+		r->dir = renames[rename_num-1].dir;
+	else
+		r->dir = arena_strdup3(&rename_arena,dir,"","");
+	r->from = arena_strdup3(&rename_arena,from,"","");
+	r->to = arena_strdup3(&rename_arena,to,"","");
+	if (!r->dir || !r->from || !r->to)
+	{
+		ERRPRINTF( "Error: out of memory\n" );
+		exit(-1);
+	}
+	r->count = count;
+	r->depth = 0;
+	for (const char *c=dir;*c;c++)
+		r->depth += *c==_DIR_SEPARATOR;
+	r->next = -1;
+	r->state = RENAME_PLANNED;
+	rename_num++;
+}
+
+// Deepest folders first, then by folder, then by new name
+int rename_order( const void* p1, const void* p2 )
+{
+	const rename_t *r1 = (const rename_t*)p1, *r2 = (const rename_t*)p2;
+	if (r1->depth!=r2->depth)
+		return r2->depth-r1->depth;
+	int d = strcmp(r1->dir,r2->dir);
+	return d?d:name_compare(r1->to,r2->to);
+}
+
+// Sorts indices into 'renames' by old name
+int rename_order_from( const void* p1, const void* p2 )
+{
+	return name_compare( renames[*(const int*)p1].from, renames[*(const int*)p2].from );
+}
+
+#ifdef _WIN32
+typedef const char* dir_handle_t;
+#else
+typedef int dir_handle_t;
+#endif
+
+// Renames a file inside a folder, never replacing an existing file
+int rename_noreplace( dir_handle_t dir, const char* from, const char* to )
+{
+	if (_Preview || strcmp(from,to)==0)
+		return 0;
+#ifdef _WIN32
+	// Unlike MoveFileEx, rename does not replace an existing file
+	char *path_from = strdup2(dir,from), *path_to = strdup2(dir,to);
+	int err = path_from && path_to && rename( path_from, path_to )==0 ? 0 : errno;
+	free(path_from);
+	free(path_to);
+	return err;
+#else
+# ifdef RENAME_NOREPLACE
+	if (renameat2( dir, from, dir, to, RENAME_NOREPLACE )==0)
+		return 0;
+	if (errno!=EINVAL && errno!=ENOSYS)
+		return errno;
+# endif
+	// No atomic variant (on this file system): check, then rename
+	struct stat st;
+	if (fstatat( dir, to, &st, AT_SYMLINK_NOFOLLOW )==0)
+		return EEXIST;
+	return renameat( dir, from, dir, to )==0 ? 0 : errno;
+#endif
+}
+
+void rename_done( rename_t *r, int err )
+{
+	if (err)
+	{
+		ERRPRINTF3( "Error: could not rename %s%s to %s", r->dir, r->from, r->to );
+		ERRPRINTF1( " (%s)\n", err==EEXIST?"file exists":strerror(err) );
+	}
+	else
+	{
+		// Filename was changed (only increment count if actually done)
+		if (!_Preview)
+			TotalFindCount += r->count;
+		printf( "%s%s => %s\n", r->dir, r->from, r->to );
+	}
+	r->state = RENAME_DONE;
+}
+
+// Runs the renames of one folder, renames[first..last)
+void rename_folder( int first, int last )
+{
+	int num = last-first, t;
+	int *by_from = (int*)malloc( num*sizeof(int) );
+	if (!by_from)
+	{
+		ERRPRINTF( "Error: out of memory\n" );
+		return;
+	}
+
+	// A name claimed twice goes to neither file (sorted by new name, so adjacent)
+	for (t=first+1;t<last;t++)
+		if (name_compare(renames[t-1].to,renames[t].to)==0)
+			renames[t-1].state = renames[t].state = RENAME_CLASH;
+	for (t=first;t<last;t++)
+	{
+		if (renames[t].state==RENAME_CLASH)
+		{
+			ERRPRINTF3( "Error: could not rename %s%s to %s", renames[t].dir, renames[t].from, renames[t].to );
+			ERRPRINTF( " (another file gets that name)\n" );
+		}
+		by_from[t-first] = t;
+	}
+
+	// Link each rename to the one that has to vacate its new name first
+	qsort( by_from, num, sizeof(int), rename_order_from );
+	for (t=first;t<last;t++)
+	{
+		if (renames[t].state==RENAME_CLASH || strcmp(renames[t].from,renames[t].to)==0)
+			continue;
+		int lo = 0, hi = num;
+		while (lo<hi)
+		{
+			int mid = (lo+hi)/2;
+			if (name_compare(renames[by_from[mid]].from,renames[t].to)<0)
+				lo = mid+1;
+			else
+				hi = mid;
+		}
+		if (lo<num && name_compare(renames[by_from[lo]].from,renames[t].to)==0 &&
+			renames[by_from[lo]].state!=RENAME_CLASH)
+			renames[t].next = by_from[lo];
+	}
+
+#ifdef _WIN32
+	dir_handle_t dir = renames[first].dir;
+#else
+	dir_handle_t dir = _Preview ? -1 : open( *renames[first].dir?renames[first].dir:".", O_RDONLY|O_DIRECTORY );
+	if (!_Preview && dir==-1)
+	{
+		ERRPRINTF2( "Error: could not open %s (%s)\n", renames[first].dir, strerror(errno) );
+		free(by_from);
+		return;
+	}
+#endif
+
+	// Follow each chain to its end and rename back to front; a chain that
+	// comes back on itself is a cycle, broken by parking one name
+	int *chain = by_from;						// no longer needed
+	for (int i=first;i<last;i++)
+	{
+		if (renames[i].state!=RENAME_PLANNED)
+			continue;
+		int len = 0, j = i;
+		for (;j!=-1 && renames[j].state==RENAME_PLANNED;j=renames[j].next)
+		{
+			renames[j].state = RENAME_CHAIN;
+			chain[len++] = j;
+		}
+
+		int parked = j!=-1 && renames[j].state==RENAME_CHAIN ? j : -1;
+		char *parking = NULL;
+		int err = 0;
+		if (parked!=-1)
+		{
+			parking = strdup2(renames[parked].from,__staged_suffix);
+			err = parking ? rename_noreplace( dir, renames[parked].from, parking ) : ENOMEM;
+		}
+		while (len--)
+		{
+			rename_t *r = &renames[chain[len]];
+			if (err)
+				rename_done( r, err );
+			else
+			if (chain[len]==parked)
+				rename_done( r, rename_noreplace( dir, parking, r->to ) );
+			else
+				rename_done( r, rename_noreplace( dir, r->from, r->to ) );
+		}
+		free(parking);
+	}
+
+#ifndef _WIN32
+	if (dir!=-1)
+		close(dir);
+#endif
+	free(by_from);
+}
+
+void rename_finish()
+{
+	qsort( renames, rename_num, sizeof(rename_t), rename_order );
+	for (int first=0,last;first<rename_num;first=last)
+	{
+		for (last=first+1;last<rename_num && strcmp(renames[last].dir,renames[first].dir)==0;last++)
+			;
+		rename_folder( first, last );
+	}
+	free(renames);
+	renames = NULL;
+	rename_num = rename_size = 0;
+	arena_free(&rename_arena);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -1117,24 +1853,9 @@ int fart_file_path( const char* dir, const char* file )
 		int count = fart_line(file,fart_buf);
 		if (count)
 		{
-			// fart_buf contains the new filename
+			// fart_buf contains the new filename; renamed after the walk
 			TotalFileCount++;
-
-			char *newpath = strdup2(dir,fart_buf);
-			// What about renaming files 'in' CVS?
-			if (_Preview || rename( _path, newpath )==0)
-			{
-				// Filename was changed (only increment count if actually done)
-				if (!_Preview)
-					TotalFindCount += count;
-				printf( __filename_rename, _path, fart_buf);
-			}
-			else
-			{
-				ERRPRINTF2("Error: could not rename %s to %s\n", _path, fart_buf );
-				// read-only: CVS?
-			}
-			free(newpath);
+			rename_add( dir, file, fart_buf, count );
 		}
 	}
 	else
@@ -1154,13 +1875,19 @@ int main( int argc, char* argv[] )
 {
 	parse_options( argc, argv );
 
-	if (_Help || !HasWildCard)
+	if (_Help || !(HasWildCard || _FilesFrom))
 	{
 		// S/He obviously needs some help
 		usage();
 		return -1;
 	}
 
+	if (_FilesFrom && !FindLength)
+	{
+		ERRPRINTF( "Error: option --files-from needs a find_string\n" );
+		return -1;
+	}
+
 	if (!FindLength)
 	{
 		// FIND-mode: search for files matching the wildcard
@@ -1201,7 +1928,7 @@ int main( int argc, char* argv[] )
 
 	// Case insensitive: we compare in lower case
 	if (_IgnoreCase && FindLength)
-		strlwr(FindString);									// FIXME: memlwr
+		memlwr(FindString,FindLength);
 
 	bool grepMode = (ReplaceLength==0);						// grep or fart?
 
@@ -1241,7 +1968,10 @@ int main( int argc, char* argv[] )
 		}
 
 		// Find text in files
-		for_all_wildcards( WildCard, &findtext_file_path );
+		if (_FilesFrom)
+			for_all_listed_files( FilesFrom, &findtext_file_path );
+		else
+			for_all_wildcards( WildCard, &findtext_file_path );
 		if (!_Quiet)
 			printf( "Found %i occurence(s) in %i file(s).\n", TotalFindCount, TotalFileCount);
 
@@ -1252,7 +1982,7 @@ int main( int argc, char* argv[] )
 	// FART-mode
 
 	memcpy( ReplaceStringLwr, ReplaceString, ReplaceLength+1 );
-	strlwr( ReplaceStringLwr );							// FIXME: memlwr
+	memlwr( ReplaceStringLwr, ReplaceLength );
 
 	if (_AdaptCase)
 	{
@@ -1261,18 +1991,23 @@ int main( int argc, char* argv[] )
 //			memcpy( ReplaceStringLwr, ReplaceString, ReplaceLength+1 );
 //			strlwr( ReplaceStringLwr );							// FIXME: memlwr
 			memcpy( ReplaceStringUpr, ReplaceString, ReplaceLength+1 );
-			strupr( ReplaceStringUpr );							// FIXME: memlwr
-			// We now have 3 strings: Lower, Mixed and Upper
+			memupr( ReplaceStringUpr, ReplaceLength );
+			memcpy( ReplaceStringTtl, ReplaceString, ReplaceLength+1 );
+			memttl( ReplaceStringTtl, ReplaceLength );
+			// We now have 4 strings: Lower, Mixed, Upper and Title
 		}
 		else
 		{
 			// OPTIMIZE: We only need to adapt the replace_string once
 			int i = analyze_case(FindString,FindLength);
 			if (i==ANALYZECASE_LOWER)
-				strlwr(ReplaceString);							// FIXME: memlwr
+				memlwr(ReplaceString,ReplaceLength);
 			else
 			if (i==ANALYZECASE_UPPER)
-				strupr(ReplaceString);							// FIXME: memlwr
+				memupr(ReplaceString,ReplaceLength);
+			else
+			if (i==ANALYZECASE_TITLE)
+				memttl(ReplaceString,ReplaceLength);
 			if (i && _Verbose)
 				ERRPRINTF1( "FART: actual replace_string=\"%s\"\n", ReplaceString );
 			_AdaptCase = false;
@@ -1311,7 +2046,19 @@ int main( int argc, char* argv[] )
 		ERRPRINTF( "Warning: fart may corrupt binary files\n" );
 	}
 
-	for_all_wildcards( WildCard, &fart_file_path );
+	if ((_CVS || _VcsEdit) && !_Preview && !vcs_init( VcsCommand ))
+	{
+		ERRPRINTF1( "Error: invalid --vcs-edit command \"%s\"\n", VcsCommand );
+		return -1;
+	}
+
+	RenameFolders = _Names;
+	if (_FilesFrom)
+		for_all_listed_files( FilesFrom, &fart_file_path );
+	else
+		for_all_wildcards( WildCard, &fart_file_path );
+	rename_finish();
+	vcs_finish();
 	if (!_Quiet)
 		printf( "Replaced %i occurence(s) in %i file(s).\n", TotalFindCount, TotalFileCount);
 
@@ -0,0 +1,166 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <unistd.h>
+
+#include "fart_config.hpp"
+#include "text_processor.hpp"
+#include "file_processor.hpp"
+#include "bench_corpus.hpp"
+#include "alloc_counter.hpp"
+
+// Regression tests for the allocation-free hot paths: once buffers are warm,
+// matching and replacing lines must not touch the heap, and processing a file
+// must cost the same number of allocations regardless of its line count.
+
+namespace {
+
+struct LineCase {
+    std::string name;
+    bool replace = false;
+    bool ignore_case = false;
+    bool whole_word = false;
+    bool adapt_case = false;
+};
+
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+int failures = 0;
+
+void check(bool ok, const std::string& name, uint64_t allocations, uint64_t units, const char* unit) {
+    std::cout << (ok ? "PASS " : "FAIL ") << name << ": " << allocations << " allocation(s) over "
+              << units << " " << unit << std::endl;
+    if (!ok) {
+        failures++;
+    }
+}
+
+uint64_t processLines(const TextProcessor& processor, const std::string& corpus, bool replace,
+                      std::string& output) {
+    uint64_t lines = 0;
+    std::string_view rest(corpus);
+    while (!rest.empty()) {
+        size_t eol = rest.find('\n');
+        std::string_view line = rest.substr(0, eol);
+        rest.remove_prefix(eol == std::string_view::npos ? rest.size() : eol + 1);
+
+        if (replace) {
+            output.clear();
+            processor.replaceLine(line, output);
+        } else {
+            processor.countMatches(line);
+        }
+        lines++;
+    }
+    return lines;
+}
+
+void testSteadyStateLines(const LineCase& test) {
+    CorpusGenerator generator;
+    CorpusGenerator::TextOptions text;
+    text.bytes = 256 << 10;
+    text.match_density = 0.2;
+    text.mixed_case = test.ignore_case;
+    const std::string corpus = generator.generateText(text);
+
+    FartConfig config;
+    config.setFindString(text.needle);
+    if (test.replace) {
+        config.setReplaceString("Replacement");
+    }
+    config.getOptions().ignore_case = test.ignore_case;
+    config.getOptions().whole_word = test.whole_word;
+    config.getOptions().adapt_case = test.adapt_case;
+
+    TextProcessor processor(config);
+    std::string output;
+    processLines(processor, corpus, test.replace, output);  // warm up the buffers
+
+    AllocationScope allocations;
+    uint64_t lines = processLines(processor, corpus, test.replace, output);
+    uint64_t count = allocations.count();
+
+    check(count == 0, "steady_state_" + test.name, count, lines, "lines");
+}
+
+uint64_t allocationsForFile(const std::filesystem::path& path, bool replace, const std::string& needle) {
+    FartConfig config;
+    config.setFindString(needle);
+    if (replace) {
+        config.setReplaceString("Replacement");
+        config.getOptions().preview = true;
+    }
+
+    FileProcessor processor(config);
+    NullBuffer null_buffer;
+    auto* saved = std::cout.rdbuf(&null_buffer);
+
+    AllocationScope allocations;
+    processor.processFile(path);
+    uint64_t count = allocations.count();
+
+    std::cout.rdbuf(saved);
+    return count;
+}
+
+// The difference between a short and a long file is the per-line cost
+void testPerFileCost(const std::filesystem::path& dir, bool replace) {
+    CorpusGenerator generator;
+    CorpusGenerator::TextOptions text;
+    text.match_density = 0.2;
+
+    auto write = [&](const std::string& name, size_t bytes) {
+        text.bytes = bytes;
+        auto path = dir / name;
+        std::ofstream(path, std::ios::binary) << generator.generateText(text);
+        return path;
+    };
+
+    auto small = write("small.txt", 16 << 10);
+    auto large = write("large.txt", 4 << 20);
+
+    allocationsForFile(small, replace, text.needle);  // warm up iostreams and locale state
+    uint64_t small_count = allocationsForFile(small, replace, text.needle);
+    uint64_t large_count = allocationsForFile(large, replace, text.needle);
+
+    // Block buffers may grow a few times for longer files, but nothing may scale with lines
+    constexpr uint64_t SLACK = 4;
+    uint64_t extra = large_count > small_count ? large_count - small_count : 0;
+    uint64_t extra_lines = ((4 << 20) - (16 << 10)) / (text.line_length + 1);
+    check(extra <= SLACK, std::string("file_") + (replace ? "replace" : "grep"), extra, extra_lines,
+          "additional lines");
+}
+
+}  // namespace
+
+int main() {
+    const std::vector<LineCase> cases = {
+        {"grep", false, false, false, false},
+        {"grep_ignore_case", false, true, false, false},
+        {"grep_whole_word", false, false, true, false},
+        {"grep_ignore_case_whole_word", false, true, true, false},
+        {"replace", true, false, false, false},
+        {"replace_ignore_case", true, true, false, false},
+        {"replace_whole_word", true, false, true, false},
+        {"replace_adapt", true, true, false, true},
+    };
+
+    for (const auto& test : cases) {
+        testSteadyStateLines(test);
+    }
+
+    auto dir = std::filesystem::temp_directory_path() / ("fart_alloc_test_" + std::to_string(getpid()));
+    std::filesystem::create_directories(dir);
+    testPerFileCost(dir, false);
+    testPerFileCost(dir, true);
+    std::filesystem::remove_all(dir);
+
+    return failures;
+}
@@ -0,0 +1,341 @@
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "fart_config.hpp"
+#include "text_processor.hpp"
+#include "file_processor.hpp"
+#include "bench_corpus.hpp"
+#include "alloc_counter.hpp"
+
+namespace {
+
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+struct BenchOptions {
+    bool quick = false;
+    std::string filter;
+    std::filesystem::path dir;
+    bool keep = false;
+};
+
+struct MicroCase {
+    std::string name;
+    size_t needle_length = 6;
+    double density = 0.01;
+    bool ignore_case = false;
+    bool whole_word = false;
+    bool adapt_case = false;
+    bool replace = false;
+};
+
+struct MacroCase {
+    std::string name;
+    CorpusGenerator::TreeOptions tree;
+    bool replace = false;
+};
+
+long peakRssKb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+double megabytesPerSecond(uint64_t bytes, double seconds) {
+    return seconds > 0 ? static_cast<double>(bytes) / (1024.0 * 1024.0) / seconds : 0.0;
+}
+
+// The runs below return their JSON and count a case whose match count is not
+// the number of needles the corpus generator inserted as a mismatch.
+void checkMatches(const std::string& name, uint64_t expected, uint64_t matches, int& mismatches) {
+    if (matches != expected) {
+        std::cerr << "Mismatch in " << name << ": expected " << expected << " matches, got " << matches << std::endl;
+        mismatches++;
+    }
+}
+
+std::string runMicro(const MicroCase& bench, const BenchOptions& options, int& mismatches) {
+    CorpusGenerator generator;
+    CorpusGenerator::TextOptions text;
+    text.bytes = options.quick ? (256 << 10) : (32 << 20);
+    text.match_density = bench.density;
+    text.needle = CorpusGenerator::makeNeedle(bench.needle_length);
+    text.mixed_case = bench.ignore_case || bench.adapt_case;
+    int expected_matches = 0;
+    const std::string corpus = generator.generateText(text, expected_matches);
+
+    FartConfig config;
+    config.setFindString(text.needle);
+    if (bench.replace) {
+        config.setReplaceString("Replacement");
+    }
+    config.getOptions().ignore_case = bench.ignore_case;
+    config.getOptions().whole_word = bench.whole_word;
+    config.getOptions().adapt_case = bench.adapt_case;
+
+    TextProcessor processor(config);
+    std::string line;
+    std::string output;
+    uint64_t lines = 0;
+    uint64_t matches = 0;
+    uint64_t output_bytes = 0;
+    uint64_t iterations = 0;
+    const double min_seconds = options.quick ? 0.0 : 0.5;
+
+    AllocationScope allocations;
+    auto start = std::chrono::steady_clock::now();
+    double seconds = 0;
+
+    do {
+        std::string_view rest(corpus);
+        while (!rest.empty()) {
+            size_t eol = rest.find('\n');
+            if (eol == std::string_view::npos) {
+                eol = rest.size();
+            }
+            line.assign(rest.data(), eol);
+            rest.remove_prefix(eol < rest.size() ? eol + 1 : eol);
+
+            int match_count = 0;
+            if (bench.replace) {
+                output.clear();
+                match_count = processor.replaceLine(line, output);
+                output_bytes += output.size();
+            } else {
+                match_count = processor.countMatches(line);
+            }
+            matches += static_cast<uint64_t>(match_count);
+            lines++;
+        }
+        iterations++;
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (seconds < min_seconds);
+
+    uint64_t allocation_count = allocations.count();
+    uint64_t input_bytes = corpus.size() * iterations;
+    checkMatches(bench.name, static_cast<uint64_t>(expected_matches) * iterations, matches, mismatches);
+
+    std::ostringstream json;
+    json << "{\"name\": \"" << bench.name << "\""
+         << ", \"needle_length\": " << bench.needle_length
+         << ", \"density\": " << bench.density
+         << ", \"ignore_case\": " << (bench.ignore_case ? "true" : "false")
+         << ", \"whole_word\": " << (bench.whole_word ? "true" : "false")
+         << ", \"adapt\": " << (bench.adapt_case ? "true" : "false")
+         << ", \"replace\": " << (bench.replace ? "true" : "false")
+         << ", \"iterations\": " << iterations
+         << ", \"bytes\": " << input_bytes
+         << ", \"lines\": " << lines
+         << ", \"expected_matches\": " << static_cast<uint64_t>(expected_matches) * iterations
+         << ", \"matches\": " << matches
+         << ", \"output_bytes\": " << output_bytes
+         << ", \"seconds\": " << seconds
+         << ", \"mb_per_s\": " << megabytesPerSecond(input_bytes, seconds)
+         << ", \"allocations\": " << allocation_count
+         << ", \"allocations_per_line\": " << (lines ? static_cast<double>(allocation_count) / lines : 0.0)
+         << ", \"peak_rss_kb\": " << peakRssKb()
+         << "}";
+    return json.str();
+}
+
+std::string runMacro(const MacroCase& bench, const BenchOptions& options, int& mismatches) {
+    auto root = options.dir / bench.name;
+    std::filesystem::remove_all(root);
+
+    CorpusGenerator generator;
+    auto info = generator.generateTree(root, bench.tree);
+
+    FartConfig config;
+    config.setWildcard(root.string());
+    config.setFindString(bench.tree.needle);
+    if (bench.replace) {
+        config.setReplaceString("Replacement");
+        config.getOptions().preview = true;
+    }
+    config.getOptions().recursive = true;
+
+    FileProcessor processor(config);
+
+    NullBuffer null_buffer;
+    auto* saved = std::cout.rdbuf(&null_buffer);
+
+    AllocationScope allocations;
+    auto start = std::chrono::steady_clock::now();
+    auto result = processor.processWildcards(config.getWildcard());
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t allocation_count = allocations.count();
+
+    std::cout.rdbuf(saved);
+    checkMatches(bench.name, static_cast<uint64_t>(info.matches), static_cast<uint64_t>(result.matches_found),
+                 mismatches);
+
+    if (!options.keep) {
+        std::filesystem::remove_all(root);
+    }
+
+    std::ostringstream json;
+    json << "{\"name\": \"" << bench.name << "\""
+         << ", \"files\": " << info.files
+         << ", \"binary_files\": " << info.binary_files
+         << ", \"directories\": " << info.directories
+         << ", \"depth\": " << bench.tree.depth
+         << ", \"min_file_size\": " << bench.tree.min_file_size
+         << ", \"max_file_size\": " << bench.tree.max_file_size
+         << ", \"replace\": " << (bench.replace ? "true" : "false")
+         << ", \"bytes\": " << info.total_bytes
+         << ", \"expected_matches\": " << info.matches
+         << ", \"matches\": " << result.matches_found
+         << ", \"success\": " << (result.success ? "true" : "false")
+         << ", \"seconds\": " << seconds
+         << ", \"mb_per_s\": " << megabytesPerSecond(info.total_bytes, seconds)
+         << ", \"files_per_s\": " << (seconds > 0 ? info.files / seconds : 0.0)
+         << ", \"allocations\": " << allocation_count
+         << ", \"peak_rss_kb\": " << peakRssKb()
+         << "}";
+    return json.str();
+}
+
+std::vector<MicroCase> microCases() {
+    std::vector<MicroCase> cases;
+
+    for (double density : {0.0, 0.01, 0.1, 1.0}) {
+        MicroCase c;
+        c.name = "grep_density_" + std::to_string(static_cast<int>(density * 100)) + "pct";
+        c.density = density;
+        cases.push_back(c);
+    }
+
+    for (size_t length : {1, 4, 16, 64}) {
+        MicroCase c;
+        c.name = "grep_needle_" + std::to_string(length);
+        c.needle_length = length;
+        cases.push_back(c);
+    }
+
+    MicroCase ignore_case{"grep_ignore_case", 6, 0.1, true, false, false, false};
+    MicroCase whole_word{"grep_whole_word", 6, 0.1, false, true, false, false};
+    MicroCase replace{"replace", 6, 0.1, false, false, false, true};
+    MicroCase replace_adapt{"replace_adapt", 6, 0.1, true, false, true, true};
+    cases.insert(cases.end(), {ignore_case, whole_word, replace, replace_adapt});
+
+    return cases;
+}
+
+std::vector<MacroCase> macroCases(bool quick) {
+    std::vector<MacroCase> cases;
+    int scale = quick ? 1 : 20;
+
+    MacroCase small;
+    small.name = "tree_many_small";
+    small.tree.files = 100 * scale;
+    small.tree.min_file_size = 1 << 10;
+    small.tree.max_file_size = 16 << 10;
+    cases.push_back(small);
+
+    MacroCase large;
+    large.name = "tree_few_large";
+    large.tree.files = quick ? 4 : 40;
+    large.tree.depth = 0;
+    large.tree.min_file_size = quick ? (64 << 10) : (1 << 20);
+    large.tree.max_file_size = quick ? (256 << 10) : (16 << 20);
+    cases.push_back(large);
+
+    MacroCase binary = small;
+    binary.name = "tree_binary_mix";
+    binary.tree.binary_fraction = 0.3;
+    cases.push_back(binary);
+
+    MacroCase deep = small;
+    deep.name = "tree_deep";
+    deep.tree.depth = 5;
+    deep.tree.dirs_per_level = 2;
+    cases.push_back(deep);
+
+    MacroCase replace = small;
+    replace.name = "tree_replace_preview";
+    replace.replace = true;
+    cases.push_back(replace);
+
+    return cases;
+}
+
+void showUsage() {
+    std::cout << "Usage: fart_bench [--quick] [--filter substring] [--dir path] [--keep]\n\n"
+              << "Runs TextProcessor micro-benchmarks and FileProcessor macro-benchmarks over\n"
+              << "generated corpora and prints the results as JSON on stdout. The exit code\n"
+              << "is the number of benchmarks whose match count is not the expected one.\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    options.dir = std::filesystem::temp_directory_path() / ("fart_bench_" + std::to_string(getpid()));
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--quick") {
+            options.quick = true;
+        } else if (arg == "--keep") {
+            options.keep = true;
+        } else if (arg == "--filter" && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (arg == "--dir" && i + 1 < argc) {
+            options.dir = argv[++i];
+        } else {
+            showUsage();
+            return arg == "--help" ? 0 : -1;
+        }
+    }
+
+    auto selected = [&](const std::string& name) {
+        return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    };
+
+    int mismatches = 0;
+    try {
+        std::filesystem::create_directories(options.dir);
+
+        std::cout << "{\n  \"version\": \"" << FartConfig::VERSION << "\""
+                  << ",\n  \"quick\": " << (options.quick ? "true" : "false")
+                  << ",\n  \"micro\": [";
+        const char* separator = "\n    ";
+        for (const auto& bench : microCases()) {
+            if (selected(bench.name)) {
+                std::cout << separator << runMicro(bench, options, mismatches) << std::flush;
+                separator = ",\n    ";
+            }
+        }
+
+        std::cout << "\n  ],\n  \"macro\": [";
+        separator = "\n    ";
+        for (const auto& bench : macroCases(options.quick)) {
+            if (selected(bench.name)) {
+                std::cout << separator << runMacro(bench, options, mismatches) << std::flush;
+                separator = ",\n    ";
+            }
+        }
+
+        std::cout << "\n  ],\n  \"peak_rss_kb\": " << peakRssKb() << "\n}" << std::endl;
+
+        if (!options.keep) {
+            std::filesystem::remove_all(options.dir);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Fatal error: " << e.what() << std::endl;
+        return -1;
+    }
+
+    return mismatches;
+}
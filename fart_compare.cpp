@@ -0,0 +1,437 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "fart_config.hpp"
+#include "bench_corpus.hpp"
+
+// Differential harness: runs fart_original and fart_refactored over identical
+// copies of the same corpora with the same arguments, then compares their
+// stdout and the resulting file trees, and records cost side by side.
+
+namespace {
+
+struct CompareOptions {
+    bool quick = false;
+    bool strict = false;
+    bool keep = false;
+    std::string original;
+    std::string refactored;
+    std::filesystem::path dir;
+    std::filesystem::path corpus;       // user-supplied tree instead of generated ones
+    std::string find_string = "uvwxyz";
+    std::string replace_string = "Replacement";
+};
+
+struct RunStats {
+    int exit_code = -1;
+    double wall_seconds = 0;
+    double user_seconds = 0;
+    double system_seconds = 0;
+    long max_rss_kb = 0;
+    uint64_t read_syscalls = 0;
+    uint64_t write_syscalls = 0;
+    uint64_t read_bytes = 0;
+    uint64_t written_bytes = 0;
+    std::string stdout_text;
+};
+
+struct Case {
+    std::string name;
+    std::vector<std::string> args;
+    bool replace = false;
+    // Why stdout and the exit code are known to differ; the trees must still match
+    std::string known_difference;
+};
+
+std::string readText(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::ostringstream oss;
+    oss << file.rdbuf();
+    return oss.str();
+}
+
+// Reads the I/O accounting of a terminated but not yet reaped child.
+void readProcIo(pid_t pid, RunStats& stats) {
+    std::ifstream io("/proc/" + std::to_string(pid) + "/io");
+    std::string key;
+    uint64_t value;
+    while (io >> key >> value) {
+        if (key == "syscr:") stats.read_syscalls = value;
+        else if (key == "syscw:") stats.write_syscalls = value;
+        else if (key == "rchar:") stats.read_bytes = value;
+        else if (key == "wchar:") stats.written_bytes = value;
+    }
+}
+
+RunStats runBinary(const std::string& binary, const std::vector<std::string>& args,
+                   const std::filesystem::path& cwd, const std::filesystem::path& output) {
+    RunStats stats;
+
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(binary.c_str()));
+    for (const auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        throw std::runtime_error("fork failed: " + std::string(strerror(errno)));
+    }
+    if (pid == 0) {
+        int out = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int null = open("/dev/null", O_WRONLY);
+        if (out < 0 || null < 0 || chdir(cwd.c_str()) != 0) {
+            _exit(127);
+        }
+        dup2(out, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execv(binary.c_str(), argv.data());
+        _exit(127);
+    }
+
+    siginfo_t info;
+    memset(&info, 0, sizeof(info));
+    waitid(P_PID, static_cast<id_t>(pid), &info, WEXITED | WNOWAIT);
+    stats.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    readProcIo(pid, stats);
+
+    int status = 0;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+
+    stats.exit_code = WIFEXITED(status) ? static_cast<signed char>(WEXITSTATUS(status)) : -1;
+    stats.user_seconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+    stats.system_seconds = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    stats.max_rss_kb = usage.ru_maxrss;
+    stats.stdout_text = readText(output);
+    return stats;
+}
+
+std::vector<std::string> splitLines(const std::string& text) {
+    std::vector<std::string> lines;
+    std::istringstream iss(text);
+    std::string line;
+    while (std::getline(iss, line)) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+// Drops what differs between the binaries on every run without meaning
+// anything: the legacy progress spinner ("|\r", "/\r", ...), its spelling of
+// "occurence(s)" in the summary, and its listing of each changed file by name
+// (lines naming a file under cwd).
+std::vector<std::string> normalizeOutput(const std::string& text, const std::filesystem::path& cwd) {
+    std::string plain;
+    plain.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (i + 1 < text.size() && text[i + 1] == '\r' && std::string_view("|/-\\").find(text[i]) != std::string_view::npos) {
+            ++i;
+            continue;
+        }
+        plain += text[i];
+    }
+
+    std::vector<std::string> lines;
+    const std::string legacy = " occurence(s) ";
+    for (auto& line : splitLines(plain)) {
+        std::error_code ec;
+        if (!line.empty() && std::filesystem::is_regular_file(cwd / line, ec)) {
+            continue;
+        }
+        for (size_t pos = 0; (pos = line.find(legacy, pos)) != std::string::npos; pos += legacy.size()) {
+            line.replace(pos, legacy.size(), " occurrence(s) ");
+        }
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+// Both binaries walk directories in a different order, so besides an exact
+// comparison the outputs are also compared, normalized, as multisets of lines.
+bool equivalentOutput(const std::string& a, const std::filesystem::path& cwd_a,
+                      const std::string& b, const std::filesystem::path& cwd_b) {
+    auto lines_a = normalizeOutput(a, cwd_a);
+    auto lines_b = normalizeOutput(b, cwd_b);
+    std::sort(lines_a.begin(), lines_a.end());
+    std::sort(lines_b.begin(), lines_b.end());
+    return lines_a == lines_b;
+}
+
+std::map<std::string, std::string> snapshotTree(const std::filesystem::path& root) {
+    std::map<std::string, std::string> tree;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(root)) {
+        if (entry.is_regular_file()) {
+            tree[std::filesystem::relative(entry.path(), root).string()] = readText(entry.path());
+        }
+    }
+    return tree;
+}
+
+std::vector<std::string> diffTrees(const std::filesystem::path& a, const std::filesystem::path& b) {
+    auto tree_a = snapshotTree(a);
+    auto tree_b = snapshotTree(b);
+    std::vector<std::string> differences;
+
+    for (const auto& [path, content] : tree_a) {
+        auto it = tree_b.find(path);
+        if (it == tree_b.end()) {
+            differences.push_back(path + " (only original)");
+        } else if (it->second != content) {
+            differences.push_back(path + " (content)");
+        }
+    }
+    for (const auto& entry : tree_b) {
+        if (tree_a.find(entry.first) == tree_a.end()) {
+            differences.push_back(entry.first + " (only refactored)");
+        }
+    }
+    return differences;
+}
+
+std::string jsonEscape(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    out += ' ';
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out;
+}
+
+std::string statsJson(const RunStats& stats) {
+    std::ostringstream json;
+    json << "{\"exit_code\": " << stats.exit_code
+         << ", \"wall_seconds\": " << stats.wall_seconds
+         << ", \"user_seconds\": " << stats.user_seconds
+         << ", \"system_seconds\": " << stats.system_seconds
+         << ", \"max_rss_kb\": " << stats.max_rss_kb
+         << ", \"read_syscalls\": " << stats.read_syscalls
+         << ", \"write_syscalls\": " << stats.write_syscalls
+         << ", \"read_bytes\": " << stats.read_bytes
+         << ", \"written_bytes\": " << stats.written_bytes
+         << ", \"stdout_bytes\": " << stats.stdout_text.size()
+         << "}";
+    return json.str();
+}
+
+std::vector<Case> optionMatrix(const CompareOptions& options) {
+    std::vector<Case> cases;
+    const std::string wildcard = "*.txt";
+
+    cases.push_back({"find", {"-r", wildcard}, false,
+                     "legacy lists the files found, refactored does not find any"});
+
+    const std::vector<std::pair<std::string, std::vector<std::string>>> grep_options = {
+        {"grep", {}},
+        {"grep_ignore_case", {"-i"}},
+        {"grep_word", {"-w"}},
+        {"grep_count", {"-c"}},
+        {"grep_line_numbers", {"-n"}},
+        {"grep_invert_count", {"-v", "-c"}},
+    };
+    for (const auto& [name, flags] : grep_options) {
+        Case c{name, {"-r"}, false, ""};
+        c.args.insert(c.args.end(), flags.begin(), flags.end());
+        c.args.insert(c.args.end(), {"--", wildcard, options.find_string});
+        cases.push_back(c);
+    }
+
+    const std::vector<std::pair<std::string, std::vector<std::string>>> replace_options = {
+        {"replace", {}},
+        {"replace_ignore_case", {"-i"}},
+        {"replace_adapt", {"-i", "-a"}},
+        {"replace_word", {"-w"}},
+        {"replace_count", {"-c"}},
+        {"replace_preview", {"-p"}},
+        {"replace_backup", {"-b"}},
+    };
+    for (const auto& [name, flags] : replace_options) {
+        Case c{name, {"-r"}, true, name == "replace_preview" ? "legacy previews count no occurrences" : ""};
+        c.args.insert(c.args.end(), flags.begin(), flags.end());
+        c.args.insert(c.args.end(), {"--", wildcard, options.find_string, options.replace_string});
+        cases.push_back(c);
+    }
+
+    return cases;
+}
+
+std::vector<std::pair<std::string, CorpusGenerator::TreeOptions>> corpora(bool quick) {
+    std::vector<std::pair<std::string, CorpusGenerator::TreeOptions>> result;
+    int scale = quick ? 1 : 20;
+
+    CorpusGenerator::TreeOptions small;
+    small.files = 50 * scale;
+    small.max_file_size = 16 << 10;
+    small.match_density = 0.05;
+    result.push_back({"small_files", small});
+
+    CorpusGenerator::TreeOptions binary = small;
+    binary.binary_fraction = 0.3;
+    result.push_back({"binary_mix", binary});
+
+    CorpusGenerator::TreeOptions long_lines = small;
+    long_lines.files = 5 * scale;
+    long_lines.depth = 0;
+    long_lines.min_file_size = 64 << 10;
+    long_lines.max_file_size = 256 << 10;
+    long_lines.line_length = 20000;
+    long_lines.match_density = 0.5;
+    result.push_back({"long_lines", long_lines});
+
+    return result;
+}
+
+void showUsage() {
+    std::cout << "Usage: fart_compare [--quick] [--strict] [--keep] [--dir path]\n"
+              << "                    [--original path] [--refactored path]\n"
+              << "                    [--corpus path [--find string] [--replace string]]\n\n"
+              << "Runs fart_original and fart_refactored with the same arguments over identical\n"
+              << "copies of generated corpora (or of --corpus), compares stdout and the resulting\n"
+              << "trees and prints a JSON report. With --strict the exit code is the number of\n"
+              << "cases that differ, known differences aside.\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    CompareOptions options;
+    auto self_dir = std::filesystem::absolute(argv[0]).parent_path();
+    options.original = (self_dir / "fart_original").string();
+    options.refactored = (self_dir / "fart_refactored").string();
+    options.dir = std::filesystem::temp_directory_path() / ("fart_compare_" + std::to_string(getpid()));
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--quick") options.quick = true;
+        else if (arg == "--strict") options.strict = true;
+        else if (arg == "--keep") options.keep = true;
+        else if (arg == "--dir" && has_value) options.dir = argv[++i];
+        else if (arg == "--original" && has_value) options.original = argv[++i];
+        else if (arg == "--refactored" && has_value) options.refactored = argv[++i];
+        else if (arg == "--corpus" && has_value) options.corpus = argv[++i];
+        else if (arg == "--find" && has_value) options.find_string = argv[++i];
+        else if (arg == "--replace" && has_value) options.replace_string = argv[++i];
+        else {
+            showUsage();
+            return arg == "--help" ? 0 : -1;
+        }
+    }
+
+    int differing = 0;
+
+    try {
+        options.dir = std::filesystem::absolute(options.dir);
+        std::filesystem::remove_all(options.dir);
+        std::filesystem::create_directories(options.dir);
+
+        std::vector<std::pair<std::string, std::filesystem::path>> sources;
+        if (!options.corpus.empty()) {
+            sources.push_back({options.corpus.filename().string(), std::filesystem::absolute(options.corpus)});
+        } else {
+            CorpusGenerator generator;
+            for (const auto& [name, tree] : corpora(options.quick)) {
+                auto path = options.dir / "corpus" / name;
+                generator.generateTree(path, tree);
+                sources.push_back({name, path});
+            }
+        }
+
+        double total_original = 0;
+        double total_refactored = 0;
+        int total_cases = 0;
+
+        std::cout << "{\n  \"version\": \"" << FartConfig::VERSION << "\""
+                  << ",\n  \"cases\": [";
+        const char* separator = "\n    ";
+
+        for (const auto& [corpus_name, source] : sources) {
+            for (const auto& test : optionMatrix(options)) {
+                auto work = options.dir / "run";
+                auto tree_original = work / "original";
+                auto tree_refactored = work / "refactored";
+                std::filesystem::remove_all(work);
+                std::filesystem::create_directories(work);
+                std::filesystem::copy(source, tree_original, std::filesystem::copy_options::recursive);
+                std::filesystem::copy(source, tree_refactored, std::filesystem::copy_options::recursive);
+
+                auto original = runBinary(options.original, test.args, tree_original, work / "original.out");
+                auto refactored = runBinary(options.refactored, test.args, tree_refactored, work / "refactored.out");
+
+                bool identical = original.stdout_text == refactored.stdout_text;
+                bool equivalent = identical || equivalentOutput(original.stdout_text, tree_original,
+                                                                refactored.stdout_text, tree_refactored);
+                auto differences = diffTrees(tree_original, tree_refactored);
+                bool same = differences.empty() && (!test.known_difference.empty() ||
+                                                    (equivalent && original.exit_code == refactored.exit_code));
+
+                total_original += original.wall_seconds;
+                total_refactored += refactored.wall_seconds;
+                total_cases++;
+                if (!same) {
+                    differing++;
+                }
+
+                std::cout << separator << "{\"corpus\": \"" << jsonEscape(corpus_name) << "\""
+                          << ", \"case\": \"" << test.name << "\", \"args\": [";
+                for (size_t a = 0; a < test.args.size(); ++a) {
+                    std::cout << (a ? ", " : "") << "\"" << jsonEscape(test.args[a]) << "\"";
+                }
+                std::cout << "], \"stdout_identical\": " << (identical ? "true" : "false")
+                          << ", \"stdout_equivalent\": " << (equivalent ? "true" : "false")
+                          << ", \"exit_code_equal\": " << (original.exit_code == refactored.exit_code ? "true" : "false")
+                          << ", \"tree_differences\": " << differences.size();
+                if (!test.known_difference.empty()) {
+                    std::cout << ", \"known_difference\": \"" << jsonEscape(test.known_difference) << "\"";
+                }
+                if (!differences.empty()) {
+                    std::cout << ", \"first_tree_difference\": \"" << jsonEscape(differences.front()) << "\"";
+                }
+                std::cout << ",\n      \"original\": " << statsJson(original)
+                          << ",\n      \"refactored\": " << statsJson(refactored) << "}" << std::flush;
+                separator = ",\n    ";
+            }
+        }
+
+        std::cout << "\n  ],\n  \"summary\": {\"cases\": " << total_cases
+                  << ", \"differing\": " << differing
+                  << ", \"original_wall_seconds\": " << total_original
+                  << ", \"refactored_wall_seconds\": " << total_refactored
+                  << ", \"wall_ratio\": " << (total_original > 0 ? total_refactored / total_original : 0.0)
+                  << "}\n}" << std::endl;
+
+        if (!options.keep) {
+            std::filesystem::remove_all(options.dir);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Fatal error: " << e.what() << std::endl;
+        return -1;
+    }
+
+    return options.strict ? differing : 0;
+}
@@ -0,0 +1,141 @@
+#include "fart_config.hpp"
+#include <algorithm>
+#include <iomanip>
+
+namespace {
+
+double toSeconds(std::chrono::nanoseconds elapsed) {
+    return std::chrono::duration<double>(elapsed).count();
+}
+
+std::string jsonEscape(const std::string& text) {
+    std::string out;
+    out.reserve(text.size());
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out += ' ';
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+}  // namespace
+
+void FartConfig::Statistics::recordFileLatency(const std::string& path, std::chrono::nanoseconds elapsed) {
+    auto micros = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+    size_t bucket = 0;
+    while (micros > 1 && bucket + 1 < LATENCY_BUCKETS) {
+        micros >>= 1;
+        bucket++;
+    }
+    latency_histogram[bucket]++;
+
+    // Keep the slowest files sorted, slowest first
+    if (slowest_files.size() < SLOWEST_FILES || elapsed > slowest_files.back().first) {
+        auto pos = std::upper_bound(slowest_files.begin(), slowest_files.end(), elapsed,
+            [](std::chrono::nanoseconds value, const auto& entry) { return value > entry.first; });
+        slowest_files.insert(pos, {elapsed, path});
+        if (slowest_files.size() > SLOWEST_FILES) {
+            slowest_files.pop_back();
+        }
+    }
+}
+
+const char* FartConfig::Statistics::phaseName(Phase phase) {
+    switch (phase) {
+        case Phase::WALK: return "walk";
+        case Phase::READ: return "read";
+        case Phase::MATCH: return "match";
+        case Phase::WRITE: return "write";
+        case Phase::RENAME: return "rename";
+        default: return "other";
+    }
+}
+
+void FartConfig::Statistics::report(std::ostream& out, bool json) const {
+    const std::pair<const char*, uint64_t> counters[] = {
+        {"files_matched", static_cast<uint64_t>(total_files)},
+        {"matches", static_cast<uint64_t>(total_matches)},
+        {"bytes_read", bytes_read},
+        {"bytes_written", bytes_written},
+        {"files_opened", static_cast<uint64_t>(files_opened)},
+        {"files_skipped_binary", static_cast<uint64_t>(files_skipped_binary)},
+        {"files_skipped_pattern", static_cast<uint64_t>(files_skipped_pattern)},
+        {"files_skipped_shard", static_cast<uint64_t>(files_skipped_shard)},
+        {"dirs_skipped_vcs", static_cast<uint64_t>(dirs_skipped_vcs)},
+        {"files_skipped_ignore", static_cast<uint64_t>(files_skipped_ignore)},
+        {"dirs_skipped_ignore", static_cast<uint64_t>(dirs_skipped_ignore)},
+        {"files_skipped_filter", static_cast<uint64_t>(files_skipped_filter)},
+        {"files_skipped_link", static_cast<uint64_t>(files_skipped_link)},
+        {"dirs_skipped_link", static_cast<uint64_t>(dirs_skipped_link)},
+        {"directories_walked", static_cast<uint64_t>(directories_walked)},
+    };
+
+    size_t first_bucket = LATENCY_BUCKETS;
+    size_t last_bucket = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS; ++i) {
+        if (latency_histogram[i]) {
+            first_bucket = std::min(first_bucket, i);
+            last_bucket = i + 1;
+        }
+    }
+
+    if (json) {
+        out << "{";
+        for (const auto& [name, value] : counters) {
+            out << "\"" << name << "\": " << value << ", ";
+        }
+        out << "\"phase_seconds\": {";
+        for (size_t p = 1; p < phase_time.size(); ++p) {
+            out << (p > 1 ? ", " : "") << "\"" << phaseName(static_cast<Phase>(p)) << "\": "
+                << toSeconds(phase_time[p]);
+        }
+        out << "}, \"latency_histogram\": [";
+        for (size_t i = first_bucket; i < last_bucket; ++i) {
+            out << (i > first_bucket ? ", " : "") << "{\"max_us\": " << (uint64_t{2} << i)
+                << ", \"files\": " << latency_histogram[i] << "}";
+        }
+        out << "], \"slowest_files\": [";
+        for (size_t i = 0; i < slowest_files.size(); ++i) {
+            out << (i ? ", " : "") << "{\"path\": \"" << jsonEscape(slowest_files[i].second)
+                << "\", \"seconds\": " << toSeconds(slowest_files[i].first) << "}";
+        }
+        out << "]}" << std::endl;
+        return;
+    }
+
+    auto flags = out.flags();
+    auto precision = out.precision();
+
+    out << "Statistics:\n";
+    for (const auto& [name, value] : counters) {
+        out << "  " << std::left << std::setw(24) << name << value << "\n";
+    }
+
+    out << "Phase times:\n";
+    for (size_t p = 1; p < phase_time.size(); ++p) {
+        out << "  " << std::left << std::setw(24) << phaseName(static_cast<Phase>(p))
+            << std::fixed << std::setprecision(6) << toSeconds(phase_time[p]) << " s\n";
+    }
+
+    out << "File latency:\n";
+    for (size_t i = first_bucket; i < last_bucket; ++i) {
+        out << "  < " << std::right << std::setw(10) << (uint64_t{2} << i) << " us  "
+            << std::setw(8) << latency_histogram[i] << "\n";
+    }
+
+    if (!slowest_files.empty()) {
+        out << "Slowest files:\n";
+        for (const auto& [elapsed, path] : slowest_files) {
+            out << "  " << std::fixed << std::setprecision(6) << toSeconds(elapsed) << " s  " << path << "\n";
+        }
+    }
+    out.flags(flags);
+    out.precision(precision);
+    out << std::flush;
+}
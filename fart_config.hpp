@@ -1,12 +1,18 @@
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
 #include <string>
+#include <utility>
 #include <vector>
 
 class FartConfig {
 public:
     struct Options {
         bool help = false;
+        bool version = false;
         bool quiet = false;
         bool verbose = false;
         bool recursive = false;
@@ -18,6 +24,7 @@ public:
         bool filename_mode = false;
         bool binary = false;
         bool c_style = false;
+        bool regex = false;
         bool cvs = false;
         bool svn = false;
         bool git = true;
@@ -25,16 +32,65 @@ public:
         bool adapt_case = false;
         bool backup = false;
         bool preview = false;
+        bool stats = false;
+        bool stats_json = false;
+        std::string vcs_edit;  // command run on changed files before they change
+        unsigned shard_index = 0;  // --shard K/N: only files hashing to shard K-1 of N
+        unsigned shard_count = 0;
+        std::string emit_results;  // per-file results for --merge
+        bool merge = false;
+        std::string serve_work;  // address to hand out work on
+        std::string worker;      // address of the coordinator to work for
+        bool watch = false;
+        std::string files_from;  // file listing the files to process instead of a wildcard; "-" is stdin
+        bool null_data = false;  // the list is NUL-separated
+        bool gitignore = false;
+        bool follow = false;
+        bool io_uring = false;
+        bool no_cache_pollution = false;  // drop files from the page cache once read
+        bool search_archives = false;     // grep the members of tar files
+        uint64_t min_filesize = 0;
+        uint64_t max_filesize = 0;  // 0 for no limit
+        std::string newer_than;     // an age ("2d") or a file
+        std::vector<std::string> types;
     };
 
     struct Statistics {
+        enum class Phase { NONE, WALK, READ, MATCH, WRITE, RENAME, COUNT };
+        
+        static constexpr size_t LATENCY_BUCKETS = 32;
+        static constexpr size_t SLOWEST_FILES = 10;
+        
         int total_files = 0;
         int total_matches = 0;
         
+        // Only collected with --stats
+        uint64_t bytes_read = 0;
+        uint64_t bytes_written = 0;
+        int files_opened = 0;
+        int files_skipped_binary = 0;
+        int files_skipped_pattern = 0;
+        int files_skipped_shard = 0;
+        int dirs_skipped_vcs = 0;
+        int files_skipped_ignore = 0;
+        int dirs_skipped_ignore = 0;
+        int files_skipped_filter = 0;
+        int files_skipped_link = 0;
+        int dirs_skipped_link = 0;
+        int directories_walked = 0;
+        std::array<std::chrono::nanoseconds, static_cast<size_t>(Phase::COUNT)> phase_time{};
+        std::array<uint64_t, LATENCY_BUCKETS> latency_histogram{};  // log2 of microseconds
+        std::vector<std::pair<std::chrono::nanoseconds, std::string>> slowest_files;
+        
         void reset() {
-            total_files = 0;
-            total_matches = 0;
+            *this = Statistics();
         }
+        
+        void recordFileLatency(const std::string& path, std::chrono::nanoseconds elapsed);
+        
+        void report(std::ostream& out, bool json) const;
+        
+        static const char* phaseName(Phase phase);
     };
 
     static constexpr const char* VERSION = "v1.99d";
@@ -43,6 +99,8 @@ public:
     static constexpr const char* WILDCARD_ALL = "*";
     static constexpr const char* TEMP_FILE = "_fart.~";
     static constexpr const char* BACKUP_SUFFIX = ".bak";
+    static constexpr const char* STAGED_SUFFIX = ".fart~";
+    static constexpr const char* CVS_EDIT = "cvs edit";
 
     FartConfig() = default;
     
@@ -61,6 +119,10 @@ public:
     const std::string& getReplaceString() const { return replace_string_; }
     void setReplaceString(const std::string& replace_string) { replace_string_ = replace_string; }
     
+    // With --merge every argument names a result log
+    const std::vector<std::string>& getMergeFiles() const { return merge_files_; }
+    void setMergeFiles(const std::vector<std::string>& merge_files) { merge_files_ = merge_files; }
+    
     bool hasWildcard() const { return !wildcard_.empty(); }
     bool hasFindString() const { return !find_string_.empty(); }
     bool hasReplaceString() const { return !replace_string_.empty(); }
@@ -75,4 +137,5 @@ private:
     std::string wildcard_;
     std::string find_string_;
     std::string replace_string_;
+    std::vector<std::string> merge_files_;
 };
\ No newline at end of file
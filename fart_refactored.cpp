@@ -1,10 +1,16 @@
+#include <algorithm>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "fart_config.hpp"
 #include "argument_parser.hpp"
 #include "file_processor.hpp"
+#include "file_watcher.hpp"
+#include "result_log.hpp"
+#include "work_server.hpp"
 
 class FartApplication {
 public:
@@ -12,6 +18,11 @@ public:
         ArgumentParser parser;
         auto parse_result = parser.parse(argc, argv, config_);
         
+        if (parse_result.success && config_.getOptions().version && !config_.getOptions().help) {
+            parser.showVersion();
+            return 0;
+        }
+        
         if (parse_result.show_help) {
             parser.showUsage();
             return parse_result.success ? 0 : -1;
@@ -22,25 +33,178 @@ public:
             return -1;
         }
         
-        if (config_.isFindMode()) {
-            return handleFindMode();
-        }
+        int status;
         
-        if (config_.isGrepMode()) {
-            return handleGrepMode();
+        if (!config_.getOptions().worker.empty()) {
+            status = handleWorkerMode();
+        } else if (!config_.getOptions().serve_work.empty()) {
+            status = handleServeMode(argc, argv);
+        } else if (config_.getOptions().watch) {
+            status = handleWatchMode();
+        } else if (config_.getOptions().merge) {
+            status = handleMergeMode();
+        } else if (config_.isFindMode()) {
+            status = handleFindMode();
+        } else if (config_.isGrepMode()) {
+            status = handleGrepMode();
+        } else if (config_.isFartMode()) {
+            status = handleFartMode();
+        } else {
+            std::cerr << "Error: Invalid mode" << std::endl;
+            return -1;
         }
         
-        if (config_.isFartMode()) {
-            return handleFartMode();
+        if (config_.getOptions().stats) {
+            std::cout.flush();
+            config_.getStats().report(std::cerr, config_.getOptions().stats_json);
         }
         
-        std::cerr << "Error: Invalid mode" << std::endl;
-        return -1;
+        return status;
     }
 
 private:
     FartConfig config_;
     
+    int handleWorkerMode() {
+        std::string error;
+        if (!WorkClient::run(config_.getOptions().worker, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    
+    // Walks on one thread while handing the files out on this one
+    int handleServeMode(int argc, char* argv[]) {
+        const auto& options = config_.getOptions();
+        
+        // Workers run the same command line, minus --serve-work
+        std::vector<std::string> args;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--serve-work") {
+                ++i;
+            } else if (arg.compare(0, 13, "--serve-work=") != 0) {
+                args.push_back(arg);
+            }
+        }
+        
+        WorkServer server(args);
+        std::string error;
+        if (!server.listen(options.serve_work, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return -1;
+        }
+        if (options.verbose) {
+            std::cerr << "Serving work on " << options.serve_work << std::endl;
+        }
+        
+        FileProcessor processor(config_);
+        processor.setFileSink([&](const std::filesystem::path& file) { server.add(file); });
+        FileProcessor::ProcessResult result;
+        std::thread walk([&]() {
+            result = processor.processWildcards(config_.getWildcard());
+            server.finish();
+        });
+        server.run(std::cout);
+        walk.join();
+        
+        auto& stats = config_.getStats();
+        stats.total_files += server.files();
+        stats.total_matches += server.matches();
+        if (!result.success || !server.errorMessage().empty()) {
+            std::cerr << "Error: " << result.error_message << server.errorMessage() << std::endl;
+            return -1;
+        }
+        
+        if (!options.quiet) {
+            if (config_.isFindMode()) {
+                std::cout << "Found " << stats.total_files << " file(s)." << std::endl;
+            } else {
+                std::cout << (config_.isGrepMode() ? "Found " : "Replaced ") << stats.total_matches
+                          << " occurrence(s) in " << stats.total_files << " file(s)." << std::endl;
+            }
+        }
+        return config_.isFindMode() ? stats.total_files : stats.total_matches;
+    }
+    
+    // A normal run, then one over the changed files whenever files change
+    int handleWatchMode() {
+        const auto& options = config_.getOptions();
+        FileProcessor processor(config_);
+        if (options.verbose) {
+            processor.setProgressCallback([](const std::string& file) {
+                std::cerr << "Processing: " << file << std::endl;
+            });
+        }
+        
+        FileWatcher watcher(config_, processor);
+        std::string error;
+        if (!watcher.open(error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return -1;
+        }
+        
+        auto report = [&](int files, int matches) {
+            if (!options.quiet) {
+                std::cout << (config_.isGrepMode() ? "Found " : "Replaced ") << matches
+                          << " occurrence(s) in " << files << " file(s)." << std::endl;
+            }
+        };
+        
+        auto result = processor.processWildcards(config_.getWildcard());
+        if (!result.success) {
+            std::cerr << "Error: " << result.error_message << std::endl;
+        }
+        report(watcher.files(), watcher.matches());
+        
+        if (!watcher.run(report, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    
+    // Prints what one run over all shards would have: the -c lines and the totals
+    int handleMergeMode() {
+        const auto& options = config_.getOptions();
+        ResultLog::Summary summary;
+        std::string error;
+        for (const auto& file : config_.getMergeFiles()) {
+            if (!ResultLog::merge(file, summary, error)) {
+                std::cerr << "Error: " << error << std::endl;
+                return -1;
+            }
+        }
+        if (!ResultLog::complete(summary, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return -1;
+        }
+        
+        if (options.count) {
+            std::sort(summary.file_matches.begin(), summary.file_matches.end());
+            for (const auto& [file, matches] : summary.file_matches) {
+                if (options.quiet) {
+                    std::cout << file << "\n";
+                } else {
+                    std::cout << file << " [" << matches << "]\n";
+                }
+            }
+        }
+        
+        if (summary.mode == "find") {
+            if (!options.quiet) {
+                std::cout << "Found " << summary.files << " file(s)." << std::endl;
+            }
+            return summary.files;
+        }
+        if (!options.quiet) {
+            std::cout << (summary.mode == "grep" ? "Found " : "Replaced ") << summary.matches
+                      << " occurrence(s) in " << summary.files << " file(s)." << std::endl;
+        }
+        return summary.matches;
+    }
+    
     int handleFindMode() {
         FileProcessor processor(config_);
         
@@ -75,7 +239,9 @@ private:
         
         FileProcessor::ProcessResult result;
         
-        if (config_.getWildcard() == "-") {
+        if (!config_.getOptions().files_from.empty()) {
+            result = processor.processListedFiles(config_.getOptions().files_from);
+        } else if (config_.getWildcard() == "-") {
             result = processor.processStdin();
         } else {
             result = processor.processWildcards(config_.getWildcard());
@@ -122,7 +288,9 @@ private:
         
         FileProcessor::ProcessResult result;
         
-        if (config_.getWildcard() == "-") {
+        if (!options.files_from.empty()) {
+            result = processor.processListedFiles(options.files_from);
+        } else if (config_.getWildcard() == "-") {
             result = processor.processStdin();
         } else {
             result = processor.processWildcards(config_.getWildcard());
@@ -144,6 +312,9 @@ private:
 };
 
 int main(int argc, char* argv[]) {
+    // All output goes through iostreams; unsynced they buffer instead of writing per call
+    std::ios::sync_with_stdio(false);
+    
     try {
         FartApplication app;
         return app.run(argc, argv);
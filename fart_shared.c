@@ -4,12 +4,10 @@
 
 #include <io.h>
 #include <direct.h>
-#define USE_WILDMAT
 
 #else /* _WIN32 */
 
 #include <dirent.h>
-#define USE_WILDMAT
 
 #ifndef DT_DIR
 #include <sys/stat.h>
@@ -17,17 +15,11 @@
 
 #endif /* !_WIN32 */
 
-
-#ifdef USE_WILDMAT
-/*extern "C"*/
-int wildmat (const char *text, const char *p);
-#endif
-
 /*****************************************************************************/
 
 int analyze_case( const char* in, int inl )
 {
-	int t, UC=0, LC=0;
+	int t, UC=0, LC=0, first_UC=0;
 
 	for (t=0;t<inl;t++)
 	{
@@ -38,7 +30,11 @@ int analyze_case( const char* in, int inl )
 			continue;
 
 		if (uc==in[t])					/* char is uppercase	*/
+		{
+			if (UC+LC==0)
+				first_UC = 1;
 			UC++;
+		}
 		else							/* char is lowercase	*/
 			LC++;
 	}
@@ -55,6 +51,9 @@ int analyze_case( const char* in, int inl )
 	if (LC==0)
 		return ANALYZECASE_UPPER;		/* all uppercase		*/
 
+	if (UC==1 && first_UC)
+		return ANALYZECASE_TITLE;		/* only the first uppercase	*/
+
 	return ANALYZECASE_MIXED;
 }
 
@@ -76,24 +75,38 @@ char* memupr( char *ptr, size_t size )
 	return ptr;
 }
 
+char* memttl( char *ptr, size_t size )
+{
+	char *p = ptr;
+	for (;size--;p++)
+		if (isalpha((unsigned char)*p))
+		{
+			*p = toupper(*p);
+			break;
+		}
+	return ptr;
+}
+
 /*****************************************************************************/
 
 char* _memmem( const char* m1, size_t len1, const char *m2, size_t len2 )
 {
-	size_t c,t;
+	const char *cur, *last;
 	if (len1<len2)
 		return NULL;
 	/* Check for valid arguments (same behaviour as strstr) */
 	if (!m2 || !len2)
 		return (char*)m1;
 
-	for (t=0;t<=len1-len2;t++)
+	/* Let memchr skip to candidates for the first byte, then compare the rest */
+	last = m1 + (len1-len2);
+	for (cur=m1;cur<=last;cur++)
 	{
-		for (c=0;c<len2;c++)
-			if (m1[c+t]!=m2[c])
-				break;
-		if (c==len2)
-			return (char*)&m1[t];
+		cur = (const char*)memchr( cur, m2[0], (size_t)(last-cur)+1 );
+		if (!cur)
+			break;
+		if (memcmp( cur+1, m2+1, len2-1 )==0)
+			return (char*)cur;
 	}
 	return NULL;
 }
@@ -124,80 +137,183 @@ char* strdup3( const char* s1, const char* s2, const char* s3 )
 
 /*****************************************************************************/
 
+#define ARENA_CHUNK		65536
+#define ARENA_ALIGN		sizeof(void*)
+
+struct arena_chunk_s
+{
+	arena_chunk_t	*next;
+	size_t			size, used;
+	/* followed by 'size' bytes of data */
+};
+
+void arena_init( arena_t *arena )
+{
+	arena->first = arena->current = NULL;
+}
+
+void arena_free( arena_t *arena )
+{
+	arena_chunk_t *chunk, *next;
+	for (chunk=arena->first;chunk;chunk=next)
+	{
+		next = chunk->next;
+		free(chunk);
+	}
+	arena_init(arena);
+}
+
+void* arena_alloc( arena_t *arena, size_t size )
+{
+	arena_chunk_t *chunk = arena->current, *next;
+	char *ptr;
+
+	size = (size+ARENA_ALIGN-1) & ~(ARENA_ALIGN-1);
+	if (!chunk || chunk->size-chunk->used<size)
+	{
+		/* Move on to the next chunk, reusing a released one if it is big enough */
+		next = chunk?chunk->next:arena->first;
+		if (!next || next->size<size)
+		{
+			size_t chunk_size = size>ARENA_CHUNK?size:ARENA_CHUNK;
+			arena_chunk_t *fresh = (arena_chunk_t*)malloc(sizeof(arena_chunk_t)+chunk_size);
+			if (!fresh)
+				return NULL;
+			fresh->size = chunk_size;
+			fresh->next = next;
+			if (chunk)
+				chunk->next = fresh;
+			else
+				arena->first = fresh;
+			next = fresh;
+		}
+		next->used = 0;
+		arena->current = chunk = next;
+	}
+	ptr = (char*)(chunk+1) + chunk->used;
+	chunk->used += size;
+	return ptr;
+}
+
+arena_mark_t arena_mark( arena_t *arena )
+{
+	arena_mark_t mark;
+	mark.chunk = arena->current;
+	mark.used = arena->current?arena->current->used:0;
+	return mark;
+}
+
+void arena_release( arena_t *arena, arena_mark_t mark )
+{
+	arena->current = mark.chunk;
+	if (mark.chunk)
+		mark.chunk->used = mark.used;
+}
+
+char* arena_strdup3( arena_t *arena, const char* s1, const char* s2, const char* s3 )
+{
+	size_t l1 = strlen(s1);
+	size_t l2 = strlen(s2);
+	size_t l3 = strlen(s3) + 1;
+	char *str = (char*)arena_alloc(arena,l1+l2+l3);
+	if (!str)
+		return NULL;
+	memcpy( str, s1, l1 );
+	memcpy( str+l1, s2, l2 );
+	memcpy( str+l1+l2, s3, l3 );
+	return str;
+}
+
+#define FINDFILES_TABLE	64
+
+/* Starts an empty NULL delimited table in the arena */
+static char** new_names( arena_t *arena, int *numitems, int *capacity )
+{
+	char **spul = (char**)arena_alloc(arena, FINDFILES_TABLE*sizeof(char*));
+	if (spul)
+		spul[0] = NULL;
+	*numitems = 0;
+	*capacity = FINDFILES_TABLE;
+	return spul;
+}
+
+/* Appends a name to a NULL delimited table in the arena, doubling its capacity when full */
+static char** append_name( arena_t *arena, char **spul, int *numitems, int *capacity, const char* name )
+{
+	if (*numitems+1>=*capacity)
+	{
+		int grown = *capacity*2;
+		char **table = (char**)arena_alloc(arena, grown*sizeof(char*));
+		if (!table)
+			return NULL;
+		memcpy( table, spul, *numitems*sizeof(char*) );
+		*capacity = grown;
+		spul = table;
+	}
+	spul[*numitems] = arena_strdup3(arena,name,"","");
+	if (!spul[*numitems])
+		return NULL;
+	spul[++*numitems] = NULL;
+	return spul;
+}
+
+/*****************************************************************************/
+
 #ifdef _WIN32
 
-char** find_files( const char* dir, const char *wc, int dirs_or_files )
+char** find_files( arena_t *arena, const char* dir, const globset_t *wc, int dirs_or_files )
 {
 	char *_path;
 	intptr_t fh;
 	struct _finddata_t fd;
 	char **spul;
-	int numitems;
-#ifdef USE_WILDMAT
-	/* When using the wildmat routine, we compare in lowercase */
-	char *wclwr, *namelwr;
-	int matched;
-#endif
+	int numitems, capacity;
 
-	/* Make full path wildcard */
-#ifdef USE_WILDMAT
+	/* List everything; the glob set does the matching (case-insensitive) */
 	_path = strdup2(dir,"*");
-#else
-	_path = strdup2(dir,wc);
-#endif
 	fh = _findfirst( _path, &fd );
 	free(_path);
 
 	if (fh==-1)
 		return NULL;
 
-#ifdef USE_WILDMAT
-	wclwr = strlwr(strdup(wc));
-#endif
+	spul = new_names(arena,&numitems,&capacity);
+	if (!spul)
+	{
+		_findclose(fh);
+		return NULL;
+	}
 
-	spul = NULL;
-	numitems = 0;
 	do
 	{
-		if (!(fd.attrib & _A_SUBDIR)==dirs_or_files)
+		if ((!(fd.attrib & _A_SUBDIR))==dirs_or_files)
 			continue;
-#ifdef USE_WILDMAT
-		namelwr = strlwr(strdup(fd.name));
-		matched = !strcmp(namelwr,wclwr) || wildmat(namelwr,wclwr);
-		free(namelwr);
-		if (!matched)
+		if (wc && !globset_match(wc,fd.name,NULL))
 			continue;
-#endif
-		spul = (char**)realloc(spul, ++numitems*sizeof(char*));
-		spul[numitems-1] = strdup(fd.name);
+		spul = append_name(arena,spul,&numitems,&capacity,fd.name);
+		if (!spul)
+			break;
 	}
 	while (_findnext(fh,&fd)==0);
 
 	_findclose(fh);
 
-	/* append NULL */
-	spul = (char**)realloc(spul, ++numitems*sizeof(char*));
-	spul[numitems-1] = NULL;
-
-#ifdef USE_WILDMAT
-	free( wclwr );
-#endif
-
 	return spul;
 }
 
 #else /* _WIN32 */
 
-char** find_files( const char* dir, const char *wc, int dirs_or_files )
+char** find_files( arena_t *arena, const char* dir, const globset_t *wc, int dirs_or_files )
 {
 	DIR *hd;
 	struct dirent* dirent;
 	char **spul;
-	int numitems;
+	int numitems, capacity;
 #ifndef DT_DIR
 	/* dirent without d_type field; we must 'stat' to get the type */
 	struct stat sbuf;
 	char *_fullpath;
+	arena_mark_t mark;
 	int i;
 #endif
 
@@ -212,42 +328,42 @@ char** find_files( const char* dir, const char *wc, int dirs_or_files )
 		closedir(hd);
 		return NULL;
 	}
-	spul = NULL;
-	numitems = 0;
+	spul = new_names(arena,&numitems,&capacity);
+	if (!spul)
+	{
+		closedir(hd);
+		return NULL;
+	}
 
 	do
 	{
 		/* Do files now; process folders later */
 #ifdef DT_DIR
-		if (!(dirent->d_type==DT_DIR)==dirs_or_files)
+		if ((!(dirent->d_type==DT_DIR))==dirs_or_files)
 			continue;
 #else
 		if (dirs_or_files!=FINDFILES_BOTH)
 		{
-			_fullpath = strdup2(dir,dirent->d_name);
-			i = stat(_fullpath, &sbuf);
-			free(_fullpath);
+			mark = arena_mark(arena);
+			_fullpath = arena_strdup3(arena,dir,dirent->d_name,"");
+			i = _fullpath?stat(_fullpath, &sbuf):-1;
+			arena_release(arena,mark);
 			/* skip entry if stat failed or if it's not what we want */
 			if (i==-1 || !S_ISDIR(sbuf.st_mode)==dirs_or_files)
 				continue;
 		}
 #endif
 
-#ifdef USE_WILDMAT
-		if (strcmp(dirent->d_name,wc) && !wildmat(dirent->d_name,wc))
+		if (wc && !globset_match(wc,dirent->d_name,NULL))
 			continue;
-#endif
-		spul = (char**)realloc(spul, ++numitems*sizeof(char*));
-		spul[numitems-1] = strdup(dirent->d_name);
+		spul = append_name(arena,spul,&numitems,&capacity,dirent->d_name);
+		if (!spul)
+			break;
 	}
 	while ((dirent = readdir(hd)));
 
 	closedir(hd);
 
-	/* append NULL */
-	spul = (char**)realloc(spul, ++numitems*sizeof(char*));
-	spul[numitems-1] = NULL;
-
 	return spul;
 }
 
@@ -14,11 +14,13 @@ extern "C" {
 
 /* WIN32 specific */
 # define strcasecmp stricmp
+# define FILENAME_FOLDCASE 1		/* file names compare case-insensitively */
 
 #else /* WIN32 */
 
 /* !WIN32 specific */
 # define stricmp strcasecmp
+# define FILENAME_FOLDCASE 0
 
 /* It seems these are only available on windows */
 char *strupr(char *s);
@@ -28,13 +30,38 @@ char *strrev(char *s);
 #endif /* !WIN32 */
 
 
-/* Find files/dirs in a dir, matching a wildcard pattern
-   Returns a NULL delimited array of strings, which must be freed
-   with free() (the array itself too) */
+/* Shell-style pattern matching for ?, \, [] and * characters */
+int wildmat( const char *text, const char *p );
+
+/* Glob set: patterns compiled once, then matched against names in one call.
+   globset_match returns the number of patterns matching 'name' and, if
+   'hits' is given (one byte per pattern), marks which; without 'hits' it
+   stops at the first match. The set keeps pointers to the patterns. */
+typedef struct globset_s globset_t;
+globset_t* globset_compile( const char* const* patterns, int count, int foldcase );
+void globset_free( globset_t *set );
+int globset_match( const globset_t *set, const char *name, unsigned char *hits );
+
+/* Bump allocator for short-lived strings. Memory is handed back in one shot
+   by releasing to an earlier mark; chunks are kept and reused until
+   arena_free. Returns NULL when out of memory. */
+typedef struct arena_chunk_s arena_chunk_t;
+typedef struct { arena_chunk_t *first, *current; } arena_t;
+typedef struct { arena_chunk_t *chunk; size_t used; } arena_mark_t;
+void arena_init( arena_t *arena );
+void arena_free( arena_t *arena );
+void* arena_alloc( arena_t *arena, size_t size );
+arena_mark_t arena_mark( arena_t *arena );
+void arena_release( arena_t *arena, arena_mark_t mark );
+char* arena_strdup3( arena_t *arena, const char* s1, const char* s2, const char* s3 );
+
+/* Find files/dirs in a dir, matching any pattern of a glob set (NULL for all)
+   Returns a NULL delimited array of strings, allocated (with the
+   strings) in the arena; release the arena to free them */
 #define FINDFILES_FILES	0
 #define FINDFILES_DIRS	1
 #define FINDFILES_BOTH	2
-char** find_files( const char* dir, const char *wc, int dirs );
+char** find_files( arena_t *arena, const char* dir, const globset_t *wc, int dirs );
 
 /* Efficient strdup that concatenates strings. */
 char* strdup2( const char* s1, const char* s2 );
@@ -47,14 +74,16 @@ char* _memmem( const char* m1, size_t len1, const char *m2, size_t len2 );
 /* Find and replace a char in a memory block */
 char* memchrset( char* m1, size_t len1, int find, int replace );
 
-/* Convert string of length 'size' to lower- or upper-case */
+/* Convert string of length 'size' to lower-, upper- or title-case */
 char* memlwr( char *ptr, size_t size );
 char* memupr( char *ptr, size_t size );
+char* memttl( char *ptr, size_t size );
 
 /* Analyze the case of the characters (0 means no alphabetic chars) */
 #define ANALYZECASE_UPPER	1
 #define ANALYZECASE_LOWER	2
 #define ANALYZECASE_MIXED	3
+#define ANALYZECASE_TITLE	4			/* "Title": first letter uppercase */
 int analyze_case( const char* in, int inl );
 
 /*****************************************************************************/
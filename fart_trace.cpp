@@ -0,0 +1,124 @@
+#include "fart_trace.hpp"
+
+#ifdef FART_TRACE
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct TraceEvent {
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+};
+
+// Single-producer ring: only the owning thread writes, the registry reads at exit.
+// When full, the oldest events are overwritten.
+class TraceRing {
+public:
+    static constexpr size_t CAPACITY = 1 << 16;
+
+    explicit TraceRing(uint32_t tid) : tid_(tid) {}
+
+    void push(const TraceEvent& event) {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        events_[head & (CAPACITY - 1)] = event;
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    template <typename Visitor>
+    void forEach(Visitor&& visit) const {
+        uint64_t head = head_.load(std::memory_order_acquire);
+        uint64_t first = head > CAPACITY ? head - CAPACITY : 0;
+        for (uint64_t i = first; i < head; ++i) {
+            visit(events_[i & (CAPACITY - 1)]);
+        }
+    }
+
+    uint32_t tid() const { return tid_; }
+
+private:
+    std::array<TraceEvent, CAPACITY> events_;
+    std::atomic<uint64_t> head_{0};
+    uint32_t tid_;
+};
+
+// Owns every thread's ring so events outlive their threads; dumps on destruction.
+class TraceRegistry {
+public:
+    TraceRegistry() : epoch_(std::chrono::steady_clock::now()) {}
+
+    ~TraceRegistry() {
+        const char* path = std::getenv("FART_TRACE_FILE");
+        dump(path && *path ? path : "fart_trace.json");
+    }
+
+    TraceRing* registerThread() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rings_.push_back(std::make_unique<TraceRing>(static_cast<uint32_t>(rings_.size() + 1)));
+        return rings_.back().get();
+    }
+
+    std::chrono::steady_clock::time_point epoch() const { return epoch_; }
+
+private:
+    std::chrono::steady_clock::time_point epoch_;
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<TraceRing>> rings_;
+
+    void dump(const char* path) {
+        FILE* out = std::fopen(path, "w");
+        if (!out) {
+            std::fprintf(stderr, "Error: unable to write trace file: %s\n", path);
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::fprintf(out, "{\"traceEvents\":[");
+        const char* separator = "\n";
+        for (const auto& ring : rings_) {
+            std::fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                         "\"args\":{\"name\":\"%s %u\"}}",
+                         separator, ring->tid(), ring->tid() == 1 ? "main" : "worker", ring->tid());
+            separator = ",\n";
+            ring->forEach([&](const TraceEvent& event) {
+                std::fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                             "\"ts\":%.3f,\"dur\":%.3f}",
+                             event.name, ring->tid(), event.start / 1000.0,
+                             (event.end - event.start) / 1000.0);
+            });
+        }
+        std::fprintf(out, "\n],\"displayTimeUnit\":\"ms\"}\n");
+        std::fclose(out);
+    }
+};
+
+TraceRegistry& registry() {
+    static TraceRegistry instance;
+    return instance;
+}
+
+TraceRing& threadRing() {
+    thread_local TraceRing* ring = registry().registerThread();
+    return *ring;
+}
+
+}  // namespace
+
+uint64_t TraceSpan::now() {
+    auto elapsed = std::chrono::steady_clock::now() - registry().epoch();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
+
+void TraceSpan::record(const char* name, uint64_t start_ns, uint64_t end_ns) {
+    threadRing().push({name, start_ns, end_ns});
+}
+
+#endif
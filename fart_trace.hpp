@@ -0,0 +1,37 @@
+#pragma once
+
+// Hot-path tracing, compiled in only when FART_TRACE is defined (cmake -DFART_TRACE=ON).
+// Spans are recorded into a per-thread ring buffer and written as Chrome trace-event
+// JSON at exit, to $FART_TRACE_FILE or "fart_trace.json". Load it in chrome://tracing
+// or Perfetto.
+
+#ifdef FART_TRACE
+
+#include <cstdint>
+
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name) : name_(name), start_(now()) {}
+    ~TraceSpan() { record(name_, start_, now()); }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    static uint64_t now();
+
+    static void record(const char* name, uint64_t start_ns, uint64_t end_ns);
+
+private:
+    const char* name_;
+    uint64_t start_;
+};
+
+#define FART_TRACE_CONCAT_(a, b) a##b
+#define FART_TRACE_CONCAT(a, b) FART_TRACE_CONCAT_(a, b)
+#define FART_TRACE_SCOPE(name) TraceSpan FART_TRACE_CONCAT(fart_trace_span_, __LINE__)(name)
+
+#else
+
+#define FART_TRACE_SCOPE(name) ((void)0)
+
+#endif
@@ -0,0 +1,191 @@
+#include "file_filter.hpp"
+#include <cctype>
+#include <chrono>
+#include <map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+const std::map<std::string, std::vector<std::string>>& fileTypes() {
+    static const std::map<std::string, std::vector<std::string>> types = {
+        {"c", {"*.c", "*.h"}},
+        {"cmake", {"CMakeLists.txt", "*.cmake"}},
+        {"cpp", {"*.cpp", "*.cc", "*.cxx", "*.c++", "*.hpp", "*.hh", "*.hxx", "*.h", "*.inl"}},
+        {"cs", {"*.cs"}},
+        {"css", {"*.css", "*.scss", "*.less"}},
+        {"go", {"*.go"}},
+        {"html", {"*.html", "*.htm"}},
+        {"java", {"*.java"}},
+        {"js", {"*.js", "*.jsx", "*.mjs", "*.cjs"}},
+        {"json", {"*.json"}},
+        {"md", {"*.md", "*.markdown"}},
+        {"py", {"*.py", "*.pyi"}},
+        {"rust", {"*.rs"}},
+        {"sh", {"*.sh", "*.bash"}},
+        {"ts", {"*.ts", "*.tsx"}},
+        {"txt", {"*.txt"}},
+        {"xml", {"*.xml"}},
+        {"yaml", {"*.yaml", "*.yml"}},
+    };
+    return types;
+}
+
+struct FileInfo {
+    uint64_t size;
+    int64_t modified;  // nanoseconds since the epoch
+};
+
+bool statFile(const std::filesystem::path& path, bool want_size, bool want_time, FileInfo& info) {
+#if defined(__linux__) && defined(STATX_SIZE)
+    struct statx st;
+    unsigned mask = (want_size ? STATX_SIZE : 0) | (want_time ? STATX_MTIME : 0);
+    if (statx(AT_FDCWD, path.c_str(), 0, mask, &st) != 0) {
+        return false;
+    }
+    info.size = st.stx_size;
+    info.modified = st.stx_mtime.tv_sec * 1000000000LL + st.stx_mtime.tv_nsec;
+    return true;
+#elif !defined(_WIN32)
+    (void)want_size;
+    (void)want_time;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    info.size = static_cast<uint64_t>(st.st_size);
+    info.modified = static_cast<int64_t>(st.st_mtime) * 1000000000LL;
+    return true;
+#else
+    std::error_code ec;
+    info.size = want_size ? std::filesystem::file_size(path, ec) : 0;
+    if (!ec && want_time) {
+        auto modified = std::chrono::clock_cast<std::chrono::system_clock>(std::filesystem::last_write_time(path, ec));
+        info.modified = std::chrono::duration_cast<std::chrono::nanoseconds>(modified.time_since_epoch()).count();
+    }
+    return !ec;
+#endif
+}
+
+}  // namespace
+
+FileFilter::FileFilter(const FartConfig::Options& options)
+    : min_size_(options.min_filesize), max_size_(options.max_filesize) {
+    if (!options.types.empty()) {
+        std::vector<std::string> patterns;
+        for (const auto& type : options.types) {
+            if (const auto* type_patterns = typePatterns(type)) {
+                patterns.insert(patterns.end(), type_patterns->begin(), type_patterns->end());
+            }
+        }
+        types_ = std::make_unique<GlobSet>(patterns);
+    }
+    if (!options.newer_than.empty()) {
+        parseNewerThan(options.newer_than, newer_than_);
+    }
+    needs_stat_ = min_size_ || max_size_ || newer_than_;
+}
+
+bool FileFilter::accepts(const std::filesystem::path& path) const {
+    if (types_ && !types_->matches(path.filename().string())) {
+        return false;
+    }
+    if (!needs_stat_) {
+        return true;
+    }
+
+    FileInfo info;
+    if (!statFile(path, min_size_ || max_size_, newer_than_ != 0, info)) {
+        return true;  // processing the file reports the problem
+    }
+    if (info.size < min_size_ || (max_size_ && info.size > max_size_)) {
+        return false;
+    }
+    return !newer_than_ || info.modified > newer_than_;
+}
+
+bool FileFilter::parseSize(const std::string& text, uint64_t& size) {
+    size_t used = 0;
+    try {
+        size = std::stoull(text, &used);
+    } catch (const std::exception&) {
+        return false;
+    }
+    if (!std::isdigit(static_cast<unsigned char>(text[0]))) {
+        return false;
+    }
+    if (used == text.size()) {
+        return true;
+    }
+    if (used + 1 != text.size()) {
+        return false;
+    }
+    unsigned shift;
+    switch (std::toupper(static_cast<unsigned char>(text[used]))) {
+        case 'K': shift = 10; break;
+        case 'M': shift = 20; break;
+        case 'G': shift = 30; break;
+        default: return false;
+    }
+    // A size that does not fit is refused rather than wrapped to an arbitrary limit
+    if (size > (UINT64_MAX >> shift)) {
+        return false;
+    }
+    size <<= shift;
+    return true;
+}
+
+bool FileFilter::parseAge(const std::string& text, int64_t& seconds) {
+    if (text.size() < 2 || !std::isdigit(static_cast<unsigned char>(text[0]))) {
+        return false;
+    }
+    size_t used = 0;
+    try {
+        seconds = std::stoll(text, &used);
+    } catch (const std::exception&) {
+        return false;
+    }
+    if (used + 1 != text.size()) {
+        return false;
+    }
+    switch (text[used]) {
+        case 's': return true;
+        case 'm': seconds *= 60; return true;
+        case 'h': seconds *= 60 * 60; return true;
+        case 'd': seconds *= 24 * 60 * 60; return true;
+        case 'w': seconds *= 7 * 24 * 60 * 60; return true;
+        default: return false;
+    }
+}
+
+bool FileFilter::parseNewerThan(const std::string& text, int64_t& time) {
+    int64_t seconds;
+    if (parseAge(text, seconds)) {
+        auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch());
+        time = now.count() - seconds * 1000000000LL;
+        return true;
+    }
+    FileInfo info;
+    if (!statFile(text, false, true, info)) {
+        return false;
+    }
+    time = info.modified;
+    return true;
+}
+
+const std::vector<std::string>* FileFilter::typePatterns(const std::string& type) {
+    auto it = fileTypes().find(type);
+    return it == fileTypes().end() ? nullptr : &it->second;
+}
+
+std::string FileFilter::typeNames() {
+    std::string names;
+    for (const auto& [name, patterns] : fileTypes()) {
+        names += (names.empty() ? "" : ", ") + name;
+    }
+    return names;
+}
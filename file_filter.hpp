@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include "fart_config.hpp"
+#include "glob_set.hpp"
+
+// --type, --min-filesize, --max-filesize and --newer-than, decided before a
+// file is opened: the type from the name alone, size and age from a single
+// stat of the file (statx asking only for the fields needed, on Linux).
+class FileFilter {
+public:
+    explicit FileFilter(const FartConfig::Options& options);
+
+    bool active() const { return types_ || needs_stat_; }
+
+    bool accepts(const std::filesystem::path& path) const;
+
+    // "64K", "10M", "2G" or a plain number of bytes
+    static bool parseSize(const std::string& text, uint64_t& size);
+
+    // "90s", "30m", "12h", "2d" or "1w"
+    static bool parseAge(const std::string& text, int64_t& seconds);
+
+    // A --newer-than value (an age, or a file whose modification time to compare with)
+    // as nanoseconds since the epoch; false if it is neither
+    static bool parseNewerThan(const std::string& text, int64_t& time);
+
+    // The patterns of a --type name, or nullptr if there is no such type
+    static const std::vector<std::string>* typePatterns(const std::string& type);
+
+    // The known --type names, comma separated
+    static std::string typeNames();
+
+private:
+    std::unique_ptr<GlobSet> types_;
+    uint64_t min_size_;
+    uint64_t max_size_;  // 0 for no limit
+    int64_t newer_than_ = 0;  // nanoseconds since the epoch; 0 for no limit
+    bool needs_stat_;
+};
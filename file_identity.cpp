@@ -0,0 +1,76 @@
+#include "file_identity.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+bool FileId::of(const std::filesystem::path& path, FileId& id, uint64_t& links) {
+#if defined(__linux__) && defined(STATX_INO)
+    struct statx st;
+    if (statx(AT_FDCWD, path.c_str(), 0, STATX_INO | STATX_NLINK, &st) != 0) {
+        return false;
+    }
+    id.device = (static_cast<uint64_t>(st.stx_dev_major) << 32) | st.stx_dev_minor;
+    id.inode = st.stx_ino;
+    links = st.stx_nlink;
+    return true;
+#elif !defined(_WIN32)
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    id.device = static_cast<uint64_t>(st.st_dev);
+    id.inode = static_cast<uint64_t>(st.st_ino);
+    links = static_cast<uint64_t>(st.st_nlink);
+    return true;
+#else
+    (void)path;
+    (void)id;
+    (void)links;
+    return false;
+#endif
+}
+
+size_t FileIdSet::find(const FileId& id) const {
+    // splitmix64 finalizer over both halves; the table size is a power of two
+    uint64_t hash = id.inode * 0x9e3779b97f4a7c15ull ^ id.device;
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+    hash ^= hash >> 31;
+
+    size_t mask = slots_.size() - 1;
+    size_t slot = static_cast<size_t>(hash) & mask;
+    while (slots_[slot].inode != 0 && !(slots_[slot] == id)) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+bool FileIdSet::contains(const FileId& id) const {
+    return !slots_.empty() && slots_[find(id)].inode != 0;
+}
+
+bool FileIdSet::insert(const FileId& id) {
+    if ((size_ + 1) * 2 > slots_.size()) {
+        grow();
+    }
+    size_t slot = find(id);
+    if (slots_[slot].inode != 0) {
+        return false;
+    }
+    slots_[slot] = id;
+    size_++;
+    return true;
+}
+
+void FileIdSet::grow() {
+    std::vector<FileId> old;
+    old.swap(slots_);
+    slots_.resize(old.empty() ? 1024 : old.size() * 2);
+    for (const auto& id : old) {
+        if (id.inode != 0) {
+            slots_[find(id)] = id;
+        }
+    }
+}
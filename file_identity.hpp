@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// What makes a file the same file whatever path it is reached by
+struct FileId {
+    uint64_t device = 0;
+    uint64_t inode = 0;
+
+    bool operator==(const FileId& other) const { return device == other.device && inode == other.inode; }
+
+    // Identity of path, following symlinks, and its number of hard links;
+    // false on error and where files have no inode numbers (Windows)
+    static bool of(const std::filesystem::path& path, FileId& id, uint64_t& links);
+};
+
+// Set of file identities in one open-addressed table: 16 bytes a slot and no
+// allocation per file, so a walk can remember millions of them
+class FileIdSet {
+public:
+    // False if id was in the set already
+    bool insert(const FileId& id);
+
+    bool contains(const FileId& id) const;
+
+    size_t size() const { return size_; }
+
+private:
+    std::vector<FileId> slots_;  // inode 0 marks a free slot; no file has it
+    size_t size_ = 0;
+
+    size_t find(const FileId& id) const;  // its slot, or the free slot it would go in
+    void grow();
+};
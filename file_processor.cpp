@@ -1,12 +1,282 @@
 #include "file_processor.hpp"
+#include "fart_trace.hpp"
+#include "tar_reader.hpp"
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <algorithm>
-#include <regex>
+#include <iomanip>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Returns 0 at end of input
+size_t readStdin(char* buffer, size_t size) {
+#ifdef _WIN32
+    int bytes = _read(0, buffer, static_cast<unsigned>(std::min<size_t>(size, INT_MAX)));
+#else
+    ssize_t bytes;
+    while ((bytes = read(STDIN_FILENO, buffer, size)) == -1 && errno == EINTR) {
+    }
+#endif
+    if (bytes < 0) {
+        throw std::runtime_error(std::strerror(errno));
+    }
+    return static_cast<size_t>(bytes);
+}
+
+// True if a read would not block
+bool stdinReady() {
+#ifdef _WIN32
+    return false;
+#else
+    pollfd fd = {STDIN_FILENO, POLLIN, 0};
+    return poll(&fd, 1, 0) == 1;
+#endif
+}
+
+// A whole file mapped read-only; empty if it cannot be mapped. With
+// drop_cache its pages leave the page cache once it is unmapped.
+class MappedFile {
+public:
+    MappedFile(const std::filesystem::path& path, bool drop_cache) : drop_cache_(drop_cache) {
+#ifndef _WIN32
+        fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_ == -1) {
+            return;
+        }
+        struct stat info;
+        if (fstat(fd_, &info) == 0 && info.st_size > 0) {
+            void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd_, 0);
+            if (data != MAP_FAILED) {
+                madvise(data, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+                data_ = static_cast<const char*>(data);
+                size_ = static_cast<size_t>(info.st_size);
+            }
+        }
+#else
+        (void)path;
+#endif
+    }
+    
+    ~MappedFile() { close(); }
+    
+    void close() {
+#ifndef _WIN32
+        if (data_) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+        if (fd_ != -1) {
+#ifdef POSIX_FADV_DONTNEED
+            if (drop_cache_) {
+                posix_fadvise(fd_, 0, 0, POSIX_FADV_DONTNEED);
+            }
+#endif
+            ::close(fd_);
+        }
+#endif
+        data_ = nullptr;
+        size_ = 0;
+        fd_ = -1;
+    }
+    
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    std::string_view data() const { return std::string_view(data_ ? data_ : "", size_); }
+    bool valid() const { return data_ != nullptr; }
+    
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    int fd_ = -1;
+    bool drop_cache_;
+};
+
+// --search-archives: members must match the name patterns of the wildcards,
+// or anything where a wildcard names a file or folder
+std::vector<std::string> memberPatterns(const FartConfig& config) {
+    std::vector<std::string> patterns;
+    for (const auto& wildcard : FileProcessor::splitWildcards(config.getWildcard())) {
+        std::filesystem::path path(wildcard);
+        std::error_code ec;
+        patterns.push_back(std::filesystem::exists(path, ec) ? FartConfig::WILDCARD_ALL : path.filename().string());
+    }
+    if (patterns.empty()) {
+        patterns.push_back(FartConfig::WILDCARD_ALL);
+    }
+    return patterns;
+}
+
+}  // namespace
 
 FileProcessor::FileProcessor(FartConfig& config) 
-    : config_(config), text_processor_(std::make_unique<TextProcessor>(config)) {}
+    : config_(config), text_processor_(std::make_unique<TextProcessor>(config)),
+      file_filter_(config.getOptions()),
+      archive_members_(config.getOptions().search_archives ? memberPatterns(config) : std::vector<std::string>()),
+      phase_started_(std::chrono::steady_clock::now()) {
+    const auto& options = config_.getOptions();
+    std::string vcs_command = options.vcs_edit.empty() && options.cvs ? FartConfig::CVS_EDIT : options.vcs_edit;
+    if (!vcs_command.empty() && !options.preview) {
+        vcs_hook_ = std::make_unique<VcsHook>(vcs_command);
+    }
+    if (options.io_uring && !options.filename_mode) {
+        reader_ = std::make_unique<FileReader>(options.no_cache_pollution);
+        std::string error;
+        if (!reader_->open(error)) {
+            if (options.verbose) {
+                std::cerr << "Warning: " << error << "; reading files one at a time" << std::endl;
+            }
+            reader_.reset();
+        }
+    }
+}
+
+FileProcessor::~FileProcessor() = default;
+
+FileProcessor::PhaseScope::PhaseScope(FileProcessor& processor, Phase phase)
+    : processor_(processor), previous_(processor.current_phase_),
+      active_(processor.config_.getOptions().stats) {
+    if (active_) {
+        processor_.switchPhase(phase);
+    }
+}
+
+FileProcessor::PhaseScope::~PhaseScope() {
+    if (active_) {
+        processor_.switchPhase(previous_);
+    }
+}
+
+void FileProcessor::switchPhase(Phase phase) {
+    auto now = std::chrono::steady_clock::now();
+    config_.getStats().phase_time[static_cast<size_t>(current_phase_)] += now - phase_started_;
+    current_phase_ = phase;
+    phase_started_ = now;
+}
+
+unsigned FileProcessor::shardOf(const std::filesystem::path& path, unsigned shard_count) {
+    // FNV-1a over the path as walked, with '/' separators on every platform
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : path.lexically_normal().generic_string()) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+    return static_cast<unsigned>(hash % shard_count);
+}
+
+bool FileProcessor::inShard(const std::filesystem::path& path) {
+    const auto& options = config_.getOptions();
+    if (!options.shard_count || shardOf(path, options.shard_count) == options.shard_index) {
+        return true;
+    }
+    config_.getStats().files_skipped_shard++;
+    return false;
+}
+
+bool FileProcessor::firstVisit(const std::filesystem::path& path) {
+    // Symbolic links to files are processed too, so any file can be reached twice
+    FileId id;
+    uint64_t links;
+    if (!FileId::of(path, id, links)) {
+        return true;
+    }
+    return seen_files_.insert(id);
+}
+
+void FileProcessor::queueFile(const std::filesystem::path& file_path, ProcessResult& total_result) {
+    // Renames are planned in walk order, so names are not queued
+    if (file_sink_ || config_.getOptions().filename_mode) {
+        auto result = processFile(file_path);
+        total_result.matches_found += result.matches_found;
+        if (!result.success) {
+            total_result.success = false;
+            total_result.error_message += result.error_message + "\n";
+        }
+        return;
+    }
+    // Filtered before reading, as processFile would
+    if (file_filter_.active() && !file_filter_.accepts(file_path)) {
+        config_.getStats().files_skipped_filter++;
+        return;
+    }
+    pending_.emplace_back();
+    pending_.back().path = file_path;
+    if (reader_) {
+        if (pending_.size() == FileReader::QUEUE_DEPTH) {
+            flushFiles(total_result);
+        }
+        return;
+    }
+    
+    // Opened now, so the kernel reads it in while the files before it are matched
+    auto& file = pending_.back();
+    if (file.input.open(file_path, config_.getOptions().no_cache_pollution)) {
+        file.input.prefetch();
+    }
+    if (pending_.size() > LOOKAHEAD_FILES) {
+        processQueued(pending_.front(), total_result);
+        pending_.erase(pending_.begin());
+    }
+}
+
+void FileProcessor::flushFiles(ProcessResult& total_result) {
+    if (pending_.empty()) {
+        return;
+    }
+    if (reader_) {
+        PhaseScope phase(*this, Phase::READ);
+        reader_->read(pending_);
+    }
+    for (auto& file : pending_) {
+        processQueued(file, total_result);
+    }
+    pending_.clear();
+}
+
+void FileProcessor::processQueued(FileReader::File& file, ProcessResult& total_result) {
+    preloaded_ = &file;
+    auto result = processFile(file.path);
+    preloaded_ = nullptr;
+    total_result.matches_found += result.matches_found;
+    if (!result.success) {
+        total_result.success = false;
+        total_result.error_message += result.error_message + "\n";
+    }
+}
+
+bool FileProcessor::openInput(const std::filesystem::path& file_path, InputFile& file) {
+    if (preloaded_ && preloaded_->path == file_path && preloaded_->input.isOpen()) {
+        file = std::move(preloaded_->input);
+        return true;
+    }
+    return file.open(file_path, config_.getOptions().no_cache_pollution);
+}
+
+void FileProcessor::recordResult(const std::filesystem::path& path, const ProcessResult& result) {
+    if (result_callback_ && result.success) {
+        result_callback_(path, result.matches_found);
+    }
+    if (result_log_ && result.matches_found > 0) {
+        result_log_->add(path.string(), result.matches_found);
+    }
+}
 
 FileProcessor::ProcessResult FileProcessor::processWildcards(const std::string& wildcards) {
     ProcessResult total_result;
@@ -14,24 +284,37 @@ FileProcessor::ProcessResult FileProcessor::processWildcards(const std::string&
     
     auto wildcard_list = splitWildcards(wildcards);
     
+    if (!beginRun(total_result)) {
+        return total_result;
+    }
+    
+    auto add_result = [&](const ProcessResult& result) {
+        total_result.matches_found += result.matches_found;
+        if (!result.success) {
+            total_result.success = false;
+            total_result.error_message += result.error_message + "\n";
+        }
+    };
+    
+    // Wildcards are processed in the order given; consecutive ones in the same
+    // directory are served by one walk. A named file is a step without patterns.
+    std::vector<std::pair<std::filesystem::path, std::vector<std::string>>> steps;
+    auto add_walk = [&](const std::filesystem::path& dir, const std::string& pattern) {
+        if (!steps.empty() && !steps.back().second.empty() && steps.back().first == dir) {
+            steps.back().second.push_back(pattern);
+        } else {
+            steps.emplace_back(dir, std::vector<std::string>{pattern});
+        }
+    };
+    
     for (const auto& wildcard : wildcard_list) {
         std::filesystem::path path(wildcard);
         
         if (std::filesystem::exists(path)) {
             if (std::filesystem::is_directory(path)) {
-                auto result = processDirectory(path, "*", config_.getOptions().recursive);
-                total_result.matches_found += result.matches_found;
-                if (!result.success) {
-                    total_result.success = false;
-                    total_result.error_message += result.error_message + "\n";
-                }
+                add_walk(path, "*");
             } else {
-                auto result = processFile(path);
-                total_result.matches_found += result.matches_found;
-                if (!result.success) {
-                    total_result.success = false;
-                    total_result.error_message += result.error_message + "\n";
-                }
+                steps.emplace_back(path, std::vector<std::string>());
             }
         } else {
             auto parent_path = path.parent_path();
@@ -41,28 +324,177 @@ FileProcessor::ProcessResult FileProcessor::processWildcards(const std::string&
                 parent_path = ".";
             }
             
-            auto result = processDirectory(parent_path, filename, config_.getOptions().recursive);
-            total_result.matches_found += result.matches_found;
-            if (!result.success) {
-                total_result.success = false;
-                total_result.error_message += result.error_message + "\n";
+            add_walk(parent_path, filename);
+        }
+    }
+    
+    for (const auto& [path, patterns] : steps) {
+        if (patterns.empty()) {
+            if (inShard(path)) {
+                queueFile(path, total_result);
             }
+            continue;
         }
+        // Each walk has its own patterns, so a folder another walk went through is walked again
+        seen_dirs_ = FileIdSet();
+        add_result(processDirectory(path, GlobSet(patterns), config_.getOptions().recursive));
     }
     
+    finishRun(total_result);
     return total_result;
 }
 
+FileProcessor::ProcessResult FileProcessor::processFileList(const std::vector<std::filesystem::path>& files) {
+    ProcessResult total_result;
+    total_result.success = true;
+    
+    if (!beginRun(total_result)) {
+        return total_result;
+    }
+    
+    for (const auto& file : files) {
+        if (!inShard(file)) {
+            continue;
+        }
+        queueFile(file, total_result);
+    }
+    
+    finishRun(total_result);
+    return total_result;
+}
+
+FileProcessor::ProcessResult FileProcessor::processListedFiles(const std::string& list_file) {
+    ProcessResult total_result;
+    total_result.success = true;
+    
+    std::ifstream file;
+    if (list_file != "-") {
+        file.open(list_file, std::ios::binary);
+        if (!file.is_open()) {
+            total_result.success = false;
+            total_result.error_message = "Could not open file: " + list_file;
+            return total_result;
+        }
+    }
+    std::istream& list = list_file == "-" ? std::cin : file;
+    
+    if (!beginRun(total_result)) {
+        return total_result;
+    }
+    
+    const bool null_data = config_.getOptions().null_data;
+    std::string name;
+    while (std::getline(list, name, null_data ? '\0' : '\n')) {
+        if (!null_data && !name.empty() && name.back() == '\r') {
+            name.pop_back();
+        }
+        if (name.empty()) {
+            continue;
+        }
+        std::filesystem::path path(name);
+        if (!inShard(path)) {
+            continue;
+        }
+        queueFile(path, total_result);
+    }
+    
+    finishRun(total_result);
+    return total_result;
+}
+
+void FileProcessor::forgetVisits() {
+    seen_files_ = FileIdSet();
+    seen_dirs_ = FileIdSet();
+}
+
+bool FileProcessor::beginRun(ProcessResult& total_result) {
+    // A file seen by an earlier run may have been deleted and its inode reused (--watch)
+    forgetVisits();
+    const std::string& emit_results = config_.getOptions().emit_results;
+    if (!emit_results.empty()) {
+        result_log_ = std::make_unique<ResultLog>();
+        if (!result_log_->open(emit_results, config_)) {
+            total_result.success = false;
+            total_result.error_message = "Could not write to file: " + emit_results;
+            return false;
+        }
+    }
+    return true;
+}
+
+void FileProcessor::finishRun(ProcessResult& total_result) {
+    flushFiles(total_result);
+    
+    if (rename_plan_.size()) {
+        auto result = executeRenames();
+        if (!result.success) {
+            total_result.success = false;
+            total_result.error_message += result.error_message + "\n";
+        }
+    }
+    
+    if (vcs_hook_ && !vcs_hook_->finish()) {
+        total_result.success = false;
+        total_result.error_message += vcs_hook_->errorMessage();
+    }
+    
+    if (result_log_) {
+        const auto& stats = config_.getStats();
+        if (!result_log_->finish(stats.total_files, stats.total_matches)) {
+            total_result.success = false;
+            total_result.error_message += "Could not write to file: " + result_log_->path();
+        }
+        result_log_.reset();
+    }
+}
+
 FileProcessor::ProcessResult FileProcessor::processFile(const std::filesystem::path& file_path) {
+    FART_TRACE_SCOPE("processFile");
     ProcessResult result;
+    auto started = std::chrono::steady_clock::now();
+    
+    // Decided from the name and a stat, so a rejected file is never opened
+    if (!preloaded_ && file_filter_.active() && !file_filter_.accepts(file_path)) {
+        config_.getStats().files_skipped_filter++;
+        result.success = true;
+        return result;
+    }
+    
+    if (file_sink_) {
+        file_sink_(file_path);
+        result.success = true;
+        return result;
+    }
     
     try {
-        if (!std::filesystem::exists(file_path)) {
+        bool opened = preloaded_ && (preloaded_->loaded || preloaded_->input.isOpen());
+        if (!opened && !std::filesystem::exists(file_path)) {
             result.error_message = "File not found: " + file_path.string();
             return result;
         }
         
-        if (!config_.getOptions().binary && isBinaryFile(file_path)) {
+        // Grep mode searches compressed files as the text they hold, which is
+        // checked for being binary once decompressed
+        const auto& options = config_.getOptions();
+        const bool grep = config_.isGrepMode() && !options.filename_mode;
+        auto format = Decompressor::Format::NONE;
+        bool binary = false;
+        if (!options.binary || grep) {
+            PhaseScope phase(*this, Phase::READ);
+            char buffer[BINARY_SAMPLE_SIZE];
+            std::string_view sample;
+            if (readSample(file_path, buffer, sample)) {
+                format = grep ? Decompressor::detect(sample) : format;
+                if (!Decompressor::supported(format)) {
+                    format = Decompressor::Format::NONE;
+                }
+                binary = !options.binary && format == Decompressor::Format::NONE && looksBinary(sample) &&
+                         !(grep && options.search_archives && TarReader::isTar(sample));
+            }
+        }
+        
+        if (binary) {
+            config_.getStats().files_skipped_binary++;
             if (config_.getOptions().verbose) {
                 std::cerr << "Skipping binary file: " << file_path << std::endl;
             }
@@ -73,22 +505,40 @@ FileProcessor::ProcessResult FileProcessor::processFile(const std::filesystem::p
         updateProgress(file_path.string());
         
         if (config_.getOptions().filename_mode) {
-            return processFileName(file_path);
+            result = processFileName(file_path);
         } else {
-            return processFileContents(file_path);
+            result = processFileContents(file_path, format);
         }
         
     } catch (const std::exception& e) {
         result.error_message = "Error processing file " + file_path.string() + ": " + e.what();
-        return result;
     }
+    
+    if (config_.getOptions().stats) {
+        config_.getStats().recordFileLatency(file_path.string(), std::chrono::steady_clock::now() - started);
+    }
+    
+    recordResult(file_path, result);
+    return result;
 }
 
 FileProcessor::ProcessResult FileProcessor::processDirectory(const std::filesystem::path& dir_path, 
                                                            const std::string& pattern, 
                                                            bool recursive) {
+    return processDirectory(dir_path, GlobSet({pattern}), recursive);
+}
+
+FileProcessor::ProcessResult FileProcessor::processDirectory(const std::filesystem::path& dir_path,
+                                                           const GlobSet& patterns,
+                                                           bool recursive) {
+    FART_TRACE_SCOPE("processDirectory");
     ProcessResult total_result;
     total_result.success = true;
+    PhaseScope phase(*this, Phase::WALK);
+    const auto& options = config_.getOptions();
+    const bool gitignore = options.gitignore;
+    bool entered = false;
+    bool stacked = false;
     
     try {
         if (!std::filesystem::exists(dir_path) || !std::filesystem::is_directory(dir_path)) {
@@ -96,27 +546,79 @@ FileProcessor::ProcessResult FileProcessor::processDirectory(const std::filesyst
             return total_result;
         }
         
+        FileId id;
+        uint64_t links;
+        if (options.follow && FileId::of(dir_path, id, links)) {
+            if (std::find(dir_stack_.begin(), dir_stack_.end(), id) != dir_stack_.end()) {
+                if (!options.quiet) {
+                    std::cerr << "Warning: skipping symbolic link loop: " << dir_path.string() << std::endl;
+                }
+                config_.getStats().dirs_skipped_link++;
+                return total_result;
+            }
+            if (!seen_dirs_.insert(id)) {
+                config_.getStats().dirs_skipped_link++;  // walked already, through another link
+                return total_result;
+            }
+            dir_stack_.push_back(id);
+            stacked = true;
+        }
+        
         std::filesystem::directory_iterator dir_iter(dir_path);
+        config_.getStats().directories_walked++;
+        if (directory_callback_) {
+            directory_callback_(dir_path, patterns);
+        }
+        if (gitignore) {
+            ignore_rules_.enter(dir_path);
+            entered = true;
+        }
         
         for (const auto& entry : dir_iter) {
+            // Linked files are processed once each; linked folders are only walked with --follow
             if (entry.is_regular_file()) {
-                if (matchesPattern(entry.path().filename().string(), pattern)) {
-                    auto result = processFile(entry.path());
-                    total_result.matches_found += result.matches_found;
-                    if (!result.success) {
-                        total_result.success = false;
-                        total_result.error_message += result.error_message + "\n";
+                std::string file_name = entry.path().filename().string();
+                if (file_name.ends_with(FartConfig::STAGED_SUFFIX)) {
+                    // Staged by this run (--vcs-edit), in a folder that is still being read
+                    continue;
+                }
+                if (gitignore && ignore_rules_.ignored(file_name, false)) {
+                    config_.getStats().files_skipped_ignore++;
+                } else if (patterns.matches(file_name) ||
+                           (options.search_archives && TarReader::isArchiveName(file_name))) {
+                    if (!inShard(entry.path())) {
+                        continue;
+                    }
+                    if (!options.filename_mode && !firstVisit(entry.path())) {
+                        config_.getStats().files_skipped_link++;
+                        continue;
                     }
+                    queueFile(entry.path(), total_result);
+                } else {
+                    config_.getStats().files_skipped_pattern++;
                 }
             } else if (entry.is_directory() && recursive) {
                 std::string dir_name = entry.path().filename().string();
-                if (!shouldSkipDirectory(dir_name, config_.getOptions())) {
-                    auto result = processDirectory(entry.path(), pattern, recursive);
+                if (!options.follow && entry.is_symlink()) {
+                    config_.getStats().dirs_skipped_link++;
+                } else if (shouldSkipDirectory(dir_name, config_.getOptions())) {
+                    config_.getStats().dirs_skipped_vcs++;
+                } else if (gitignore && ignore_rules_.ignored(dir_name, true)) {
+                    config_.getStats().dirs_skipped_ignore++;
+                } else {
+                    auto result = processDirectory(entry.path(), patterns, recursive);
                     total_result.matches_found += result.matches_found;
                     if (!result.success) {
                         total_result.success = false;
                         total_result.error_message += result.error_message + "\n";
                     }
+                    // Folders are renamed too, after their contents (see RenamePlan)
+                    if (config_.getOptions().filename_mode && config_.isFartMode() &&
+                        patterns.matches(dir_name) && inShard(entry.path())) {
+                        result = processFileName(entry.path());
+                        total_result.matches_found += result.matches_found;
+                        recordResult(entry.path(), result);
+                    }
                 }
             }
         }
@@ -126,65 +628,192 @@ FileProcessor::ProcessResult FileProcessor::processDirectory(const std::filesyst
         total_result.error_message = "Error processing directory " + dir_path.string() + ": " + e.what();
     }
     
+    if (entered) {
+        ignore_rules_.leave();
+    }
+    if (stacked) {
+        dir_stack_.pop_back();
+    }
     return total_result;
 }
 
-FileProcessor::ProcessResult FileProcessor::findInFile(const std::filesystem::path& file_path) {
+FileProcessor::ProcessResult FileProcessor::findInFile(const std::filesystem::path& file_path,
+                                                       Decompressor::Format format) {
     ProcessResult result;
     
     try {
-        std::ifstream file(file_path);
-        if (!file.is_open()) {
-            result.error_message = "Could not open file: " + file_path.string();
-            return result;
+        const bool compressed = format != Decompressor::Format::NONE;
+        InputFile file;
+        ReadFunction source;
+        if (preloaded_ && preloaded_->loaded) {
+            source = [content = readFile(file_path), pos = size_t(0)](char* buffer, size_t size) mutable {
+                size_t bytes = std::min(size, content.size() - pos);
+                std::memcpy(buffer, content.data() + pos, bytes);
+                pos += bytes;
+                return bytes;
+            };
+        } else {
+            if (!openInput(file_path, file)) {
+                result.error_message = "Could not open file: " + file_path.string();
+                return result;
+            }
+            config_.getStats().files_opened++;
+            source = [&](char* buffer, size_t size) {
+                size_t bytes = file.read(buffer, size);
+                config_.getStats().bytes_read += bytes;
+                return bytes;
+            };
         }
         
-        std::string line;
-        int line_number = 0;
-        bool first_match = true;
+        std::unique_ptr<Decompressor> decompressor;
+        ReadFunction read = source;
+        if (compressed) {
+            decompressor = std::make_unique<Decompressor>(format, source);
+            read = [&](char* buffer, size_t size) { return decompressor->read(buffer, size); };
+        }
         
-        while (std::getline(file, line)) {
-            line_number++;
-            int match_count = text_processor_->countMatches(line);
+        if (config_.getOptions().search_archives) {
+            // A tar archive, compressed or not, is told by its first block
+            std::string head(TarReader::BLOCK_SIZE, '\0');
+            size_t filled = 0;
+            size_t bytes;
+            while (filled < head.size() && (bytes = read(head.data() + filled, head.size() - filled)) > 0) {
+                filled += bytes;
+            }
+            head.resize(filled);
+            bool tar = TarReader::isTar(head);
+            read = [head = std::move(head), pos = size_t(0), rest = read](char* buffer, size_t size) mutable {
+                if (pos == head.size()) {
+                    return rest(buffer, size);
+                }
+                size_t bytes = std::min(size, head.size() - pos);
+                std::memcpy(buffer, head.data() + pos, bytes);
+                pos += bytes;
+                return bytes;
+            };
+            if (tar) {
+                return searchArchive(file_path, read);
+            }
+        }
+        
+        result = searchText(file_path.string(), read, compressed && !config_.getOptions().binary);
+        
+    } catch (const std::exception& e) {
+        result.error_message = "Error reading file " + file_path.string() + ": " + e.what();
+    }
+    
+    return result;
+}
+
+FileProcessor::ProcessResult FileProcessor::searchArchive(const std::filesystem::path& archive_path,
+                                                          const ReadFunction& read) {
+    ProcessResult result;
+    TarReader tar(read);
+    TarReader::Member member;
+    while (tar.next(member)) {
+        std::string_view name = member.name;
+        if (!archive_members_.matches(name.substr(name.rfind('/') + 1))) {
+            config_.getStats().files_skipped_pattern++;
+            continue;
+        }
+        auto member_result = searchText(archive_path.string() + ":" + member.name,
+                                        [&tar](char* buffer, size_t size) { return tar.read(buffer, size); },
+                                        !config_.getOptions().binary);
+        result.matches_found += member_result.matches_found;
+    }
+    result.success = true;
+    return result;
+}
+
+FileProcessor::ProcessResult FileProcessor::searchText(const std::string& name, const ReadFunction& read,
+                                                       bool check_binary) {
+    ProcessResult result;
+    int line_number = 0;
+    bool first_match = true;
+    
+    auto match_line = [&](std::string_view line) {
+        line_number++;
+        int match_count = text_processor_->countMatches(line);
+        
+        if (config_.getOptions().invert) {
+            match_count = match_count ? 0 : 1;
+        }
+        
+        if (match_count > 0) {
+            result.matches_found += match_count;
             
-            if (config_.getOptions().invert) {
-                match_count = match_count ? 0 : 1;
+            if (first_match && !config_.getOptions().count && !config_.getOptions().quiet) {
+                std::cout << name << " :\n";
+                first_match = false;
             }
             
-            if (match_count > 0) {
-                result.matches_found += match_count;
-                
-                if (first_match && !config_.getOptions().count && !config_.getOptions().quiet) {
-                    std::cout << file_path.string() << " :\n";
-                    first_match = false;
-                }
-                
-                if (!config_.getOptions().count) {
-                    if (config_.getOptions().line_numbers) {
-                        std::cout << "[" << std::setw(4) << line_number << "]";
-                    }
-                    std::cout << line << std::endl;
+            if (!config_.getOptions().count) {
+                if (config_.getOptions().line_numbers) {
+                    std::cout << "[" << std::setw(4) << line_number << "]";
                 }
+                std::cout << line << std::endl;
             }
         }
+    };
+    
+    // Read in blocks so that reading and matching can be timed separately
+    constexpr size_t BLOCK_SIZE = 64 * 1024;
+    std::string buffer;
+    
+    while (true) {
+        size_t carried = buffer.size();
+        buffer.resize(carried + BLOCK_SIZE);
+        size_t bytes;
+        {
+            FART_TRACE_SCOPE("readBlock");
+            PhaseScope phase(*this, Phase::READ);
+            bytes = read(&buffer[carried], BLOCK_SIZE);
+        }
+        buffer.resize(carried + bytes);
         
-        if (result.matches_found > 0) {
-            config_.getStats().total_files++;
-            if (config_.getOptions().count) {
-                if (config_.getOptions().quiet) {
-                    std::cout << file_path.string() << std::endl;
-                } else {
-                    std::cout << file_path.string() << " [" << result.matches_found << "]" << std::endl;
+        if (check_binary) {
+            check_binary = false;
+            if (looksBinary(buffer)) {
+                config_.getStats().files_skipped_binary++;
+                if (config_.getOptions().verbose) {
+                    std::cerr << "Skipping binary file: " << name << std::endl;
                 }
+                result.success = true;
+                return result;
             }
         }
         
-        result.success = true;
+        PhaseScope phase(*this, Phase::MATCH);
+        size_t start = 0;
+        size_t eol;
+        while ((eol = buffer.find('\n', start)) != std::string::npos) {
+            match_line(std::string_view(buffer).substr(start, eol - start));
+            start = eol + 1;
+        }
         
-    } catch (const std::exception& e) {
-        result.error_message = "Error reading file " + file_path.string() + ": " + e.what();
+        if (bytes == 0) {
+            if (start < buffer.size()) {
+                match_line(std::string_view(buffer).substr(start));
+            }
+            break;
+        }
+        buffer.erase(0, start);
     }
     
+    config_.getStats().total_matches += result.matches_found;
+    
+    if (result.matches_found > 0) {
+        config_.getStats().total_files++;
+        if (config_.getOptions().count) {
+            if (config_.getOptions().quiet) {
+                std::cout << name << std::endl;
+            } else {
+                std::cout << name << " [" << result.matches_found << "]" << std::endl;
+            }
+        }
+    }
+    
+    result.success = true;
     return result;
 }
 
@@ -194,16 +823,21 @@ FileProcessor::ProcessResult FileProcessor::replaceInFile(const std::filesystem:
     try {
         std::string content = readFile(file_path);
         std::string modified_content;
+        modified_content.reserve(content.size() + 1);
         bool file_changed = false;
         
-        std::istringstream iss(content);
-        std::string line;
+        PhaseScope match_phase(*this, Phase::MATCH);
+        std::string_view rest(content);
         int line_number = 0;
         
-        while (std::getline(iss, line)) {
+        while (!rest.empty()) {
+            size_t eol = rest.find('\n');
+            std::string_view line = rest.substr(0, eol);
+            rest.remove_prefix(eol == std::string_view::npos ? rest.size() : eol + 1);
+            
             line_number++;
-            int match_count = 0;
-            std::string processed_line = text_processor_->processLine(line, match_count);
+            int match_count = text_processor_->replaceLine(line, modified_content);
+            modified_content += '\n';
             
             if (match_count > 0) {
                 result.matches_found += match_count;
@@ -213,25 +847,39 @@ FileProcessor::ProcessResult FileProcessor::replaceInFile(const std::filesystem:
                     std::cout << "[" << std::setw(4) << line_number << "]";
                 }
             }
-            
-            modified_content += processed_line + "\n";
         }
         
         if (file_changed) {
-            config_.getStats().total_files++;
-            
             if (config_.getOptions().count && !config_.getOptions().quiet) {
                 std::cout << file_path.string() << " [" << result.matches_found << "]" << std::endl;
             }
             
-            if (!config_.getOptions().preview) {
-                if (config_.getOptions().backup) {
-                    createBackup(file_path);
-                }
-                
-                if (!writeFile(file_path, modified_content)) {
-                    result.error_message = "Could not write to file: " + file_path.string();
-                    return result;
+            if (config_.getOptions().preview) {
+                config_.getStats().total_files++;
+                config_.getStats().total_matches += result.matches_found;
+            } else {
+                PhaseScope write_phase(*this, Phase::WRITE);
+                if (vcs_hook_) {
+                    // Stage the result next to the file; it replaces the file after the command ran
+                    auto staged = stagedPath(file_path);
+                    if (!writeFile(staged, modified_content)) {
+                        result.error_message = "Could not write to file: " + staged.string();
+                        return result;
+                    }
+                    vcs_hook_->add(file_path, [this, file_path, staged, matches = result.matches_found](bool apply) {
+                        return commitStaged(file_path, staged, apply, matches);
+                    });
+                } else {
+                    if (config_.getOptions().backup) {
+                        createBackup(file_path);
+                    }
+                    
+                    if (!writeFile(file_path, modified_content)) {
+                        result.error_message = "Could not write to file: " + file_path.string();
+                        return result;
+                    }
+                    config_.getStats().total_files++;
+                    config_.getStats().total_matches += result.matches_found;
                 }
             }
         }
@@ -249,30 +897,70 @@ FileProcessor::ProcessResult FileProcessor::processStdin() {
     ProcessResult result;
     
     try {
-        std::string line;
-        int total_matches = 0;
+        // Input is read in large blocks and cut at line ends into one chunk per
+        // thread; chunks are matched in parallel and written in input order.
+        constexpr size_t CHUNK_SIZE = 1 << 20;
+        const size_t threads = std::max(1u, std::thread::hardware_concurrency());
+        
+        std::vector<StdinChunk> chunks(threads);
+        std::vector<std::unique_ptr<TextProcessor>> processors(threads);
+        std::string buffer(threads * CHUNK_SIZE, '\0');
+        size_t filled = 0;
+        bool eof = false;
+        bool ends_with_newline = true;
         
-        while (std::getline(std::cin, line)) {
-            int match_count = 0;
+        while (!eof) {
+            {
+                PhaseScope phase(*this, Phase::READ);
+                // Keep reading while more input is ready, so a busy pipe gives full
+                // blocks while a slow one still sees each line promptly
+                do {
+                    size_t bytes = readStdin(buffer.data() + filled, buffer.size() - filled);
+                    eof = bytes == 0;
+                    filled += bytes;
+                    config_.getStats().bytes_read += bytes;
+                } while (!eof && filled < buffer.size() && stdinReady());
+            }
             
-            if (config_.isFartMode()) {
-                std::string processed_line = text_processor_->processLine(line, match_count);
-                std::cout << processed_line << std::endl;
-            } else {
-                match_count = text_processor_->countMatches(line);
-                if (config_.getOptions().invert) {
-                    match_count = match_count ? 0 : 1;
-                }
-                
-                if (match_count > 0) {
-                    std::cout << line << std::endl;
+            size_t cut = filled;
+            if (!eof) {
+                size_t last = std::string_view(buffer.data(), filled).rfind('\n');
+                if (last == std::string_view::npos) {
+                    if (filled == buffer.size()) {
+                        buffer.resize(buffer.size() * 2);  // one line longer than the buffer
+                    }
+                    continue;
                 }
+                cut = last + 1;
+            } else if (filled > 0 && buffer[filled - 1] != '\n') {
+                ends_with_newline = false;
             }
             
-            total_matches += match_count;
+            size_t used = splitChunks(std::string_view(buffer.data(), cut), threads, chunks);
+            {
+                PhaseScope phase(*this, Phase::MATCH);
+                forEachChunk(chunks, used, processors, [this](const TextProcessor& processor, StdinChunk& chunk) {
+                    processStdinChunk(processor, chunk);
+                });
+            }
+            
+            PhaseScope phase(*this, Phase::WRITE);
+            for (size_t t = 0; t < used; t++) {
+                const auto& chunk = chunks[t];
+                const std::string_view output = chunk.unchanged ? chunk.input : chunk.output;
+                std::cout.write(output.data(), static_cast<std::streamsize>(output.size()));
+                result.matches_found += chunk.matches;
+            }
+            if (eof && !ends_with_newline && config_.isFartMode()) {
+                std::cout.put('\n');
+            }
+            std::cout.flush();
+            
+            std::memmove(buffer.data(), buffer.data() + cut, filled - cut);
+            filled -= cut;
         }
         
-        result.matches_found = total_matches;
+        config_.getStats().total_matches += result.matches_found;
         result.success = true;
         
     } catch (const std::exception& e) {
@@ -282,34 +970,410 @@ FileProcessor::ProcessResult FileProcessor::processStdin() {
     return result;
 }
 
-bool FileProcessor::isBinaryFile(const std::filesystem::path& file_path) {
-    try {
-        std::ifstream file(file_path, std::ios::binary);
-        if (!file.is_open()) {
-            return false;
+size_t FileProcessor::splitChunks(std::string_view block, size_t threads, std::vector<StdinChunk>& chunks) {
+    constexpr size_t MIN_CHUNK_SIZE = 64 << 10;
+    size_t size = block.size();
+    size_t used = std::min(threads, std::max<size_t>(1, size / MIN_CHUNK_SIZE));
+    size_t target = size / used + 1;
+    for (size_t t = 0, start = 0; t < used; t++) {
+        size_t stop = t + 1 == used ? size : block.find('\n', std::min(size - 1, start + target));
+        stop = stop == std::string_view::npos ? size : std::max(stop + 1, start);
+        chunks[t].input = block.substr(start, stop - start);
+        start = stop;
+    }
+    return used;
+}
+
+// Threads for forEachChunk, started once rather than for every block of
+// stdin or round of a large file. Thread 0 is the caller's own.
+class FileProcessor::ChunkPool {
+public:
+    explicit ChunkPool(size_t threads) {
+        for (size_t t = 1; t < threads; t++) {
+            threads_.emplace_back([this, t]() { work(t); });
+        }
+    }
+    
+    ~ChunkPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+    
+    size_t size() const { return threads_.size() + 1; }
+    
+    // Runs job(t) for t below count, on the pool and the calling thread
+    void run(size_t count, const std::function<void(size_t)>& job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job_ = &job;
+            count_ = count;
+            busy_ = count - 1;
+            round_++;
+        }
+        wake_.notify_all();
+        job(0);
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this]() { return busy_ == 0; });
+        job_ = nullptr;
+    }
+    
+private:
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const std::function<void(size_t)>* job_ = nullptr;
+    size_t count_ = 0;
+    size_t busy_ = 0;
+    uint64_t round_ = 0;
+    bool stopping_ = false;
+    
+    void work(size_t t) {
+        uint64_t seen = 0;
+        while (true) {
+            const std::function<void(size_t)>* job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [&]() { return stopping_ || round_ != seen; });
+                if (stopping_) {
+                    return;
+                }
+                seen = round_;
+                if (t >= count_) {
+                    continue;  // not needed this round
+                }
+                job = job_;
+            }
+            (*job)(t);
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--busy_ == 0) {
+                done_.notify_one();
+            }
+        }
+    }
+};
+
+void FileProcessor::forEachChunk(std::vector<StdinChunk>& chunks, size_t used,
+                                 std::vector<std::unique_ptr<TextProcessor>>& processors, const ChunkWork& work) {
+    std::atomic<size_t> next(0);
+    auto worker = [&](size_t t) {
+        if (!processors[t] && t > 0) {
+            processors[t] = std::make_unique<TextProcessor>(config_);
+        }
+        const TextProcessor& processor = t > 0 ? *processors[t] : *text_processor_;
+        for (size_t c; (c = next++) < used;) {
+            work(processor, chunks[c]);
+        }
+    };
+    if (used <= 1) {
+        worker(0);
+        return;
+    }
+    if (!chunk_pool_ || chunk_pool_->size() < used) {
+        chunk_pool_.reset();
+        chunk_pool_ = std::make_unique<ChunkPool>(std::max<size_t>(used, std::thread::hardware_concurrency()));
+    }
+    chunk_pool_->run(used, worker);
+}
+
+void FileProcessor::processStdinChunk(const TextProcessor& processor, StdinChunk& chunk) const {
+    const auto& options = config_.getOptions();
+    std::string_view input = chunk.input;
+    chunk.output.clear();
+    chunk.lines.clear();
+    chunk.matches = 0;
+    chunk.unchanged = false;
+    
+    // One search over the whole chunk finds the few lines that need any work
+    processor.findMatchingLines(input, chunk.lines);
+    
+    if (config_.isFartMode()) {
+        if (chunk.lines.empty()) {
+            chunk.unchanged = true;
+            return;
+        }
+        size_t copied = 0;
+        for (const auto& [start, end] : chunk.lines) {
+            chunk.output.append(input, copied, start - copied);
+            chunk.matches += processor.replaceLine(input.substr(start, end - start), chunk.output);
+            copied = end;
+        }
+        chunk.output.append(input, copied, std::string_view::npos);
+        return;
+    }
+    
+    if (!options.invert) {
+        for (const auto& [start, end] : chunk.lines) {
+            std::string_view line = input.substr(start, end - start);
+            chunk.matches += processor.countMatches(line);
+            chunk.output.append(line);
+            chunk.output += '\n';
+        }
+        return;
+    }
+    
+    // Inverted: every line between the matching ones
+    auto matching = chunk.lines.begin();
+    for (size_t start = 0; start < input.size();) {
+        size_t end = input.find('\n', start);
+        if (end == std::string_view::npos) {
+            end = input.size();
+        }
+        if (matching != chunk.lines.end() && matching->first == start) {
+            ++matching;
+        } else {
+            chunk.output.append(input, start, end - start);
+            chunk.output += '\n';
+            chunk.matches++;
+        }
+        start = end + 1;
+    }
+}
+
+void FileProcessor::processFileChunk(const TextProcessor& processor, StdinChunk& chunk) const {
+    const auto& options = config_.getOptions();
+    if (config_.isFartMode() || (!options.line_numbers && !options.count)) {
+        processStdinChunk(processor, chunk);
+        return;
+    }
+    
+    std::string_view input = chunk.input;
+    chunk.output.clear();
+    chunk.lines.clear();
+    chunk.matches = 0;
+    chunk.unchanged = false;
+    processor.findMatchingLines(input, chunk.lines);
+    
+    // Lines are numbered by counting newlines only up to the ones printed
+    size_t line_number = chunk.first_line;
+    size_t counted = 0;
+    auto print = [&](size_t start, size_t end) {
+        if (options.count) {
+            return;
+        }
+        if (options.line_numbers) {
+            line_number += static_cast<size_t>(std::count(input.begin() + counted, input.begin() + start, '\n'));
+            counted = start;
+            std::string number = std::to_string(line_number);
+            chunk.output += '[';
+            chunk.output.append(number.size() < 4 ? 4 - number.size() : 0, ' ');
+            chunk.output += number;
+            chunk.output += ']';
+        }
+        chunk.output.append(input, start, end - start);
+        chunk.output += '\n';
+    };
+    
+    if (!options.invert) {
+        for (const auto& [start, end] : chunk.lines) {
+            chunk.matches += processor.countMatches(input.substr(start, end - start));
+            print(start, end);
+        }
+        return;
+    }
+    
+    auto matching = chunk.lines.begin();
+    for (size_t start = 0; start < input.size();) {
+        size_t end = input.find('\n', start);
+        if (end == std::string_view::npos) {
+            end = input.size();
+        }
+        if (matching != chunk.lines.end() && matching->first == start) {
+            ++matching;
+        } else {
+            chunk.matches++;
+            print(start, end);
+        }
+        start = end + 1;
+    }
+}
+
+bool FileProcessor::processLargeFile(const std::filesystem::path& file_path, ProcessResult& result) {
+    const auto& options = config_.getOptions();
+    auto& stats = config_.getStats();
+    const bool fart = config_.isFartMode();
+    
+    MappedFile file(file_path, options.no_cache_pollution);
+    if (!file.valid()) {
+        return false;
+    }
+    std::string_view content = file.data();
+    stats.files_opened++;
+    stats.bytes_read += content.size();
+    
+    // Rounds of one range per thread, each cut at line ends; a round's output is
+    // printed, or appended to the staged file, in file order before the next
+    const size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<StdinChunk> chunks(threads);
+    std::vector<std::unique_ptr<TextProcessor>> processors(threads);
+    
+    auto staged = stagedPath(file_path);
+    std::ofstream out;  // opened at the first replacement, so unchanged files are never written
+    uint64_t written = 0;
+    bool header = !fart && !options.count && !options.quiet;
+    size_t line = 1;
+    
+    for (size_t pos = 0; pos < content.size();) {
+        size_t end = std::min(content.size(), pos + threads * LARGE_FILE_CHUNK);
+        if (end < content.size()) {
+            size_t eol = content.rfind('\n', end - 1);
+            if (eol == std::string_view::npos || eol < pos) {
+                eol = content.find('\n', end);
+            }
+            end = eol == std::string_view::npos ? content.size() : eol + 1;
         }
+        size_t used = splitChunks(content.substr(pos, end - pos), threads, chunks);
+        pos = end;
         
-        constexpr size_t SAMPLE_SIZE = 1024;
-        char buffer[SAMPLE_SIZE];
+        {
+            PhaseScope phase(*this, Phase::MATCH);
+            if (options.line_numbers && !fart) {
+                forEachChunk(chunks, used, processors, [](const TextProcessor&, StdinChunk& chunk) {
+                    chunk.first_line = static_cast<size_t>(std::count(chunk.input.begin(), chunk.input.end(), '\n'));
+                });
+                for (size_t c = 0; c < used; c++) {
+                    size_t lines = chunks[c].first_line;
+                    chunks[c].first_line = line;
+                    line += lines;
+                }
+            }
+            forEachChunk(chunks, used, processors, [this](const TextProcessor& processor, StdinChunk& chunk) {
+                processFileChunk(processor, chunk);
+            });
+        }
         
-        file.read(buffer, SAMPLE_SIZE);
-        std::streamsize bytes_read = file.gcount();
+        PhaseScope phase(*this, Phase::WRITE);
+        for (size_t c = 0; c < used; c++) {
+            const auto& chunk = chunks[c];
+            result.matches_found += chunk.matches;
+            if (!fart) {
+                if (header && !chunk.output.empty()) {
+                    std::cout << file_path.string() << " :\n";
+                    header = false;
+                }
+                std::cout << chunk.output;
+                continue;
+            }
+            if (options.preview) {
+                continue;
+            }
+            if (chunk.matches > 0 && !out.is_open()) {
+                out.open(staged, std::ios::binary);
+                if (!out.is_open()) {
+                    result.error_message = "Could not write to file: " + staged.string();
+                    return true;
+                }
+                size_t unchanged = static_cast<size_t>(chunk.input.data() - content.data());
+                out.write(content.data(), static_cast<std::streamsize>(unchanged));
+                written += unchanged;
+            }
+            if (out.is_open()) {
+                std::string_view text = chunk.unchanged ? chunk.input : std::string_view(chunk.output);
+                out.write(text.data(), static_cast<std::streamsize>(text.size()));
+                written += text.size();
+            }
+        }
+    }
+    
+    if (!fart) {
+        stats.total_matches += result.matches_found;
+        if (result.matches_found > 0) {
+            stats.total_files++;
+            if (options.count) {
+                if (options.quiet) {
+                    std::cout << file_path.string() << std::endl;
+                } else {
+                    std::cout << file_path.string() << " [" << result.matches_found << "]" << std::endl;
+                }
+            }
+        }
+        result.success = true;
+        return true;
+    }
+    
+    if (result.matches_found > 0) {
+        if (options.preview) {
+            stats.total_files++;
+            stats.total_matches += result.matches_found;
+        }
+        if (options.count && !options.quiet) {
+            std::cout << file_path.string() << " [" << result.matches_found << "]" << std::endl;
+        }
+    }
+    
+    if (out.is_open()) {
+        // Like replaceInFile, the result always ends in a newline
+        if (content.back() != '\n') {
+            out.put('\n');
+            written++;
+        }
+        out.close();
+        if (!out) {
+            std::error_code ec;
+            std::filesystem::remove(staged, ec);
+            result.error_message = "Could not write to file: " + staged.string();
+            return true;
+        }
+        stats.bytes_written += written;
         
-        size_t non_ascii_count = 0;
-        for (std::streamsize i = 0; i < bytes_read; ++i) {
-            unsigned char c = static_cast<unsigned char>(buffer[i]);
-            if (c == 0 || (c < 32 && c != 9 && c != 10 && c != 13)) {
-                non_ascii_count++;
+        if (vcs_hook_) {
+            vcs_hook_->add(file_path, [this, file_path, staged, matches = result.matches_found](bool apply) {
+                return commitStaged(file_path, staged, apply, matches);
+            });
+        } else {
+            file.close();  // the file is rewritten below, so nothing may map it any more
+            if (options.backup) {
+                createBackup(file_path);
+            }
+            if (!copyStaged(file_path, staged)) {
+                result.error_message = "Could not write to file: " + file_path.string() +
+                                       " (its replaced text is in " + staged.string() + ")";
+                return true;
             }
+            stats.total_files++;
+            stats.total_matches += result.matches_found;
+        }
+    }
+    
+    result.success = true;
+    return true;
+}
+
+bool FileProcessor::isBinaryFile(const std::filesystem::path& file_path) {
+    try {
+        std::ifstream file(file_path, std::ios::binary);
+        if (!file.is_open()) {
+            return false;
         }
         
-        return (non_ascii_count * 20 >= static_cast<size_t>(bytes_read));
+        char buffer[BINARY_SAMPLE_SIZE];
+        file.read(buffer, BINARY_SAMPLE_SIZE);
+        return looksBinary(std::string_view(buffer, static_cast<size_t>(file.gcount())));
         
     } catch (...) {
         return false;
     }
 }
 
+bool FileProcessor::looksBinary(std::string_view sample) {
+    sample = sample.substr(0, BINARY_SAMPLE_SIZE);
+    size_t non_ascii_count = 0;
+    for (char ch : sample) {
+        unsigned char c = static_cast<unsigned char>(ch);
+        if (c == 0 || (c < 32 && c != 9 && c != 10 && c != 13)) {
+            non_ascii_count++;
+        }
+    }
+    
+    return (non_ascii_count * 20 >= sample.size());
+}
+
 bool FileProcessor::shouldSkipDirectory(const std::string& dir_name, const FartConfig::Options& options) {
     if (options.cvs && dir_name == "CVS") return true;
     if (options.svn && dir_name == ".svn") return true;
@@ -332,26 +1396,44 @@ std::vector<std::string> FileProcessor::splitWildcards(const std::string& wildca
 }
 
 bool FileProcessor::matchesPattern(const std::string& filename, const std::string& pattern) {
-    if (pattern == "*") {
+    return GlobSet({pattern}).matches(filename);
+}
+
+bool FileProcessor::readSample(const std::filesystem::path& file_path, char (&buffer)[BINARY_SAMPLE_SIZE],
+                               std::string_view& sample) {
+    if (preloaded_ && preloaded_->loaded) {
+        sample = std::string_view(preloaded_->content).substr(0, BINARY_SAMPLE_SIZE);
         return true;
     }
-    
-    try {
-        std::string regex_pattern = pattern;
-        std::replace(regex_pattern.begin(), regex_pattern.end(), '*', '.');
-        regex_pattern = std::regex_replace(regex_pattern, std::regex("\\."), ".*");
-        regex_pattern = std::regex_replace(regex_pattern, std::regex("\\?"), ".");
-        
-        std::regex regex(regex_pattern);
-        return std::regex_match(filename, regex);
-    } catch (...) {
-        return filename == pattern;
+    if (preloaded_ && preloaded_->input.isOpen()) {
+        sample = std::string_view(buffer, preloaded_->input.peek(buffer, BINARY_SAMPLE_SIZE));
+        return true;
     }
+    std::ifstream file(file_path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    file.read(buffer, BINARY_SAMPLE_SIZE);
+    sample = std::string_view(buffer, static_cast<size_t>(file.gcount()));
+    return true;
 }
 
-FileProcessor::ProcessResult FileProcessor::processFileContents(const std::filesystem::path& file_path) {
+FileProcessor::ProcessResult FileProcessor::processFileContents(const std::filesystem::path& file_path,
+                                                               Decompressor::Format format) {
+    // Replacing with --line-number prints as it goes, and archives are told
+    // while streaming, so both stay serial
+    std::error_code ec;
+    if (format == Decompressor::Format::NONE && !config_.getOptions().search_archives && !(preloaded_ && preloaded_->loaded) &&
+        std::thread::hardware_concurrency() > 1 && !(config_.isFartMode() && config_.getOptions().line_numbers) &&
+        std::filesystem::file_size(file_path, ec) >= LARGE_FILE_SIZE && !ec) {
+        ProcessResult result;
+        if (processLargeFile(file_path, result)) {
+            return result;
+        }
+    }
+    
     if (config_.isGrepMode()) {
-        return findInFile(file_path);
+        return findInFile(file_path, format);
     } else {
         return replaceInFile(file_path);
     }
@@ -367,17 +1449,11 @@ FileProcessor::ProcessResult FileProcessor::processFileName(const std::filesyste
     if (match_count > 0) {
         result.matches_found = match_count;
         config_.getStats().total_files++;
+        config_.getStats().total_matches += match_count;
         
-        if (config_.isFartMode() && !config_.getOptions().preview) {
-            auto new_path = file_path.parent_path() / new_filename;
-            
-            try {
-                std::filesystem::rename(file_path, new_path);
-                std::cout << file_path.string() << " => " << new_filename << std::endl;
-            } catch (const std::exception& e) {
-                result.error_message = "Could not rename " + file_path.string() + " to " + new_filename + ": " + e.what();
-                return result;
-            }
+        if (config_.isFartMode()) {
+            // Renamed after the walk, so the new name is not visited again
+            rename_plan_.add(file_path, new_filename);
         } else {
             std::cout << file_path.string() << std::endl;
         }
@@ -387,6 +1463,34 @@ FileProcessor::ProcessResult FileProcessor::processFileName(const std::filesyste
     return result;
 }
 
+FileProcessor::ProcessResult FileProcessor::executeRenames() {
+    ProcessResult result;
+    result.success = true;
+    bool preview = config_.getOptions().preview;
+    
+    std::vector<RenamePlan::Outcome> outcomes;
+    {
+        PhaseScope phase(*this, Phase::RENAME);
+        outcomes = rename_plan_.execute(preview);
+    }
+    
+    for (const auto& outcome : outcomes) {
+        if (!outcome.error.empty()) {
+            result.success = false;
+            result.error_message += "Could not rename " + outcome.from.string() + " to " + outcome.to + ": " +
+                                    outcome.error + "\n";
+        } else if (preview) {
+            std::cout << outcome.from.string() << std::endl;
+        } else {
+            std::cout << outcome.from.string() << " => " << outcome.to << std::endl;
+        }
+    }
+    if (!result.success) {
+        result.error_message.pop_back();
+    }
+    return result;
+}
+
 bool FileProcessor::createBackup(const std::filesystem::path& file_path) {
     try {
         auto backup_path = file_path.string() + FartConfig::BACKUP_SUFFIX;
@@ -397,6 +1501,54 @@ bool FileProcessor::createBackup(const std::filesystem::path& file_path) {
     }
 }
 
+std::filesystem::path FileProcessor::stagedPath(const std::filesystem::path& file_path) {
+    std::error_code ec;
+    auto target = std::filesystem::is_symlink(file_path, ec) ? std::filesystem::canonical(file_path, ec) : file_path;
+    if (ec) {
+        target = file_path;
+    }
+    target += FartConfig::STAGED_SUFFIX;
+    return target;
+}
+
+bool FileProcessor::commitStaged(const std::filesystem::path& file_path, const std::filesystem::path& staged,
+                                 bool apply, int matches) {
+    PhaseScope phase(*this, Phase::WRITE);
+    std::error_code ec;
+    if (!apply) {
+        std::filesystem::remove(staged, ec);
+        return true;
+    }
+    
+    if (config_.getOptions().backup) {
+        createBackup(file_path);
+    }
+    // Written into the file a symbolic link leads to, so the link, the file's hard
+    // links and its owner stay; a copy that could not be written back is kept
+    const auto& name = staged.native();
+    std::filesystem::path target = name.substr(0, name.size() - std::strlen(FartConfig::STAGED_SUFFIX));
+    if (!copyStaged(target, staged)) {
+        return false;
+    }
+    config_.getStats().total_files++;
+    config_.getStats().total_matches += matches;
+    return true;
+}
+
+bool FileProcessor::copyStaged(const std::filesystem::path& file_path, const std::filesystem::path& staged) {
+    PhaseScope phase(*this, Phase::WRITE);
+    {
+        std::ifstream in(staged, std::ios::binary);
+        std::ofstream out(file_path, std::ios::binary);
+        if (!in.is_open() || !out.is_open() || !(out << in.rdbuf()) || !out.flush()) {
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::remove(staged, ec);
+    return true;
+}
+
 void FileProcessor::updateProgress(const std::string& message) {
     if (progress_callback_) {
         progress_callback_(message);
@@ -404,17 +1556,41 @@ void FileProcessor::updateProgress(const std::string& message) {
 }
 
 std::string FileProcessor::readFile(const std::filesystem::path& file_path) {
-    std::ifstream file(file_path);
-    if (!file.is_open()) {
+    FART_TRACE_SCOPE("readFile");
+    PhaseScope phase(*this, Phase::READ);
+    if (preloaded_ && preloaded_->path == file_path && preloaded_->loaded) {
+        config_.getStats().files_opened++;
+        config_.getStats().bytes_read += preloaded_->content.size();
+        return std::move(preloaded_->content);
+    }
+    InputFile file;
+    if (!openInput(file_path, file)) {
         throw std::runtime_error("Could not open file: " + file_path.string());
     }
+    config_.getStats().files_opened++;
+    
+    // Size the buffer once up front; keep reading in case the file grew meanwhile
+    std::error_code ec;
+    auto expected = std::filesystem::file_size(file_path, ec);
+    std::string content(ec ? 0 : static_cast<size_t>(expected), '\0');
+    size_t filled = 0;
+    size_t bytes;
+    while (filled < content.size() && (bytes = file.read(content.data() + filled, content.size() - filled)) > 0) {
+        filled += bytes;
+    }
+    content.resize(filled);
     
-    std::ostringstream oss;
-    oss << file.rdbuf();
-    return oss.str();
+    char chunk[4096];
+    while ((bytes = file.read(chunk, sizeof(chunk))) > 0) {
+        content.append(chunk, bytes);
+    }
+    
+    config_.getStats().bytes_read += content.size();
+    return content;
 }
 
 bool FileProcessor::writeFile(const std::filesystem::path& file_path, const std::string& content) {
+    FART_TRACE_SCOPE("writeFile");
     try {
         std::ofstream file(file_path);
         if (!file.is_open()) {
@@ -422,6 +1598,9 @@ bool FileProcessor::writeFile(const std::filesystem::path& file_path, const std:
         }
         
         file << content;
+        if (file.good()) {
+            config_.getStats().bytes_written += content.size();
+        }
         return file.good();
     } catch (...) {
         return false;
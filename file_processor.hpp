@@ -2,14 +2,25 @@
 
 #include <string>
 #include <vector>
+#include <chrono>
 #include <functional>
 #include <filesystem>
 #include "fart_config.hpp"
+#include "decompressor.hpp"
 #include "text_processor.hpp"
+#include "file_filter.hpp"
+#include "file_identity.hpp"
+#include "file_reader.hpp"
+#include "glob_set.hpp"
+#include "ignore_rules.hpp"
+#include "rename_plan.hpp"
+#include "result_log.hpp"
+#include "vcs_hook.hpp"
 
 class FileProcessor {
 public:
     explicit FileProcessor(FartConfig& config);
+    ~FileProcessor();
     
     struct ProcessResult {
         bool success = false;
@@ -18,18 +29,50 @@ public:
     };
     
     using ProgressCallback = std::function<void(const std::string&)>;
+    using FileSink = std::function<void(const std::filesystem::path&)>;
+    using DirectoryCallback = std::function<void(const std::filesystem::path&, const GlobSet&)>;
+    using ResultCallback = std::function<void(const std::filesystem::path&, int matches)>;
     
     void setProgressCallback(ProgressCallback callback) { progress_callback_ = callback; }
     
+    // Hands every file the walk selects to sink instead of processing it (--serve-work)
+    void setFileSink(FileSink sink) { file_sink_ = std::move(sink); }
+    
+    // Called with every directory the walk enters and the patterns it matches there (--watch)
+    void setDirectoryCallback(DirectoryCallback callback) { directory_callback_ = std::move(callback); }
+    
+    // Called with the matches of every file processed, none included (--watch)
+    void setResultCallback(ResultCallback callback) { result_callback_ = std::move(callback); }
+    
     ProcessResult processWildcards(const std::string& wildcards);
     
+    // Forgets the files and folders walked so far, as every run does when it
+    // starts; for walks made outside a run (--watch)
+    void forgetVisits();
+    
+    // Processes the given files in order, then finishes the run as processWildcards does
+    ProcessResult processFileList(const std::vector<std::filesystem::path>& files);
+    
+    // Same for the files named in list_file (--files-from; "-" is stdin), each
+    // opened as soon as its name has been read
+    ProcessResult processListedFiles(const std::string& list_file);
+    
     ProcessResult processFile(const std::filesystem::path& file_path);
     
     ProcessResult processDirectory(const std::filesystem::path& dir_path, 
                                    const std::string& pattern, 
                                    bool recursive = false);
     
-    ProcessResult findInFile(const std::filesystem::path& file_path);
+    // One pass over the directory serves every pattern in the set. Its files may
+    // only be processed later in the walk, or when the run finishes.
+    ProcessResult processDirectory(const std::filesystem::path& dir_path,
+                                   const GlobSet& patterns,
+                                   bool recursive = false);
+    
+    // format: how the file is compressed, if it is (grep mode searches the text).
+    // With --search-archives a tar file's members are searched instead.
+    ProcessResult findInFile(const std::filesystem::path& file_path,
+                             Decompressor::Format format = Decompressor::Format::NONE);
     
     ProcessResult replaceInFile(const std::filesystem::path& file_path);
     
@@ -42,16 +85,133 @@ public:
     static std::vector<std::string> splitWildcards(const std::string& wildcards);
     
     static bool matchesPattern(const std::string& filename, const std::string& pattern);
+    
+    // Shard (0-based) of shard_count a path belongs to; the same on every machine
+    static unsigned shardOf(const std::filesystem::path& path, unsigned shard_count);
 
 private:
+    using Phase = FartConfig::Statistics::Phase;
+    
+    // Attributes wall time to a phase for --stats; restores the enclosing phase on exit
+    class PhaseScope {
+    public:
+        PhaseScope(FileProcessor& processor, Phase phase);
+        ~PhaseScope();
+        PhaseScope(const PhaseScope&) = delete;
+        PhaseScope& operator=(const PhaseScope&) = delete;
+    private:
+        FileProcessor& processor_;
+        Phase previous_;
+        bool active_;
+    };
+    
     FartConfig& config_;
     std::unique_ptr<TextProcessor> text_processor_;
     ProgressCallback progress_callback_;
+    FileFilter file_filter_;
+    GlobSet archive_members_;  // --search-archives
+    FileSink file_sink_;
+    DirectoryCallback directory_callback_;
+    ResultCallback result_callback_;
+    Phase current_phase_ = Phase::NONE;
+    std::chrono::steady_clock::time_point phase_started_;
+    RenamePlan rename_plan_;
+    IgnoreRules ignore_rules_;
+    FileIdSet seen_files_;
+    FileIdSet seen_dirs_;             // --follow: folders the current walk went through
+    std::vector<FileId> dir_stack_;   // --follow: the directories being walked, to tell a loop
+    std::unique_ptr<ResultLog> result_log_;
+    std::unique_ptr<FileReader> reader_;     // --io-uring
+    std::vector<FileReader::File> pending_;  // files queued by the walk, read or opened ahead
+    FileReader::File* preloaded_ = nullptr;  // the queued file being processed
+    class ChunkPool;
+    std::unique_ptr<ChunkPool> chunk_pool_;  // threads of forEachChunk, started at its first use
+    std::unique_ptr<VcsHook> vcs_hook_;  // last: its destructor commits through this object
+    
+    void switchPhase(Phase phase);
+    
+    // Opens the --emit-results log; false (with the error in total_result) if it cannot
+    bool beginRun(ProcessResult& total_result);
+    
+    // Runs the planned renames and VCS commands and closes the result log
+    void finishRun(ProcessResult& total_result);
+    
+    // False for a file the walk has processed before through another hard or symbolic link
+    bool firstVisit(const std::filesystem::path& path);
+    
+    // --shard: false for files another shard processes
+    bool inShard(const std::filesystem::path& path);
+    
+    void recordResult(const std::filesystem::path& path, const ProcessResult& result);
+    
+    // Files the walk selects are queued and processed in order: with --io-uring
+    // QUEUE_DEPTH are read at once, otherwise LOOKAHEAD_FILES are kept open and
+    // prefetched ahead of the one being matched
+    static constexpr size_t LOOKAHEAD_FILES = 16;
+    void queueFile(const std::filesystem::path& file_path, ProcessResult& total_result);
+    void flushFiles(ProcessResult& total_result);
+    void processQueued(FileReader::File& file, ProcessResult& total_result);
+    
+    // Opens file_path for reading, or takes the queued file's open handle
+    bool openInput(const std::filesystem::path& file_path, InputFile& file);
+    
+    // A newline-aligned piece of stdin or of a large file and what it turns into
+    struct StdinChunk {
+        std::string_view input;
+        std::string output;
+        std::vector<std::pair<size_t, size_t>> lines;
+        bool unchanged = false;  // output is the input itself
+        int matches = 0;
+        size_t first_line = 1;   // files with --line-number: number of the chunk's first line
+    };
+    
+    using ChunkWork = std::function<void(const TextProcessor&, StdinChunk&)>;
+    
+    // Files at least this large are searched by all cores at once (processLargeFile)
+    static constexpr uint64_t LARGE_FILE_SIZE = 64 << 20;
+    static constexpr size_t LARGE_FILE_CHUNK = 8 << 20;  // per thread and round
     
-    ProcessResult processFileContents(const std::filesystem::path& file_path);
+    // Cuts block at line ends into up to threads chunks; returns how many
+    static size_t splitChunks(std::string_view block, size_t threads, std::vector<StdinChunk>& chunks);
+    
+    // Runs work on the first used chunks on as many threads, each with its own
+    // TextProcessor; the threads are kept for the next call
+    void forEachChunk(std::vector<StdinChunk>& chunks, size_t used,
+                      std::vector<std::unique_ptr<TextProcessor>>& processors, const ChunkWork& work);
+    
+    void processStdinChunk(const TextProcessor& processor, StdinChunk& chunk) const;
+    
+    // Like processStdinChunk, plus what files print: --count and --line-number
+    void processFileChunk(const TextProcessor& processor, StdinChunk& chunk) const;
+    
+    // Searches (or replaces in) a large file from a shared mapping, one range per
+    // core; false, with nothing done, if the file cannot be mapped
+    bool processLargeFile(const std::filesystem::path& file_path, ProcessResult& result);
+    
+    using ReadFunction = std::function<size_t(char* buffer, size_t size)>;
+    
+    // Greps the text read, printed as name; with check_binary, binary text is skipped
+    ProcessResult searchText(const std::string& name, const ReadFunction& read, bool check_binary);
+    
+    // Greps the members of a tar archive, printed as "archive:member"
+    ProcessResult searchArchive(const std::filesystem::path& archive_path, const ReadFunction& read);
+    
+    // Whether the first BINARY_SAMPLE_SIZE bytes of a file make it binary
+    static constexpr size_t BINARY_SAMPLE_SIZE = 1024;
+    static bool looksBinary(std::string_view sample);
+    
+    // The first bytes of file_path, for the binary check and to tell compression;
+    // false if it cannot be read
+    bool readSample(const std::filesystem::path& file_path, char (&buffer)[BINARY_SAMPLE_SIZE],
+                    std::string_view& sample);
+    
+    ProcessResult processFileContents(const std::filesystem::path& file_path, Decompressor::Format format);
     
     ProcessResult processFileName(const std::filesystem::path& file_path);
     
+    // Carries out the renames planned by processFileName during the walk
+    ProcessResult executeRenames();
+    
     bool createBackup(const std::filesystem::path& file_path);
     
     void updateProgress(const std::string& message);
@@ -59,4 +219,17 @@ private:
     std::string readFile(const std::filesystem::path& file_path);
     
     bool writeFile(const std::filesystem::path& file_path, const std::string& content);
+    
+    // Where the replacement of file_path is staged: next to the file a symbolic
+    // link leads to, so replacing the file keeps the link
+    static std::filesystem::path stagedPath(const std::filesystem::path& file_path);
+    
+    // Writes the staged copy into file_path itself, as writeFile does, so the
+    // file keeps its hard links, owner and attributes; removes the copy
+    bool copyStaged(const std::filesystem::path& file_path, const std::filesystem::path& staged);
+    
+    // Writes the staged copy into file_path once the VCS command has run; its
+    // matches count towards the totals only once it is replaced
+    bool commitStaged(const std::filesystem::path& file_path, const std::filesystem::path& staged, bool apply,
+                      int matches);
 };
\ No newline at end of file
@@ -0,0 +1,336 @@
+#include "file_reader.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define FART_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+InputFile::InputFile(InputFile&& other) noexcept
+    : fd_(std::exchange(other.fd_, -1)), drop_cache_(other.drop_cache_) {
+}
+
+InputFile& InputFile::operator=(InputFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        fd_ = std::exchange(other.fd_, -1);
+        drop_cache_ = other.drop_cache_;
+    }
+    return *this;
+}
+
+bool InputFile::open(const std::filesystem::path& path, bool drop_cache) {
+    close();
+    drop_cache_ = drop_cache;
+#ifdef _WIN32
+    fd_ = _wopen(path.c_str(), _O_RDONLY | _O_TEXT);
+#else
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+#if defined(POSIX_FADV_SEQUENTIAL)
+    if (fd_ != -1) {
+        posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
+#endif
+    return fd_ != -1;
+}
+
+void InputFile::close() {
+    if (fd_ == -1) {
+        return;
+    }
+#ifdef _WIN32
+    _close(fd_);
+#else
+#if defined(POSIX_FADV_DONTNEED)
+    if (drop_cache_) {
+        posix_fadvise(fd_, 0, 0, POSIX_FADV_DONTNEED);
+    }
+#endif
+    ::close(fd_);
+#endif
+    fd_ = -1;
+}
+
+void InputFile::prefetch() {
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+    if (fd_ != -1) {
+        posix_fadvise(fd_, 0, PREFETCH_SIZE, POSIX_FADV_WILLNEED);
+    }
+#endif
+}
+
+size_t InputFile::read(char* buffer, size_t size) {
+#ifdef _WIN32
+    int bytes = _read(fd_, buffer, static_cast<unsigned>(std::min<size_t>(size, INT_MAX)));
+#else
+    ssize_t bytes;
+    while ((bytes = ::read(fd_, buffer, size)) == -1 && errno == EINTR) {
+    }
+#endif
+    if (bytes < 0) {
+        throw std::runtime_error(std::strerror(errno));
+    }
+    return static_cast<size_t>(bytes);
+}
+
+size_t InputFile::peek(char* buffer, size_t size) {
+#ifdef _WIN32
+    _lseek(fd_, 0, SEEK_SET);
+    size_t bytes = read(buffer, size);
+    _lseek(fd_, 0, SEEK_SET);
+    return bytes;
+#else
+    ssize_t bytes;
+    while ((bytes = pread(fd_, buffer, size, 0)) == -1 && errno == EINTR) {
+    }
+    return bytes < 0 ? 0 : static_cast<size_t>(bytes);
+#endif
+}
+
+#ifndef FART_IO_URING
+
+FileReader::~FileReader() {
+}
+
+bool FileReader::open(std::string& error) {
+    error = "io_uring is not supported on this platform";
+    return false;
+}
+
+void FileReader::read(std::vector<File>&) {
+}
+
+#else
+
+namespace {
+
+int setup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int enter(int fd, unsigned to_submit, unsigned min_complete) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, IORING_ENTER_GETEVENTS,
+                                    nullptr, 0));
+}
+
+// The ring's operations exist since Linux 5.6; older kernels take the ring but not them
+bool supported(int fd) {
+    constexpr unsigned OPS = 64;
+    std::vector<char> buffer(sizeof(io_uring_probe) + OPS * sizeof(io_uring_probe_op));
+    auto* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, OPS) != 0) {
+        return false;
+    }
+    for (unsigned op : {IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_FADVISE, IORING_OP_CLOSE}) {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+FileReader::~FileReader() {
+    if (sqes_) {
+        munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ && cq_ring_ != sq_ring_) {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_) {
+        munmap(sq_ring_, sq_ring_size_);
+    }
+    if (fd_ != -1) {
+        close(fd_);
+    }
+}
+
+bool FileReader::open(std::string& error) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    fd_ = setup(QUEUE_DEPTH, &params);
+    if (fd_ == -1) {
+        error = std::string("Could not set up io_uring: ") + std::strerror(errno);
+        return false;
+    }
+    if (!supported(fd_)) {
+        error = "io_uring cannot open and read files on this kernel";
+        return false;
+    }
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    void* ring = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                      IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED) {
+        error = std::string("Could not map io_uring: ") + std::strerror(errno);
+        return false;
+    }
+    sq_ring_ = ring;
+    if (single) {
+        cq_ring_ = sq_ring_;
+    } else {
+        ring = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                    IORING_OFF_CQ_RING);
+        if (ring == MAP_FAILED) {
+            error = std::string("Could not map io_uring: ") + std::strerror(errno);
+            return false;
+        }
+        cq_ring_ = ring;
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    ring = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (ring == MAP_FAILED) {
+        error = std::string("Could not map io_uring: ") + std::strerror(errno);
+        return false;
+    }
+    sqes_ = ring;
+
+    auto* sq = static_cast<char*>(sq_ring_);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    auto* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = cq + params.cq_off.cqes;
+    return true;
+}
+
+template <typename Prepare>
+bool FileReader::submit(const std::vector<size_t>& ops, Prepare prepare) {
+    auto* sqes = static_cast<io_uring_sqe*>(sqes_);
+    unsigned tail = *sq_tail_;
+    for (size_t op : ops) {
+        unsigned index = tail++ & *sq_mask_;
+        io_uring_sqe* sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        prepare(sqe, op);
+        sqe->user_data = op;
+        sq_array_[index] = index;
+    }
+    __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+
+    auto* cqes = static_cast<io_uring_cqe*>(cqes_);
+    unsigned to_submit = static_cast<unsigned>(ops.size());
+    size_t completed = 0;
+    while (completed < ops.size()) {
+        int submitted = enter(fd_, to_submit, 1);
+        if (submitted == -1) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            return false;
+        }
+        to_submit -= std::min(to_submit, static_cast<unsigned>(submitted));
+
+        unsigned head = *cq_head_;
+        unsigned cq_tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for (; head != cq_tail; head++, completed++) {
+            const io_uring_cqe& cqe = cqes[head & *cq_mask_];
+            results_[cqe.user_data] = cqe.res;
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+    return true;
+}
+
+void FileReader::read(std::vector<File>& files) {
+    for (size_t begin = 0; begin < files.size() && fd_ != -1; begin += QUEUE_DEPTH) {
+        size_t end = std::min(files.size(), begin + QUEUE_DEPTH);
+        std::vector<size_t> ops;
+        for (size_t i = begin; i < end; i++) {
+            files[i].loaded = false;
+            ops.push_back(i - begin);
+        }
+        results_.assign(ops.size(), -1);
+
+        bool ok = submit(ops, [&](io_uring_sqe* sqe, size_t op) {
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = reinterpret_cast<uint64_t>(files[begin + op].path.c_str());
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        });
+        std::vector<int> fds(results_);
+        ops.erase(std::remove_if(ops.begin(), ops.end(), [&](size_t op) { return fds[op] < 0; }), ops.end());
+
+        // A read may return less than is left (FUSE, network file systems, signals),
+        // so files are read until one returns 0. A full buffer may not be the whole
+        // file; the caller reads those, and those that fail, again.
+        std::vector<size_t> sizes(ops.size(), 0);
+        std::vector<size_t> reading(ops);
+        for (size_t op : reading) {
+            files[begin + op].content.resize(MAX_FILE_SIZE);
+        }
+        while (ok && !reading.empty()) {
+            ok = submit(reading, [&](io_uring_sqe* sqe, size_t op) {
+                sqe->opcode = IORING_OP_READ;
+                sqe->fd = fds[op];
+                sqe->off = sizes[op];
+                sqe->addr = reinterpret_cast<uint64_t>(files[begin + op].content.data() + sizes[op]);
+                sqe->len = static_cast<unsigned>(MAX_FILE_SIZE - sizes[op]);
+            });
+            std::vector<size_t> more;
+            for (size_t op : reading) {
+                File& file = files[begin + op];
+                int result = results_[op];
+                if (ok && result > 0) {
+                    sizes[op] += static_cast<size_t>(result);
+                    if (sizes[op] < MAX_FILE_SIZE) {
+                        more.push_back(op);
+                        continue;
+                    }
+                }
+                file.loaded = ok && result == 0;
+                file.content.resize(file.loaded ? sizes[op] : 0);
+            }
+            reading.swap(more);
+        }
+        for (size_t op : reading) {
+            files[begin + op].content.clear();
+        }
+
+        if (ok && drop_cache_) {
+            ok = submit(ops, [&](io_uring_sqe* sqe, size_t op) {
+                sqe->opcode = IORING_OP_FADVISE;
+                sqe->fd = fds[op];
+                sqe->fadvise_advice = POSIX_FADV_DONTNEED;
+            });
+        }
+
+        if (!ok || !submit(ops, [&](io_uring_sqe* sqe, size_t op) {
+                sqe->opcode = IORING_OP_CLOSE;
+                sqe->fd = fds[op];
+            })) {
+            // The ring is broken: close what it opened and read the plain way from now on
+            for (size_t op : ops) {
+                close(fds[op]);
+            }
+            close(fd_);
+            fd_ = -1;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// A file opened for one sequential read, with page cache hints: the kernel is
+// told the reads are sequential, prefetch() starts reading the file ahead of
+// them, and with drop_cache its pages leave the page cache again on close, so
+// a sweep over a large tree does not evict everything else (--no-cache-pollution).
+// Reads are in text mode where the platform has one, like std::ifstream's.
+class InputFile {
+public:
+    // How much of a file prefetch() reads ahead
+    static constexpr size_t PREFETCH_SIZE = 1 << 20;
+
+    InputFile() = default;
+    ~InputFile() { close(); }
+
+    InputFile(InputFile&& other) noexcept;
+    InputFile& operator=(InputFile&& other) noexcept;
+    InputFile(const InputFile&) = delete;
+    InputFile& operator=(const InputFile&) = delete;
+
+    bool open(const std::filesystem::path& path, bool drop_cache);
+    bool isOpen() const { return fd_ != -1; }
+    void close();
+
+    void prefetch();
+
+    // Up to size bytes; 0 at the end of the file. Throws std::runtime_error on errors.
+    size_t read(char* buffer, size_t size);
+
+    // Reads from the start without moving the read position
+    size_t peek(char* buffer, size_t size);
+
+private:
+    int fd_ = -1;
+    bool drop_cache_ = false;
+};
+
+// Reads small files many at a time through io_uring (--io-uring): the opens,
+// reads and closes of a batch are each submitted at once, so hundreds of
+// requests are in flight instead of one syscall per step per file. Files that
+// do not fit MAX_FILE_SIZE, or fail, are left for the caller to read itself,
+// as are all files where io_uring is unavailable (open fails).
+class FileReader {
+public:
+    static constexpr unsigned QUEUE_DEPTH = 256;
+    static constexpr size_t MAX_FILE_SIZE = 64 << 10;
+
+    struct File {
+        std::filesystem::path path;
+        std::string content;
+        bool loaded = false;
+        InputFile input;  // or opened ahead of its turn, without io_uring
+    };
+
+    explicit FileReader(bool drop_cache = false) : drop_cache_(drop_cache) {}
+    ~FileReader();
+
+    FileReader(const FileReader&) = delete;
+    FileReader& operator=(const FileReader&) = delete;
+
+    bool open(std::string& error);
+
+    // Reads files, QUEUE_DEPTH at a time
+    void read(std::vector<File>& files);
+
+private:
+    bool drop_cache_;
+    int fd_ = -1;
+    void* sq_ring_ = nullptr;
+    void* cq_ring_ = nullptr;
+    void* sqes_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    size_t cq_ring_size_ = 0;
+    size_t sqes_size_ = 0;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_mask_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    void* cqes_ = nullptr;
+    std::vector<int> results_;
+
+    // Submits one operation per index in ops (prepared by prepare) and waits
+    // for all of them; their results land in results_. False if the ring failed.
+    template <typename Prepare>
+    bool submit(const std::vector<size_t>& ops, Prepare prepare);
+};
@@ -0,0 +1,278 @@
+#include "file_watcher.hpp"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <unordered_set>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+bool endsWith(const std::string& text, const char* suffix) {
+    size_t length = std::strlen(suffix);
+    return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+}
+
+}  // namespace
+
+FileWatcher::FileWatcher(FartConfig& config, FileProcessor& processor)
+    : config_(config), processor_(processor) {
+    processor_.setDirectoryCallback([this](const std::filesystem::path& dir, const GlobSet& patterns) {
+        addDirectory(dir, patterns);
+    });
+    processor_.setResultCallback([this](const std::filesystem::path& file, int matches) {
+        setMatches(file.string(), matches);
+    });
+}
+
+FileWatcher::~FileWatcher() {
+    processor_.setDirectoryCallback(nullptr);
+    processor_.setResultCallback(nullptr);
+#ifdef __linux__
+    if (fd_ != -1) {
+        close(fd_);
+    }
+#endif
+}
+
+void FileWatcher::setMatches(const std::string& file, int matches) {
+    auto it = file_matches_.find(file);
+    int previous = it == file_matches_.end() ? 0 : it->second;
+    int updated = replacing() ? previous + matches : matches;
+
+    files_ += (updated > 0) - (previous > 0);
+    matches_ += updated - previous;
+    if (updated > 0) {
+        file_matches_[file] = updated;
+    } else if (it != file_matches_.end()) {
+        file_matches_.erase(it);
+    }
+
+    if (replacing() && matches > 0) {
+        written_.push_back(file);
+    }
+}
+
+void FileWatcher::noteWrites() {
+    for (const auto& file : written_) {
+        std::error_code ec;
+        auto time = std::filesystem::last_write_time(file, ec);
+        if (!ec) {
+            own_writes_[file] = time;
+        }
+    }
+    written_.clear();
+}
+
+bool FileWatcher::isOwnWrite(const std::string& file) {
+    auto it = own_writes_.find(file);
+    if (it == own_writes_.end()) {
+        return false;
+    }
+    std::error_code ec;
+    bool own = std::filesystem::last_write_time(file, ec) == it->second && !ec;
+    own_writes_.erase(it);
+    return own;
+}
+
+#ifndef __linux__
+
+bool FileWatcher::open(std::string& error) {
+    error = "--watch is not supported on this platform";
+    return false;
+}
+
+bool FileWatcher::run(const Report&, std::string& error) {
+    error = "--watch is not supported on this platform";
+    return false;
+}
+
+void FileWatcher::addDirectory(const std::filesystem::path&, const GlobSet&) {
+}
+
+#else
+
+namespace {
+
+constexpr uint32_t WATCH_EVENTS = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE |
+                                  IN_ONLYDIR | IN_EXCL_UNLINK;
+
+}  // namespace
+
+bool FileWatcher::open(std::string& error) {
+    fd_ = inotify_init1(IN_CLOEXEC);
+    if (fd_ == -1) {
+        error = std::string("Could not watch files: ") + std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+void FileWatcher::addDirectory(const std::filesystem::path& dir, const GlobSet& patterns) {
+    if (fd_ == -1) {
+        return;
+    }
+
+    // Walks hand their patterns by reference, so sets are told apart by their sources
+    auto sources = patterns.sources();
+    auto it = pattern_index_.find(sources);
+    size_t index;
+    if (it == pattern_index_.end()) {
+        index = pattern_sets_.size();
+        pattern_sets_.push_back(patterns);
+        pattern_index_.emplace(std::move(sources), index);
+    } else {
+        index = it->second;
+    }
+
+    int wd = inotify_add_watch(fd_, dir.c_str(), WATCH_EVENTS);
+    if (wd == -1) {
+        if (!watch_failed_) {
+            std::cerr << "Warning: could not watch " << dir.string() << ": " << std::strerror(errno)
+                      << (errno == ENOSPC ? " (see fs.inotify.max_user_watches)" : "") << std::endl;
+            watch_failed_ = true;
+        }
+        return;
+    }
+    watches_[wd] = {dir, index};
+}
+
+bool FileWatcher::run(const Report& report, std::string& error) {
+    noteWrites();
+    const auto& options = config_.getOptions();
+    alignas(inotify_event) char buffer[64 * 1024];
+
+    while (true) {
+        std::vector<std::string> changed;
+        std::vector<std::string> removed;
+        std::vector<std::pair<std::filesystem::path, size_t>> new_dirs;
+        std::unordered_set<std::string> seen;
+        bool overflow = false;
+
+        // Block for the first event, then collect until they stop coming
+        int timeout = -1;
+        while (true) {
+            pollfd fd = {fd_, POLLIN, 0};
+            int ready = poll(&fd, 1, timeout);
+            if (ready == -1 && errno == EINTR) {
+                continue;
+            }
+            if (ready == -1) {
+                error = std::string("Could not watch files: ") + std::strerror(errno);
+                return false;
+            }
+            if (ready == 0) {
+                break;
+            }
+            timeout = SETTLE_MS;
+
+            ssize_t bytes = read(fd_, buffer, sizeof(buffer));
+            if (bytes == -1 && errno == EINTR) {
+                continue;
+            }
+            if (bytes <= 0) {
+                error = std::string("Could not watch files: ") + std::strerror(errno);
+                return false;
+            }
+
+            for (char* p = buffer; p < buffer + bytes;) {
+                auto* event = reinterpret_cast<inotify_event*>(p);
+                p += sizeof(inotify_event) + event->len;
+
+                if (event->mask & IN_Q_OVERFLOW) {
+                    overflow = true;
+                    continue;
+                }
+                if (event->mask & IN_IGNORED) {
+                    watches_.erase(event->wd);
+                    continue;
+                }
+                auto watch = watches_.find(event->wd);
+                if (watch == watches_.end() || !event->len) {
+                    continue;
+                }
+                std::string name = event->name;
+                auto path = watch->second.dir / name;
+
+                if (event->mask & IN_ISDIR) {
+                    if ((event->mask & (IN_CREATE | IN_MOVED_TO)) && options.recursive &&
+                        !FileProcessor::shouldSkipDirectory(name, options)) {
+                        new_dirs.emplace_back(path, watch->second.patterns);
+                    }
+                } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    removed.push_back(path.string());
+                } else if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) &&
+                           pattern_sets_[watch->second.patterns].matches(name) &&
+                           !endsWith(name, FartConfig::BACKUP_SUFFIX) && !endsWith(name, FartConfig::STAGED_SUFFIX) &&
+                           seen.insert(path.string()).second) {
+                    changed.push_back(path.string());
+                }
+            }
+        }
+
+        if (overflow) {
+            // Events were lost, so nothing short of a full run is exact. Found
+            // counts start over, so files deleted meanwhile no longer count;
+            // replaced counts add up across rounds and are kept.
+            if (!replacing()) {
+                file_matches_.clear();
+                files_ = 0;
+                matches_ = 0;
+            }
+            auto result = processor_.processWildcards(config_.getWildcard());
+            if (!result.success) {
+                std::cerr << "Error: " << result.error_message << std::flush;
+            }
+            noteWrites();
+            report(files_, matches_);
+            continue;
+        }
+
+        bool updated = false;
+        if (!replacing()) {
+            for (const auto& file : removed) {
+                if (!seen.count(file) && file_matches_.count(file)) {
+                    setMatches(file, 0);
+                    updated = true;
+                }
+            }
+        }
+
+        // Only files in the new folders are skipped as seen, not those of earlier runs
+        if (!new_dirs.empty()) {
+            processor_.forgetVisits();
+        }
+        for (const auto& [dir, patterns] : new_dirs) {
+            auto result = processor_.processDirectory(dir, pattern_sets_[patterns], true);
+            if (!result.success) {
+                std::cerr << "Error: " << result.error_message << std::flush;
+            }
+            updated = true;
+        }
+
+        std::vector<std::filesystem::path> files;
+        for (const auto& file : changed) {
+            std::error_code ec;
+            if (std::filesystem::is_regular_file(file, ec) && !isOwnWrite(file)) {
+                files.emplace_back(file);
+            }
+        }
+        if (files.empty() && !updated) {
+            continue;
+        }
+
+        // Also finishes the new directories' run (VCS commands)
+        auto result = processor_.processFileList(files);
+        if (!result.success) {
+            std::cerr << "Error: " << result.error_message << std::flush;
+        }
+        noteWrites();
+        report(files_, matches_);
+    }
+}
+
+#endif
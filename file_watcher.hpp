@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "fart_config.hpp"
+#include "file_processor.hpp"
+#include "glob_set.hpp"
+
+// --watch: after the first run, watches the directories it walked (inotify)
+// and runs again over just the files created or changed since, so a touched
+// file costs one file's work instead of a walk. The matches of every file are
+// kept, so the totals stay those of a full run: in grep mode a file's new
+// count replaces its old one, in replace mode replacements add up. Directories
+// created under a recursive walk are walked and watched as they appear.
+// Files named on the command line rather than found by a walk are not watched.
+class FileWatcher {
+public:
+    // Quiet time that ends a round, so an editor's burst of writes is one round
+    static constexpr int SETTLE_MS = 50;
+
+    using Report = std::function<void(int files, int matches)>;
+
+    // Hooks itself into processor's walk; call before the first run
+    FileWatcher(FartConfig& config, FileProcessor& processor);
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    bool open(std::string& error);
+
+    // Call after the first run; returns only if watching fails
+    bool run(const Report& report, std::string& error);
+
+    int files() const { return files_; }
+    int matches() const { return matches_; }
+
+private:
+    struct Watch {
+        std::filesystem::path dir;
+        size_t patterns;  // index into pattern_sets_
+    };
+
+    FartConfig& config_;
+    FileProcessor& processor_;
+    int fd_ = -1;
+    std::unordered_map<int, Watch> watches_;
+    std::deque<GlobSet> pattern_sets_;
+    std::map<std::vector<std::string>, size_t> pattern_index_;
+
+    std::unordered_map<std::string, int> file_matches_;
+    std::vector<std::string> written_;  // replaced this round, by us
+    std::unordered_map<std::string, std::filesystem::file_time_type> own_writes_;
+    int files_ = 0;
+    int matches_ = 0;
+    bool watch_failed_ = false;
+
+    // Files are changed (not just previewed), so replacements add up across rounds
+    bool replacing() const { return config_.isFartMode() && !config_.getOptions().preview; }
+
+    void addDirectory(const std::filesystem::path& dir, const GlobSet& patterns);
+    void setMatches(const std::string& file, int matches);
+
+    // Remembers the files replaced this round, so their own write events are ignored
+    void noteWrites();
+    bool isOwnWrite(const std::string& file);
+};
@@ -0,0 +1,181 @@
+#include "glob_set.hpp"
+
+GlobSet::GlobSet(const std::vector<std::string>& patterns) {
+    patterns_.reserve(patterns.size());
+    for (const auto& source : patterns) {
+        patterns_.push_back(compile(source));
+        const Pattern& pattern = patterns_.back();
+        auto index = static_cast<uint32_t>(patterns_.size() - 1);
+
+        if (pattern.elements.size() == 1 && pattern.elements[0].kind == Element::Kind::STAR) {
+            match_all_ = true;
+        }
+        if (!pattern.elements.empty() && pattern.elements.back().kind == Element::Kind::CHAR) {
+            by_last_char_[pattern.elements.back().ch].push_back(index);
+        } else {
+            any_end_.push_back(index);
+        }
+    }
+}
+
+std::vector<std::string> GlobSet::sources() const {
+    std::vector<std::string> sources;
+    sources.reserve(patterns_.size());
+    for (const auto& pattern : patterns_) {
+        sources.push_back(pattern.source);
+    }
+    return sources;
+}
+
+GlobSet::Pattern GlobSet::compile(const std::string& source) {
+    Pattern pattern;
+    pattern.source = source;
+    pattern.exact = source.find_first_of("[\\") != std::string::npos;
+
+    for (size_t i = 0; i < source.size();) {
+        char c = source[i];
+        if (c == '*') {
+            while (i < source.size() && source[i] == '*') {
+                i++;
+            }
+            pattern.elements.push_back({Element::Kind::STAR, 0, 0});
+            pattern.has_star = true;
+            continue;
+        }
+        if (c == '?') {
+            pattern.elements.push_back({Element::Kind::ANY, 0, 0});
+            i++;
+            continue;
+        }
+        if (c == '[') {
+            size_t end = source.find(']', i + 1);
+            if (end != std::string::npos) {
+                std::bitset<256> set;
+                size_t p = i + 1;
+                bool negate = p < end && source[p] == '^';
+                if (negate) {
+                    p++;
+                }
+                int last = -1;
+                for (; p < end; p++) {
+                    auto ch = static_cast<unsigned char>(source[p]);
+                    if (ch == '-' && last >= 0 && p + 1 < end) {
+                        auto upper = static_cast<unsigned char>(source[++p]);
+                        for (int r = last; r <= upper; r++) {
+                            set.set(r);
+                        }
+                        last = upper;
+                    } else {
+                        set.set(ch);
+                        last = ch;
+                    }
+                }
+                if (negate) {
+                    set.flip();
+                }
+                classes_.push_back(set);
+                pattern.elements.push_back(
+                    {Element::Kind::CLASS, 0, static_cast<uint32_t>(classes_.size() - 1)});
+                i = end + 1;
+                continue;
+            }
+            // No closing ']': a literal '['
+        }
+        if (c == '\\' && i + 1 < source.size()) {
+            c = source[++i];
+        }
+        pattern.elements.push_back({Element::Kind::CHAR, static_cast<unsigned char>(c), 0});
+        i++;
+    }
+
+    size_t head = 0;
+    while (head < pattern.elements.size() && pattern.elements[head].kind == Element::Kind::CHAR) {
+        pattern.prefix += static_cast<char>(pattern.elements[head++].ch);
+    }
+    size_t tail = pattern.elements.size();
+    while (tail > head && pattern.elements[tail - 1].kind == Element::Kind::CHAR) {
+        tail--;
+    }
+    for (size_t i = tail; i < pattern.elements.size(); i++) {
+        pattern.suffix += static_cast<char>(pattern.elements[i].ch);
+    }
+    for (const auto& element : pattern.elements) {
+        if (element.kind != Element::Kind::STAR) {
+            pattern.min_length++;
+        }
+    }
+    return pattern;
+}
+
+bool GlobSet::matchOne(const Pattern& pattern, std::string_view name) const {
+    if (name.size() < pattern.min_length || (!pattern.has_star && name.size() != pattern.min_length) ||
+        name.substr(0, pattern.prefix.size()) != pattern.prefix ||
+        name.substr(name.size() - pattern.suffix.size()) != pattern.suffix) {
+        return pattern.exact && name == pattern.source;
+    }
+
+    // Only the most recent star ever needs to absorb more of the name, so
+    // remembering where it was is enough to backtrack without recursion.
+    const auto& elements = pattern.elements;
+    size_t e = 0, t = 0;
+    size_t star_e = SIZE_MAX, star_t = 0;
+    for (;;) {
+        if (e < elements.size() && elements[e].kind == Element::Kind::STAR) {
+            if (++e == elements.size()) {
+                return true;
+            }
+            star_e = e;
+            star_t = t;
+            continue;
+        }
+        if (e == elements.size()) {
+            if (t == name.size()) {
+                return true;
+            }
+        } else if (t < name.size()) {
+            const Element& element = elements[e];
+            auto ch = static_cast<unsigned char>(name[t]);
+            bool hit = element.kind == Element::Kind::ANY ||
+                       (element.kind == Element::Kind::CHAR && element.ch == ch) ||
+                       (element.kind == Element::Kind::CLASS && classes_[element.cls].test(ch));
+            if (hit) {
+                e++;
+                t++;
+                continue;
+            }
+        }
+        if (star_e == SIZE_MAX || star_t == name.size()) {
+            return pattern.exact && name == pattern.source;
+        }
+        e = star_e;
+        t = ++star_t;
+    }
+}
+
+template <typename OnHit>
+void GlobSet::forEachCandidate(std::string_view name, OnHit&& on_hit) const {
+    if (!name.empty()) {
+        for (uint32_t index : by_last_char_[static_cast<unsigned char>(name.back())]) {
+            if (matchOne(patterns_[index], name) && !on_hit(index)) {
+                return;
+            }
+        }
+    }
+    for (uint32_t index : any_end_) {
+        if (matchOne(patterns_[index], name) && !on_hit(index)) {
+            return;
+        }
+    }
+}
+
+bool GlobSet::matches(std::string_view name) const {
+    if (match_all_) {
+        return true;
+    }
+    bool found = false;
+    forEachCandidate(name, [&](uint32_t) {
+        found = true;
+        return false;
+    });
+    return found;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Shell-style wildcards (*, ?, [...] and \) compiled once and matched against
+// file names in a single call. Each pattern keeps its literal prefix and suffix
+// for a quick reject, and patterns are bucketed by the last character they
+// require, so a name is only tried against patterns that can end like it does.
+class GlobSet {
+public:
+    explicit GlobSet(const std::vector<std::string>& patterns);
+
+    // True if any pattern matches
+    bool matches(std::string_view name) const;
+
+    size_t size() const { return patterns_.size(); }
+
+    // The patterns as given
+    std::vector<std::string> sources() const;
+
+private:
+    struct Element {
+        enum class Kind : uint8_t { CHAR, ANY, CLASS, STAR };
+        Kind kind;
+        unsigned char ch;
+        uint32_t cls;
+    };
+
+    struct Pattern {
+        std::string source;
+        std::vector<Element> elements;
+        std::string prefix;
+        std::string suffix;
+        size_t min_length = 0;
+        bool has_star = false;
+        bool exact = false;  // source has [ or \, so it may not match itself
+    };
+
+    std::vector<Pattern> patterns_;
+    std::vector<std::bitset<256>> classes_;
+    std::array<std::vector<uint32_t>, 256> by_last_char_;
+    std::vector<uint32_t> any_end_;
+    bool match_all_ = false;
+
+    Pattern compile(const std::string& source);
+    bool matchOne(const Pattern& pattern, std::string_view name) const;
+
+    template <typename OnHit>
+    void forEachCandidate(std::string_view name, OnHit&& on_hit) const;
+};
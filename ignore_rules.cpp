@@ -0,0 +1,232 @@
+#include "ignore_rules.hpp"
+#include <fstream>
+
+void IgnoreRules::enter(const std::filesystem::path& dir) {
+    entered_.push_back({frames_.size(), path_.size()});
+    if (entered_.size() > 1) {
+        path_.push_back(dir.filename().string());
+        load(dir);
+        return;
+    }
+
+    // A new walk: the rules from the top of its git work tree down apply too
+    std::error_code ec;
+    auto root = std::filesystem::absolute(dir, ec).lexically_normal();
+    if (ec) {
+        load(dir);
+        return;
+    }
+    if (!root.has_filename() && root.has_relative_path()) {
+        root = root.parent_path();  // "dir/" is normalized with a trailing separator
+    }
+    std::vector<std::filesystem::path> above;
+    bool in_work_tree = std::filesystem::exists(root / ".git", ec);
+    for (auto current = root; !in_work_tree && current.has_relative_path();) {
+        current = current.parent_path();
+        above.push_back(current);
+        in_work_tree = std::filesystem::exists(current / ".git", ec);
+    }
+    if (in_work_tree) {
+        for (size_t i = above.size(); i-- > 0;) {
+            load(above[i]);
+            path_.push_back((i ? above[i - 1] : root).filename().string());
+        }
+    }
+    load(dir);
+}
+
+void IgnoreRules::leave() {
+    const Entered& entered = entered_.back();
+    frames_.erase(frames_.begin() + static_cast<std::ptrdiff_t>(entered.frames), frames_.end());
+    path_.erase(path_.begin() + static_cast<std::ptrdiff_t>(entered.path), path_.end());
+    entered_.pop_back();
+}
+
+void IgnoreRules::load(const std::filesystem::path& dir) {
+    Frame frame;
+    frame.depth = path_.size();
+    for (const char* file_name : FILE_NAMES) {
+        std::ifstream file(dir / file_name);
+        std::string line;
+        Rule rule;
+        while (std::getline(file, line)) {
+            if (parseRule(line, rule)) {
+                frame.rules.push_back(std::move(rule));
+            }
+        }
+    }
+    if (!frame.rules.empty()) {
+        frames_.push_back(std::move(frame));
+    }
+}
+
+bool IgnoreRules::parseRule(std::string_view line, Rule& rule) {
+    rule = Rule();
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+    // Trailing spaces do not count unless escaped
+    while (!line.empty() && line.back() == ' ' && !(line.size() > 1 && line[line.size() - 2] == '\\')) {
+        line.remove_suffix(1);
+    }
+    if (line.empty() || line[0] == '#') {
+        return false;
+    }
+    if (line[0] == '!') {
+        rule.negate = true;
+        line.remove_prefix(1);
+    }
+    if (!line.empty() && line.back() == '/') {
+        rule.dir_only = true;
+        line.remove_suffix(1);
+    }
+    if (line.find('/') != std::string_view::npos) {
+        rule.anchored = true;
+        if (line[0] == '/') {
+            line.remove_prefix(1);
+        }
+    }
+    if (line.empty()) {
+        return false;
+    }
+
+    auto is_literal = [](std::string_view text) {
+        return text.find_first_of("*?[\\") == std::string_view::npos;
+    };
+    if (!rule.anchored && is_literal(line)) {
+        rule.kind = Rule::Kind::LITERAL;
+        rule.pattern = line;
+    } else if (!rule.anchored && line[0] == '*' && is_literal(line.substr(1))) {
+        rule.kind = Rule::Kind::SUFFIX;
+        rule.pattern = line.substr(1);
+    } else {
+        rule.kind = Rule::Kind::GLOB;
+        rule.pattern = line;
+    }
+    return true;
+}
+
+bool IgnoreRules::ignored(std::string_view name, bool is_dir) const {
+    // Deepest directory first, last rule first: the first rule that matches decides
+    for (auto frame = frames_.rbegin(); frame != frames_.rend(); ++frame) {
+        std::string path;
+        for (auto rule = frame->rules.rbegin(); rule != frame->rules.rend(); ++rule) {
+            if (rule->dir_only && !is_dir) {
+                continue;
+            }
+            if (rule->anchored && path.empty()) {
+                for (size_t i = frame->depth; i < path_.size(); i++) {
+                    path += path_[i];
+                    path += '/';
+                }
+                path += name;
+            }
+            if (matchRule(*rule, name, path)) {
+                return !rule->negate;
+            }
+        }
+    }
+    return false;
+}
+
+bool IgnoreRules::matchRule(const Rule& rule, std::string_view name, std::string_view path) {
+    switch (rule.kind) {
+        case Rule::Kind::LITERAL:
+            return name == rule.pattern;
+        case Rule::Kind::SUFFIX:
+            return name.size() >= rule.pattern.size() &&
+                   name.compare(name.size() - rule.pattern.size(), rule.pattern.size(), rule.pattern) == 0;
+        case Rule::Kind::GLOB:
+            return matchGlob(rule.pattern, rule.anchored ? path : name);
+    }
+    return false;
+}
+
+bool IgnoreRules::matchGlob(std::string_view pattern, std::string_view text) {
+    // Iterative, like wildmat's DoMatch: a mismatch only backtracks to the last
+    // * (which takes one more character, but never a '/') and then to the last
+    // "**/" (which skips one more directory), so many stars stay linear
+    constexpr size_t NONE = std::string_view::npos;
+    size_t p = 0, t = 0;
+    size_t star_p = NONE, star_t = 0;  // pattern after the last *, and the text it resumes at
+    size_t dirs_p = NONE, dirs_t = 0;  // likewise for the last "**/"
+    for (;;) {
+        size_t used = 0;  // pattern characters matching text[t]; 0 for a mismatch
+        if (p < pattern.size()) {
+            // "**/" matches any number of directories, a trailing "**" everything;
+            // elsewhere ** is just *
+            bool component_start = t == 0 || text[t - 1] == '/';
+            if (component_start && pattern.substr(p, 2) == "**" &&
+                (p + 2 == pattern.size() || pattern[p + 2] == '/')) {
+                if (p + 2 == pattern.size()) {
+                    return true;
+                }
+                p = dirs_p = p + 3;
+                dirs_t = t;
+                star_p = NONE;
+                continue;
+            }
+            if (pattern[p] == '*') {
+                while (p < pattern.size() && pattern[p] == '*') {
+                    p++;
+                }
+                star_p = p;
+                star_t = t;
+                continue;
+            }
+            if (t < text.size()) {
+                used = matchChar(pattern.substr(p), static_cast<unsigned char>(text[t]));
+            }
+        } else if (t == text.size()) {
+            return true;
+        }
+
+        if (used) {
+            p += used;
+            t++;
+        } else if (star_p != NONE && star_t < text.size() && text[star_t] != '/') {
+            p = star_p;
+            t = ++star_t;
+        } else if (dirs_p != NONE && (dirs_t = text.find('/', dirs_t)) != NONE) {
+            p = dirs_p;
+            t = ++dirs_t;
+            star_p = NONE;
+        } else {
+            return false;
+        }
+    }
+}
+
+size_t IgnoreRules::matchChar(std::string_view pattern, unsigned char ch) {
+    char c = pattern[0];
+    if (c == '?') {
+        return ch != '/';
+    }
+    if (c == '[' && pattern.find(']', 2) != std::string_view::npos) {
+        size_t i = 1;
+        bool negate = i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^');
+        if (negate) {
+            i++;
+        }
+        bool matched = false;
+        for (bool first = true; i < pattern.size() && (first || pattern[i] != ']'); first = false, i++) {
+            auto lo = static_cast<unsigned char>(pattern[i]);
+            auto hi = lo;
+            if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+                hi = static_cast<unsigned char>(pattern[i + 2]);
+                i += 2;
+            }
+            matched |= lo <= ch && ch <= hi;
+        }
+        if (i >= pattern.size()) {
+            return 0;  // unterminated after all, as in "[]"
+        }
+        return matched != negate && ch != '/' ? i + 1 : 0;
+    }
+    size_t used = 1;
+    if (c == '\\' && pattern.size() > 1) {
+        c = pattern[1];
+        used = 2;
+    }
+    return static_cast<unsigned char>(c) == ch ? used : 0;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The .gitignore and .ignore files of a walk (--gitignore), read once per
+// directory as the walk enters it and applied to everything below, so ignored
+// trees are pruned before they are descended into. Rules of deeper files and
+// later lines win, as in git; .ignore is read after .gitignore. When the walk
+// starts inside a git work tree, the ignore files between its top and the
+// walk's root apply as well.
+class IgnoreRules {
+public:
+    static constexpr const char* FILE_NAMES[] = {".gitignore", ".ignore"};
+
+    // Enters dir: a subdirectory of the directory entered last, or the root of
+    // a new walk when nothing is entered
+    void enter(const std::filesystem::path& dir);
+    void leave();
+
+    // Whether name, an entry of the directory entered last, is ignored
+    bool ignored(std::string_view name, bool is_dir) const;
+
+    // Matches text against a gitignore glob: * and ? stop at '/', ** spans directories
+    static bool matchGlob(std::string_view pattern, std::string_view text);
+
+private:
+    struct Rule {
+        enum class Kind { LITERAL, SUFFIX, GLOB };  // "name", "*.ext" or anything else
+        Kind kind;
+        std::string pattern;  // for SUFFIX, without the leading *
+        bool negate = false;
+        bool dir_only = false;
+        bool anchored = false;  // matched against the path below the rule's directory
+    };
+
+    struct Frame {
+        std::vector<Rule> rules;
+        size_t depth = 0;  // entries of path_ above the frame's directory
+    };
+
+    struct Entered {
+        size_t frames;
+        size_t path;
+    };
+
+    std::vector<Frame> frames_;        // only directories with rules get one
+    std::vector<std::string> path_;    // directory names from the top down to the one entered last
+    std::vector<Entered> entered_;
+
+    void load(const std::filesystem::path& dir);
+    static bool parseRule(std::string_view line, Rule& rule);
+    static bool matchRule(const Rule& rule, std::string_view name, std::string_view path);
+    // The number of pattern characters (a literal, ?, [class] or \c) matching ch, or 0
+    static size_t matchChar(std::string_view pattern, unsigned char ch);
+};
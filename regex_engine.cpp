@@ -0,0 +1,850 @@
+#include "regex_engine.hpp"
+#include <algorithm>
+#include <cctype>
+#include <memory>
+#include <stdexcept>
+
+namespace {
+
+constexpr size_t MAX_REPEAT = 1000;
+constexpr size_t MAX_PROGRAM = 1 << 16;
+constexpr size_t MAX_DFA_STATES = 4096;  // the cache starts over beyond this
+constexpr uint32_t NO_SLOT = static_cast<uint32_t>(-1);
+
+bool isWordByte(unsigned char c) {
+    return std::isalnum(c) || c == '_';
+}
+
+int firstByte(const std::bitset<256>& set) {
+    for (int c = 0; c < 256; c++) {
+        if (set.test(c)) {
+            return c;
+        }
+    }
+    return -1;
+}
+
+struct Node {
+    enum class Kind { EMPTY, CLASS, CONCAT, ALTERNATE, REPEAT, GROUP, BOL, EOL, WORD_BOUNDARY, NOT_WORD_BOUNDARY };
+    Kind kind = Kind::EMPTY;
+    std::bitset<256> set;
+    std::vector<std::unique_ptr<Node>> children;
+    size_t min = 0;
+    size_t max = 0;  // NPOS for unbounded
+    bool greedy = true;
+    size_t group = 0;  // 0 for a non-capturing group
+};
+
+}  // namespace
+
+// Parses a pattern into a tree and emits the engine's program from it
+class RegexCompiler {
+public:
+    RegexCompiler(const std::string& pattern, bool ignore_case, RegexEngine& engine)
+        : pattern_(pattern), ignore_case_(ignore_case), engine_(engine) {}
+
+    void compile() {
+        auto root = parseAlternation();
+        if (pos_ < pattern_.size()) {
+            fail("unmatched )");
+        }
+        engine_.groups_ = std::min(groups_ + 1, RegexEngine::MAX_GROUPS);
+
+        emit(RegexEngine::Op::SAVE, 0, 0);
+        compileNode(*root);
+        emit(RegexEngine::Op::SAVE, 0, 1);
+        emit(RegexEngine::Op::MATCH, 0, 0);
+
+        bool exact = false;
+        engine_.required_literal_ = requiredLiteral(*root, exact);
+    }
+
+private:
+    using Op = RegexEngine::Op;
+    using Kind = Node::Kind;
+
+    const std::string& pattern_;
+    bool ignore_case_;
+    RegexEngine& engine_;
+    size_t pos_ = 0;
+    size_t groups_ = 0;
+
+    [[noreturn]] void fail(const std::string& message) const {
+        throw std::invalid_argument(message + " at offset " + std::to_string(pos_) + " in \"" + pattern_ + "\"");
+    }
+
+    bool more() const { return pos_ < pattern_.size(); }
+    char peek() const { return pattern_[pos_]; }
+
+    static std::unique_ptr<Node> make(Kind kind) {
+        auto node = std::make_unique<Node>();
+        node->kind = kind;
+        return node;
+    }
+
+    std::unique_ptr<Node> parseAlternation() {
+        auto first = parseConcatenation();
+        if (!more() || peek() != '|') {
+            return first;
+        }
+        auto node = make(Kind::ALTERNATE);
+        node->children.push_back(std::move(first));
+        while (more() && peek() == '|') {
+            pos_++;
+            node->children.push_back(parseConcatenation());
+        }
+        return node;
+    }
+
+    std::unique_ptr<Node> parseConcatenation() {
+        auto node = make(Kind::CONCAT);
+        while (more() && peek() != '|' && peek() != ')') {
+            node->children.push_back(parseRepeat());
+        }
+        return node;
+    }
+
+    bool parseCount(size_t& value) {
+        size_t start = pos_;
+        value = 0;
+        while (more() && std::isdigit(static_cast<unsigned char>(peek()))) {
+            value = std::min(value * 10 + static_cast<size_t>(peek() - '0'), MAX_REPEAT + 1);
+            pos_++;
+        }
+        return pos_ > start;
+    }
+
+    // {m}, {m,} or {m,n}; anything else leaves '{' to be a literal
+    bool parseBraces(size_t& min, size_t& max) {
+        size_t start = pos_;
+        pos_++;
+        if (parseCount(min)) {
+            max = min;
+            if (more() && peek() == ',') {
+                pos_++;
+                if (!parseCount(max)) {
+                    max = RegexEngine::NPOS;
+                }
+            }
+            if (more() && peek() == '}') {
+                pos_++;
+                if (min > MAX_REPEAT || (max != RegexEngine::NPOS && max > MAX_REPEAT)) {
+                    fail("repeat count over " + std::to_string(MAX_REPEAT));
+                }
+                if (max < min) {
+                    fail("bad repeat range");
+                }
+                return true;
+            }
+        }
+        pos_ = start;
+        return false;
+    }
+
+    std::unique_ptr<Node> parseRepeat() {
+        auto atom = parseAtom();
+        while (more()) {
+            size_t min, max;
+            char c = peek();
+            if (c == '*') {
+                min = 0, max = RegexEngine::NPOS, pos_++;
+            } else if (c == '+') {
+                min = 1, max = RegexEngine::NPOS, pos_++;
+            } else if (c == '?') {
+                min = 0, max = 1, pos_++;
+            } else if (c != '{' || !parseBraces(min, max)) {
+                break;
+            }
+            if (atom->kind == Kind::BOL || atom->kind == Kind::EOL || atom->kind == Kind::WORD_BOUNDARY ||
+                atom->kind == Kind::NOT_WORD_BOUNDARY) {
+                fail("nothing to repeat");
+            }
+            auto node = make(Kind::REPEAT);
+            node->min = min;
+            node->max = max;
+            if (more() && peek() == '?') {
+                node->greedy = false;
+                pos_++;
+            }
+            node->children.push_back(std::move(atom));
+            atom = std::move(node);
+        }
+        return atom;
+    }
+
+    std::bitset<256> fold(std::bitset<256> set) const {
+        if (ignore_case_) {
+            for (int c = 'a'; c <= 'z'; c++) {
+                if (set.test(c) || set.test(c - 'a' + 'A')) {
+                    set.set(c);
+                    set.set(c - 'a' + 'A');
+                }
+            }
+        }
+        return set;
+    }
+
+    std::unique_ptr<Node> classNode(const std::bitset<256>& set) const {
+        auto node = make(Kind::CLASS);
+        node->set = fold(set);
+        return node;
+    }
+
+    static std::bitset<256> single(unsigned char c) {
+        std::bitset<256> set;
+        set.set(c);
+        return set;
+    }
+
+    static std::bitset<256> namedClass(char name) {
+        std::bitset<256> set;
+        for (int c = 0; c < 256; c++) {
+            switch (std::tolower(static_cast<unsigned char>(name))) {
+                case 'd': set[c] = std::isdigit(c) != 0; break;
+                case 'w': set[c] = isWordByte(static_cast<unsigned char>(c)); break;
+                case 's': set[c] = c == ' ' || (c >= '\t' && c <= '\r'); break;
+            }
+        }
+        return std::isupper(static_cast<unsigned char>(name)) ? ~set : set;
+    }
+
+    int hexDigit(char c) const {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    // Parses the escape after a backslash into a set of bytes; false for assertions
+    bool parseEscape(std::bitset<256>& set, Kind& assertion) {
+        if (!more()) {
+            fail("trailing backslash");
+        }
+        char c = pattern_[pos_++];
+        switch (c) {
+            case 'd': case 'D': case 'w': case 'W': case 's': case 'S':
+                set = namedClass(c);
+                return true;
+            case 'b': assertion = Kind::WORD_BOUNDARY; return false;
+            case 'B': assertion = Kind::NOT_WORD_BOUNDARY; return false;
+            case 'n': set = single('\n'); return true;
+            case 't': set = single('\t'); return true;
+            case 'r': set = single('\r'); return true;
+            case 'f': set = single('\f'); return true;
+            case 'v': set = single('\v'); return true;
+            case 'x': {
+                int high = pos_ < pattern_.size() ? hexDigit(pattern_[pos_]) : -1;
+                int low = pos_ + 1 < pattern_.size() ? hexDigit(pattern_[pos_ + 1]) : -1;
+                if (high < 0 || low < 0) {
+                    fail("bad \\x escape");
+                }
+                pos_ += 2;
+                set = single(static_cast<unsigned char>(high * 16 + low));
+                return true;
+            }
+            default:
+                if (std::isalnum(static_cast<unsigned char>(c))) {
+                    pos_--;
+                    fail("unknown escape \\" + std::string(1, c));
+                }
+                set = single(static_cast<unsigned char>(c));
+                return true;
+        }
+    }
+
+    std::unique_ptr<Node> parseClass() {
+        std::bitset<256> set;
+        bool negate = more() && peek() == '^';
+        if (negate) {
+            pos_++;
+        }
+        bool first = true;
+        while (true) {
+            if (!more()) {
+                fail("missing ]");
+            }
+            char c = pattern_[pos_++];
+            if (c == ']' && !first) {
+                break;
+            }
+            first = false;
+
+            std::bitset<256> item;
+            int low = static_cast<unsigned char>(c);
+            if (c == '\\') {
+                Kind assertion;
+                if (!parseEscape(item, assertion)) {
+                    fail("assertion in character class");
+                }
+                low = item.count() == 1 ? firstByte(item) : -1;
+            } else {
+                item.set(low);
+            }
+
+            // A range a-z; '-' first or last is a literal
+            if (low >= 0 && pos_ + 1 < pattern_.size() && peek() == '-' && pattern_[pos_ + 1] != ']') {
+                pos_++;
+                int high = static_cast<unsigned char>(pattern_[pos_++]);
+                if (high == '\\') {
+                    Kind assertion;
+                    std::bitset<256> end;
+                    if (!parseEscape(end, assertion) || end.count() != 1) {
+                        fail("bad range in character class");
+                    }
+                    high = firstByte(end);
+                }
+                if (high < low) {
+                    fail("bad range in character class");
+                }
+                for (int r = low; r <= high; r++) {
+                    item.set(r);
+                }
+            }
+            set |= item;
+        }
+        // Fold first: [^a] must not match 'A' either
+        set = fold(set);
+        if (negate) {
+            set.flip();
+        }
+        return classNode(set);
+    }
+
+    std::unique_ptr<Node> parseAtom() {
+        char c = pattern_[pos_++];
+        switch (c) {
+            case '(': {
+                auto node = make(Kind::GROUP);
+                if (pattern_.compare(pos_, 2, "?:") == 0) {
+                    pos_ += 2;
+                } else {
+                    node->group = ++groups_;
+                }
+                node->children.push_back(parseAlternation());
+                if (!more() || peek() != ')') {
+                    fail("missing )");
+                }
+                pos_++;
+                return node;
+            }
+            case '[':
+                return parseClass();
+            case '.':
+                return classNode(~single('\n'));
+            case '^':
+                return make(Kind::BOL);
+            case '$':
+                return make(Kind::EOL);
+            case '*': case '+': case '?':
+                pos_--;
+                fail("nothing to repeat");
+            case '\\': {
+                std::bitset<256> set;
+                Kind assertion = Kind::EMPTY;
+                if (!parseEscape(set, assertion)) {
+                    engine_.uses_dfa_ = false;
+                    return make(assertion);
+                }
+                return classNode(set);
+            }
+            default:
+                return classNode(single(static_cast<unsigned char>(c)));
+        }
+    }
+
+    uint32_t emit(Op op, uint32_t x, uint32_t y) {
+        if (engine_.program_.size() >= MAX_PROGRAM) {
+            fail("pattern too large");
+        }
+        auto pc = static_cast<uint32_t>(engine_.program_.size());
+        engine_.program_.push_back({op, op == Op::SAVE || op == Op::CLASS || op == Op::BOL || op == Op::EOL ||
+                                                op == Op::WORD_BOUNDARY || op == Op::NOT_WORD_BOUNDARY
+                                            ? pc + 1
+                                            : x,
+                                    y});
+        return pc;
+    }
+
+    uint32_t here() const { return static_cast<uint32_t>(engine_.program_.size()); }
+
+    // A SPLIT whose preferred branch follows it; 'other' is patched later
+    uint32_t emitSplit(bool greedy) {
+        uint32_t pc = emit(Op::SPLIT, 0, 0);
+        engine_.program_[pc].x = pc + 1;
+        if (!greedy) {
+            std::swap(engine_.program_[pc].x, engine_.program_[pc].y);
+        }
+        return pc;
+    }
+
+    void patchSplit(uint32_t pc, uint32_t other) {
+        auto& inst = engine_.program_[pc];
+        (inst.x == pc + 1 ? inst.y : inst.x) = other;
+    }
+
+    void compileNode(const Node& node) {
+        switch (node.kind) {
+            case Kind::EMPTY:
+                break;
+            case Kind::CLASS:
+                engine_.classes_.push_back(node.set);
+                emit(Op::CLASS, 0, static_cast<uint32_t>(engine_.classes_.size() - 1));
+                break;
+            case Kind::CONCAT:
+                for (const auto& child : node.children) {
+                    compileNode(*child);
+                }
+                break;
+            case Kind::ALTERNATE: {
+                std::vector<uint32_t> jumps;
+                for (size_t i = 0; i < node.children.size(); i++) {
+                    uint32_t split = 0;
+                    bool last = i + 1 == node.children.size();
+                    if (!last) {
+                        split = emitSplit(true);
+                    }
+                    compileNode(*node.children[i]);
+                    if (!last) {
+                        jumps.push_back(emit(Op::JMP, 0, 0));
+                        patchSplit(split, here());
+                    }
+                }
+                for (uint32_t jump : jumps) {
+                    engine_.program_[jump].x = here();
+                }
+                break;
+            }
+            case Kind::GROUP:
+                if (node.group && node.group < RegexEngine::MAX_GROUPS) {
+                    emit(Op::SAVE, 0, static_cast<uint32_t>(node.group * 2));
+                    compileNode(*node.children[0]);
+                    emit(Op::SAVE, 0, static_cast<uint32_t>(node.group * 2 + 1));
+                } else {
+                    compileNode(*node.children[0]);
+                }
+                break;
+            case Kind::REPEAT: {
+                for (size_t i = 0; i < node.min; i++) {
+                    compileNode(*node.children[0]);
+                }
+                if (node.max == RegexEngine::NPOS) {
+                    uint32_t loop = emitSplit(node.greedy);
+                    compileNode(*node.children[0]);
+                    emit(Op::JMP, loop, 0);
+                    patchSplit(loop, here());
+                } else {
+                    std::vector<uint32_t> splits;
+                    for (size_t i = node.min; i < node.max; i++) {
+                        splits.push_back(emitSplit(node.greedy));
+                        compileNode(*node.children[0]);
+                    }
+                    for (uint32_t split : splits) {
+                        patchSplit(split, here());
+                    }
+                }
+                break;
+            }
+            case Kind::BOL:
+                emit(Op::BOL, 0, 0);
+                break;
+            case Kind::EOL:
+                emit(Op::EOL, 0, 0);
+                break;
+            case Kind::WORD_BOUNDARY:
+                emit(Op::WORD_BOUNDARY, 0, 0);
+                break;
+            case Kind::NOT_WORD_BOUNDARY:
+                emit(Op::NOT_WORD_BOUNDARY, 0, 0);
+                break;
+        }
+    }
+
+    // The byte a class stands for if it is a single (case-folded) character
+    int literalByte(const std::bitset<256>& set) const {
+        if (set.count() == 1) {
+            return firstByte(set);
+        }
+        if (ignore_case_ && set.count() == 2) {
+            int c = firstByte(set);
+            if (std::isupper(c) && set.test(std::tolower(c))) {
+                return std::tolower(c);
+            }
+        }
+        return -1;
+    }
+
+    // Longest literal every match of the node contains; 'exact' if the node
+    // matches nothing but that literal
+    std::string requiredLiteral(const Node& node, bool& exact) const {
+        exact = false;
+        switch (node.kind) {
+            case Kind::EMPTY:
+            case Kind::BOL:
+            case Kind::EOL:
+            case Kind::WORD_BOUNDARY:
+            case Kind::NOT_WORD_BOUNDARY:
+                exact = true;
+                return "";
+            case Kind::CLASS: {
+                int c = literalByte(node.set);
+                exact = c >= 0;
+                return exact ? std::string(1, static_cast<char>(c)) : "";
+            }
+            case Kind::GROUP:
+                return requiredLiteral(*node.children[0], exact);
+            case Kind::REPEAT: {
+                if (node.min == 0) {
+                    return "";
+                }
+                bool child_exact;
+                std::string literal = requiredLiteral(*node.children[0], child_exact);
+                if (child_exact && node.min == node.max && literal.size() * node.min <= 256) {
+                    exact = true;
+                    std::string repeated;
+                    for (size_t i = 0; i < node.min; i++) {
+                        repeated += literal;
+                    }
+                    return repeated;
+                }
+                return literal;
+            }
+            case Kind::CONCAT: {
+                std::string best, run;
+                bool all_exact = true;
+                for (const auto& child : node.children) {
+                    bool child_exact;
+                    std::string literal = requiredLiteral(*child, child_exact);
+                    if (child_exact) {
+                        run += literal;
+                        continue;
+                    }
+                    all_exact = false;
+                    if (run.size() > best.size()) {
+                        best = run;
+                    }
+                    run.clear();
+                    if (literal.size() > best.size()) {
+                        best = literal;
+                    }
+                }
+                if (run.size() > best.size()) {
+                    best = run;
+                }
+                exact = all_exact;
+                return exact ? run : best;
+            }
+            case Kind::ALTERNATE:
+                return "";
+        }
+        return "";
+    }
+};
+
+std::string_view RegexEngine::Match::group(std::string_view text, size_t index) const {
+    if (index >= MAX_GROUPS || start[index] == NPOS || end[index] == NPOS) {
+        return {};
+    }
+    return text.substr(start[index], end[index] - start[index]);
+}
+
+RegexEngine::RegexEngine(const std::string& pattern, bool ignore_case) {
+    RegexCompiler(pattern, ignore_case, *this).compile();
+
+    // Assertions are assumed to hold: this only has to be a superset
+    std::vector<bool> seen(program_.size());
+    std::vector<uint32_t> pending{0};
+    while (!pending.empty()) {
+        uint32_t pc = pending.back();
+        pending.pop_back();
+        if (seen[pc]) {
+            continue;
+        }
+        seen[pc] = true;
+        const Inst& inst = program_[pc];
+        if (inst.op == Op::CLASS) {
+            first_bytes_ |= classes_[inst.y];
+        } else if (inst.op == Op::MATCH) {
+            first_bytes_.set();
+        } else {
+            pending.push_back(inst.x);
+            if (inst.op == Op::SPLIT) {
+                pending.push_back(inst.y);
+            }
+        }
+    }
+
+    size_t slots = groups_ * 2;
+    for (auto& list : lists_) {
+        list.dense.resize(program_.size());
+        list.sparse.resize(program_.size());
+        list.captures.resize(program_.size() * slots);
+    }
+    scratch_.resize(slots);
+}
+
+bool RegexEngine::contains(std::string_view text) const {
+    // The DFA cannot tell an empty text from one it is at the end of
+    if (uses_dfa_ && !text.empty()) {
+        return dfaContains(text, 0);
+    }
+    Match match;
+    return pikeSearch(text, 0, match);
+}
+
+bool RegexEngine::search(std::string_view text, size_t from, Match& match) const {
+    if (from > text.size() || (uses_dfa_ && from < text.size() && !dfaContains(text, from))) {
+        return false;
+    }
+    return pikeSearch(text, from, match);
+}
+
+// DFA
+
+void RegexEngine::dfaClosure(uint32_t pc, bool at_start, bool at_end, std::vector<uint32_t>& pcs,
+                             std::vector<bool>& seen) const {
+    stack_.clear();
+    stack_.push_back({pc, NO_SLOT, 0});
+    while (!stack_.empty()) {
+        uint32_t next = stack_.back().pc;
+        stack_.pop_back();
+        while (!seen[next]) {
+            seen[next] = true;
+            const Inst& inst = program_[next];
+            switch (inst.op) {
+                case Op::JMP:
+                case Op::SAVE:
+                    next = inst.x;
+                    continue;
+                case Op::SPLIT:
+                    stack_.push_back({inst.y, NO_SLOT, 0});
+                    next = inst.x;
+                    continue;
+                case Op::BOL:
+                    if (at_start) {
+                        next = inst.x;
+                        continue;
+                    }
+                    break;
+                case Op::EOL:
+                    if (at_end) {
+                        next = inst.x;
+                        continue;
+                    }
+                    pcs.push_back(next);  // resolved once the end is reached
+                    break;
+                default:  // CLASS and MATCH wait for the next byte
+                    pcs.push_back(next);
+                    break;
+            }
+            break;
+        }
+    }
+}
+
+int32_t RegexEngine::dfaState(std::vector<uint32_t>& pcs) const {
+    std::sort(pcs.begin(), pcs.end());
+    std::string key(reinterpret_cast<const char*>(pcs.data()), pcs.size() * sizeof(uint32_t));
+    auto it = dfa_index_.find(key);
+    if (it != dfa_index_.end()) {
+        return it->second;
+    }
+
+    DfaState state;
+    state.pcs = pcs;
+    state.next.fill(-1);
+    std::vector<bool> seen(program_.size());
+    std::vector<uint32_t> at_end;
+    for (uint32_t pc : pcs) {
+        if (program_[pc].op == Op::MATCH) {
+            state.match = true;
+        } else if (program_[pc].op == Op::EOL) {
+            dfaClosure(program_[pc].x, false, true, at_end, seen);
+        }
+    }
+    for (uint32_t pc : at_end) {
+        state.match_at_end |= program_[pc].op == Op::MATCH;
+    }
+    state.match_at_end |= state.match;
+
+    auto id = static_cast<int32_t>(dfa_states_.size());
+    dfa_states_.push_back(std::move(state));
+    dfa_index_.emplace(std::move(key), id);
+    return id;
+}
+
+int32_t RegexEngine::dfaStart(bool at_start) const {
+    int32_t& start = dfa_start_[at_start ? 1 : 0];
+    if (start < 0) {
+        std::vector<uint32_t> pcs;
+        std::vector<bool> seen(program_.size());
+        dfaClosure(0, at_start, false, pcs, seen);
+        start = dfaState(pcs);
+    }
+    return start;
+}
+
+int32_t RegexEngine::dfaNext(int32_t state, unsigned char byte) const {
+    int32_t next = dfa_states_[state].next[byte];
+    if (next >= 0) {
+        return next;
+    }
+
+    std::vector<uint32_t> pcs;
+    std::vector<bool> seen(program_.size());
+    for (uint32_t pc : dfa_states_[state].pcs) {
+        const Inst& inst = program_[pc];
+        if (inst.op == Op::CLASS && classes_[inst.y].test(byte)) {
+            dfaClosure(inst.x, false, false, pcs, seen);
+        }
+    }
+    dfaClosure(0, false, false, pcs, seen);  // a match may also start at the next byte
+
+    if (dfa_states_.size() >= MAX_DFA_STATES) {
+        // Start over rather than grow without bound; the current state is rebuilt on demand
+        dfa_states_.clear();
+        dfa_index_.clear();
+        dfa_start_[0] = dfa_start_[1] = -1;
+        return dfaState(pcs);
+    }
+    next = dfaState(pcs);
+    dfa_states_[state].next[byte] = next;
+    return next;
+}
+
+bool RegexEngine::dfaContains(std::string_view text, size_t from) const {
+    int32_t state = dfaStart(from == 0);
+    for (size_t i = from; i < text.size(); i++) {
+        if (dfa_states_[state].match) {
+            return true;
+        }
+        state = dfaNext(state, static_cast<unsigned char>(text[i]));
+    }
+    return dfa_states_[state].match_at_end;
+}
+
+// Pike VM
+
+void RegexEngine::addThread(ThreadList& list, uint32_t pc, std::string_view text, size_t pos,
+                            const size_t* captures) const {
+    size_t slots = groups_ * 2;
+    std::copy(captures, captures + slots, scratch_.begin());
+
+    // Alternatives are stacked so the preferred branch is followed first; a
+    // SAVE stacks the old value so later alternatives see it restored
+    stack_.clear();
+    stack_.push_back({pc, NO_SLOT, 0});
+    while (!stack_.empty()) {
+        StackEntry entry = stack_.back();
+        stack_.pop_back();
+        if (entry.slot != NO_SLOT) {
+            scratch_[entry.slot] = entry.value;
+            continue;
+        }
+
+        uint32_t next = entry.pc;
+        while (true) {
+            uint32_t index = list.sparse[next];
+            if (index < list.size && list.dense[index] == next) {
+                break;  // already on the list, with higher priority
+            }
+            list.sparse[next] = static_cast<uint32_t>(list.size);
+            list.dense[list.size++] = next;
+
+            const Inst& inst = program_[next];
+            bool follow = false;
+            switch (inst.op) {
+                case Op::JMP:
+                    follow = true;
+                    break;
+                case Op::SPLIT:
+                    stack_.push_back({inst.y, NO_SLOT, 0});
+                    follow = true;
+                    break;
+                case Op::SAVE:
+                    if (inst.y < slots) {
+                        stack_.push_back({0, inst.y, scratch_[inst.y]});
+                        scratch_[inst.y] = pos;
+                    }
+                    follow = true;
+                    break;
+                case Op::BOL:
+                    follow = pos == 0;
+                    break;
+                case Op::EOL:
+                    follow = pos == text.size();
+                    break;
+                case Op::WORD_BOUNDARY:
+                case Op::NOT_WORD_BOUNDARY: {
+                    bool before = pos > 0 && isWordByte(static_cast<unsigned char>(text[pos - 1]));
+                    bool after = pos < text.size() && isWordByte(static_cast<unsigned char>(text[pos]));
+                    follow = (before != after) == (inst.op == Op::WORD_BOUNDARY);
+                    break;
+                }
+                case Op::CLASS:
+                case Op::MATCH:
+                    std::copy(scratch_.begin(), scratch_.end(), list.captures.begin() + next * slots);
+                    break;
+            }
+            if (!follow) {
+                break;
+            }
+            next = inst.x;
+        }
+    }
+}
+
+bool RegexEngine::pikeSearch(std::string_view text, size_t from, Match& match) const {
+    size_t slots = groups_ * 2;
+    ThreadList* current = &lists_[0];
+    ThreadList* next = &lists_[1];
+    current->size = 0;
+
+    std::array<size_t, MAX_GROUPS * 2> unset;
+    unset.fill(NPOS);
+    bool matched = false;
+
+    for (size_t pos = from;; pos++) {
+        if (!matched && current->size == 0) {
+            // No thread is running: skip to where a match can start
+            while (pos < text.size() && !first_bytes_.test(static_cast<unsigned char>(text[pos]))) {
+                pos++;
+            }
+        }
+        if (!matched) {
+            addThread(*current, 0, text, pos, unset.data());  // lowest priority: starts later
+        }
+        if (current->size == 0) {
+            break;
+        }
+
+        next->size = 0;
+        for (size_t i = 0; i < current->size; i++) {
+            uint32_t pc = current->dense[i];
+            const Inst& inst = program_[pc];
+            const size_t* captures = current->captures.data() + pc * slots;
+            if (inst.op == Op::MATCH) {
+                for (size_t g = 0; g < groups_; g++) {
+                    match.start[g] = captures[g * 2];
+                    match.end[g] = captures[g * 2 + 1];
+                }
+                for (size_t g = groups_; g < MAX_GROUPS; g++) {
+                    match.start[g] = match.end[g] = NPOS;
+                }
+                matched = true;
+                break;  // threads after this one have lower priority
+            }
+            if (inst.op == Op::CLASS && pos < text.size() &&
+                classes_[inst.y].test(static_cast<unsigned char>(text[pos]))) {
+                addThread(*next, inst.x, text, pos + 1, captures);
+            }
+        }
+        std::swap(current, next);
+        if (pos >= text.size()) {
+            if (current->size && !matched) {
+                continue;  // threads waiting at the end can only match through assertions
+            }
+            break;
+        }
+    }
+    return matched;
+}
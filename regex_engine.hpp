@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Regular expressions for --regex, matched in time linear in the text; there
+// is no backtracking, so no pattern can make a search blow up.
+//
+// The pattern compiles to a Thompson NFA. Whether (and where) a line can match
+// is decided by a DFA built lazily from the NFA, one state per set of NFA
+// states, and cached; only then does a Pike VM walk the NFA to find the
+// leftmost-first match and its capture groups. A literal that every match has
+// to contain is extracted so callers can skip text without it up front.
+//
+// Syntax: literals, ., [...] and [^...] with ranges, \d \w \s \D \W \S,
+// \t \n \r \f \v \xHH, ^ $ \b \B, groups (...) and (?:...), |, and the
+// quantifiers * + ? {m} {m,} {m,n}, each optionally lazy with a trailing ?.
+//
+// Not thread-safe: searches reuse internal buffers and grow the DFA cache, so
+// each thread needs its own instance.
+class RegexEngine {
+public:
+    static constexpr size_t MAX_GROUPS = 10;  // $0 (the whole match) to $9
+    static constexpr size_t NPOS = static_cast<size_t>(-1);
+
+    struct Match {
+        std::array<size_t, MAX_GROUPS> start;
+        std::array<size_t, MAX_GROUPS> end;
+
+        std::string_view group(std::string_view text, size_t index) const;
+    };
+
+    // Throws std::invalid_argument describing the problem if the pattern is malformed
+    RegexEngine(const std::string& pattern, bool ignore_case);
+
+    // Finds the leftmost-first match that starts at or after 'from'; ^ and $
+    // match at the start and end of 'text' only
+    bool search(std::string_view text, size_t from, Match& match) const;
+
+    // True if text contains a match; DFA only, no captures
+    bool contains(std::string_view text) const;
+
+    // Every match contains this (lower case with ignore_case); may be empty
+    const std::string& requiredLiteral() const { return required_literal_; }
+
+    // Capture groups that can be referenced, including $0
+    size_t groups() const { return groups_; }
+
+private:
+    enum class Op : uint8_t { CLASS, SPLIT, JMP, SAVE, MATCH, BOL, EOL, WORD_BOUNDARY, NOT_WORD_BOUNDARY };
+
+    struct Inst {
+        Op op;
+        uint32_t x = 0;  // next instruction; preferred branch of SPLIT
+        uint32_t y = 0;  // other branch of SPLIT; class of CLASS; slot of SAVE
+    };
+
+    struct DfaState {
+        std::vector<uint32_t> pcs;  // consuming, MATCH and pending EOL instructions
+        bool match = false;         // a match ends here
+        bool match_at_end = false;  // a match ends here if the text does
+        std::array<int32_t, 256> next;
+    };
+
+    std::vector<Inst> program_;
+    std::vector<std::bitset<256>> classes_;
+    std::string required_literal_;
+    size_t groups_ = 1;
+    bool uses_dfa_ = true;  // word boundaries need the Pike VM
+    std::bitset<256> first_bytes_;  // bytes a match can start with; all if it can be empty
+
+    // Lazily built DFA
+    mutable std::vector<DfaState> dfa_states_;
+    mutable std::unordered_map<std::string, int32_t> dfa_index_;
+    mutable int32_t dfa_start_[2] = {-1, -1};  // mid-text, start of text
+
+    // Pike VM thread lists, reused between searches
+    struct ThreadList {
+        std::vector<uint32_t> dense;
+        std::vector<uint32_t> sparse;
+        std::vector<size_t> captures;  // per instruction
+        size_t size = 0;
+    };
+    mutable ThreadList lists_[2];
+    mutable std::vector<size_t> scratch_;
+    struct StackEntry {
+        uint32_t pc;
+        uint32_t slot;  // restore scratch_[slot] to 'value' instead of following pc
+        size_t value;
+    };
+    mutable std::vector<StackEntry> stack_;
+
+    bool dfaContains(std::string_view text, size_t from) const;
+    int32_t dfaStart(bool at_start) const;
+    int32_t dfaNext(int32_t state, unsigned char byte) const;
+    int32_t dfaState(std::vector<uint32_t>& pcs) const;
+    void dfaClosure(uint32_t pc, bool at_start, bool at_end, std::vector<uint32_t>& pcs,
+                    std::vector<bool>& seen) const;
+
+    void addThread(ThreadList& list, uint32_t pc, std::string_view text, size_t pos, const size_t* captures) const;
+    bool pikeSearch(std::string_view text, size_t from, Match& match) const;
+
+    friend class RegexCompiler;
+};
@@ -0,0 +1,229 @@
+#include "rename_plan.hpp"
+#include "fart_config.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <system_error>
+#include <thread>
+
+#ifdef _WIN32
+#include <cctype>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr size_t NONE = static_cast<size_t>(-1);
+
+// File names compare case-insensitively on Windows
+std::string nameKey(const std::string& name) {
+#ifdef _WIN32
+    std::string key(name);
+    std::transform(key.begin(), key.end(), key.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return key;
+#else
+    return name;
+#endif
+}
+
+#ifdef _WIN32
+using DirectoryHandle = const std::filesystem::path*;
+
+DirectoryHandle openDirectory(const std::filesystem::path& path) {
+    return &path;
+}
+
+void closeDirectory(DirectoryHandle) {
+}
+
+// Unlike MoveFileEx, the CRT's rename never replaces an existing file
+int renameNoReplace(DirectoryHandle dir, const std::string& from, const std::string& to) {
+    return _wrename((*dir / from).c_str(), (*dir / to).c_str()) == 0 ? 0 : errno;
+}
+#else
+using DirectoryHandle = int;
+
+DirectoryHandle openDirectory(const std::filesystem::path& path) {
+    return open(path.empty() ? "." : path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+void closeDirectory(DirectoryHandle dir) {
+    if (dir != -1) {
+        close(dir);
+    }
+}
+
+int renameNoReplace(DirectoryHandle dir, const std::string& from, const std::string& to) {
+#ifdef RENAME_NOREPLACE
+    if (renameat2(dir, from.c_str(), dir, to.c_str(), RENAME_NOREPLACE) == 0) {
+        return 0;
+    }
+    if (errno != EINVAL && errno != ENOSYS) {
+        return errno;
+    }
+#endif
+    // No atomic variant here (or on this file system): check, then rename
+    struct stat st;
+    if (fstatat(dir, to.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0) {
+        return EEXIST;
+    }
+    return renameat(dir, from.c_str(), dir, to.c_str()) == 0 ? 0 : errno;
+}
+#endif
+
+}  // namespace
+
+void RenamePlan::add(const std::filesystem::path& from, const std::string& to) {
+    auto parent = from.parent_path();
+    auto [it, inserted] = directory_index_.emplace(parent.string(), directories_.size());
+    if (inserted) {
+        Directory directory;
+        directory.path = parent;
+        directory.depth = static_cast<size_t>(std::distance(parent.begin(), parent.end()));
+        directories_.push_back(std::move(directory));
+    }
+    directories_[it->second].renames.push_back({from.filename().string(), to, size_++});
+}
+
+std::vector<RenamePlan::Outcome> RenamePlan::execute(bool dry_run, unsigned threads) {
+    std::vector<Outcome> outcomes(size_);
+    for (const auto& directory : directories_) {
+        for (const auto& rename : directory.renames) {
+            outcomes[rename.index].from = directory.path / rename.from;
+            outcomes[rename.index].to = rename.to;
+        }
+    }
+
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::stable_sort(directories_.begin(), directories_.end(),
+                     [](const Directory& a, const Directory& b) { return a.depth > b.depth; });
+
+    // Directories at the same depth cannot contain each other
+    for (size_t level = 0; level < directories_.size();) {
+        size_t end = level;
+        while (end < directories_.size() && directories_[end].depth == directories_[level].depth) {
+            end++;
+        }
+
+        std::atomic<size_t> next(level);
+        auto worker = [&]() {
+            for (size_t d; (d = next++) < end;) {
+                runDirectory(directories_[d], dry_run, outcomes);
+            }
+        };
+        std::vector<std::thread> pool;
+        for (size_t t = 1; t < std::min<size_t>(threads, end - level); t++) {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : pool) {
+            thread.join();
+        }
+        level = end;
+    }
+
+    directories_.clear();
+    directory_index_.clear();
+    size_ = 0;
+    return outcomes;
+}
+
+void RenamePlan::runDirectory(const Directory& directory, bool dry_run, std::vector<Outcome>& outcomes) {
+    const auto& renames = directory.renames;
+    size_t count = renames.size();
+
+    // A name claimed by two renames is given to neither
+    std::unordered_map<std::string, size_t> by_target, by_source;
+    std::vector<bool> skip(count);
+    for (size_t i = 0; i < count; i++) {
+        auto [it, inserted] = by_target.emplace(nameKey(renames[i].to), i);
+        if (!inserted) {
+            skip[i] = skip[it->second] = true;
+        }
+        by_source.emplace(nameKey(renames[i].from), i);
+    }
+
+    // next[i] is the rename that has to move renames[i].to out of the way first
+    std::vector<size_t> next(count, NONE);
+    for (size_t i = 0; i < count; i++) {
+        if (skip[i]) {
+            outcomes[renames[i].index].error = "another file would be renamed to " + renames[i].to;
+            continue;
+        }
+        auto it = by_source.find(nameKey(renames[i].to));
+        if (it != by_source.end() && !skip[it->second] && renames[i].from != renames[i].to) {
+            next[i] = it->second;
+        }
+    }
+
+    DirectoryHandle dir = dry_run ? DirectoryHandle() : openDirectory(directory.path);
+#ifndef _WIN32
+    if (!dry_run && dir == -1) {
+        std::string error = std::error_code(errno, std::generic_category()).message();
+        for (size_t i = 0; i < count; i++) {
+            if (!skip[i]) {
+                outcomes[renames[i].index].error = error;
+            }
+        }
+        return;
+    }
+#endif
+
+    auto step = [&](const std::string& from, const std::string& to) {
+        return dry_run || from == to ? 0 : renameNoReplace(dir, from, to);
+    };
+    auto finish = [&](size_t i, int error) {
+        auto& outcome = outcomes[renames[i].index];
+        outcome.renamed = error == 0;
+        if (error) {
+            outcome.error = std::error_code(error, std::generic_category()).message();
+        }
+    };
+
+    // Follow each chain to its end and rename back to front; a chain that
+    // comes back on itself is a cycle, broken by parking one name
+    enum : uint8_t { PLANNED, ON_CHAIN, DONE };
+    std::vector<uint8_t> state(count, PLANNED);
+    std::vector<size_t> chain;
+    for (size_t i = 0; i < count; i++) {
+        if (skip[i] || state[i] != PLANNED) {
+            continue;
+        }
+        chain.clear();
+        size_t j = i;
+        while (j != NONE && state[j] == PLANNED) {
+            state[j] = ON_CHAIN;
+            chain.push_back(j);
+            j = next[j];
+        }
+
+        size_t parked = j != NONE && state[j] == ON_CHAIN ? j : NONE;
+        std::string parking;
+        int parked_error = 0;
+        if (parked != NONE) {
+            parking = renames[parked].from + FartConfig::STAGED_SUFFIX;
+            parked_error = step(renames[parked].from, parking);
+        }
+
+        for (auto c = chain.rbegin(); c != chain.rend(); ++c) {
+            if (*c == parked) {
+                finish(*c, parked_error ? parked_error : step(parking, renames[*c].to));
+            } else {
+                finish(*c, parked_error ? EBUSY : step(renames[*c].from, renames[*c].to));
+            }
+            state[*c] = DONE;
+        }
+    }
+
+    if (!dry_run) {
+        closeDirectory(dir);
+    }
+}
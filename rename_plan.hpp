@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Filename renames collected during a walk and carried out afterwards, so a
+// renamed file is never visited again and cannot clobber a file that has not
+// been looked at yet. The renames in a directory are checked against each
+// other: a name claimed by two renames goes to neither, chains (a => b, b => c)
+// run back to front and cycles (a => b, b => a) go through a temporary name.
+// Every rename is relative to an open directory and never replaces an existing
+// entry. Directories run deepest first, so a path stays valid until everything
+// below it has been renamed; directories at the same depth run in parallel.
+class RenamePlan {
+public:
+    struct Outcome {
+        std::filesystem::path from;
+        std::string to;
+        bool renamed = false;
+        std::string error;
+    };
+
+    void add(const std::filesystem::path& from, const std::string& to);
+
+    size_t size() const { return size_; }
+
+    // Carries out the plan (dry_run only checks it) using up to 'threads'
+    // threads, 0 for one per core. Outcomes are in the order the renames were
+    // added; the plan is empty afterwards.
+    std::vector<Outcome> execute(bool dry_run, unsigned threads = 0);
+
+private:
+    struct Rename {
+        std::string from;
+        std::string to;
+        size_t index;  // into the outcomes
+    };
+
+    struct Directory {
+        std::filesystem::path path;
+        size_t depth = 0;
+        std::vector<Rename> renames;
+    };
+
+    std::vector<Directory> directories_;
+    std::unordered_map<std::string, size_t> directory_index_;
+    size_t size_ = 0;
+
+    static void runDirectory(const Directory& directory, bool dry_run, std::vector<Outcome>& outcomes);
+};
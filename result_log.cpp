@@ -0,0 +1,235 @@
+#include "result_log.hpp"
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+
+bool ResultLog::open(const std::string& path, const FartConfig& config) {
+    path_ = path;
+    out_.open(path, std::ios::binary | std::ios::trunc);
+    if (!out_.is_open()) {
+        return false;
+    }
+
+    const auto& options = config.getOptions();
+    out_ << "{\"fart\":" << encode(FartConfig::VERSION) << ",\"mode\":" << encode(modeName(config));
+    if (options.shard_count) {
+        out_ << ",\"shard\":\"" << options.shard_index + 1 << "/" << options.shard_count << "\"";
+    }
+    out_ << "}\n";
+    return out_.good();
+}
+
+void ResultLog::add(const std::string& file, int matches) {
+    out_ << "{\"file\":" << encode(file) << ",\"matches\":" << matches << "}\n";
+}
+
+bool ResultLog::finish(int files, int matches) {
+    out_ << "{\"files\":" << files << ",\"matches\":" << matches << "}\n";
+    out_.close();
+    return !out_.fail();
+}
+
+const char* ResultLog::modeName(const FartConfig& config) {
+    if (config.isFindMode()) {
+        return "find";
+    }
+    return config.isGrepMode() ? "grep" : "fart";
+}
+
+std::string ResultLog::encode(std::string_view text) {
+    std::string out;
+    out.reserve(text.size() + 2);
+    out += '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else if (c == '\t') {
+            out += "\\t";
+        } else if (c == '\r') {
+            out += "\\r";
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", static_cast<unsigned char>(c));
+            out += escape;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+    return out;
+}
+
+bool ResultLog::decode(std::string_view line, std::unordered_map<std::string, std::string>& fields) {
+    size_t pos = 0;
+    auto skip_space = [&]() {
+        while (pos < line.size() && (line[pos] == ' ' || line[pos] == '\t' || line[pos] == '\r')) {
+            pos++;
+        }
+    };
+    auto parse_string = [&](std::string& out) {
+        if (pos >= line.size() || line[pos] != '"') {
+            return false;
+        }
+        out.clear();
+        for (pos++; pos < line.size() && line[pos] != '"'; pos++) {
+            if (line[pos] != '\\') {
+                out += line[pos];
+                continue;
+            }
+            if (++pos >= line.size()) {
+                return false;
+            }
+            switch (line[pos]) {
+                case 'n': out += '\n'; break;
+                case 't': out += '\t'; break;
+                case 'r': out += '\r'; break;
+                case 'u': {
+                    if (pos + 4 >= line.size()) {
+                        return false;
+                    }
+                    std::string hex(line.substr(pos + 1, 4));
+                    char* end;
+                    long value = std::strtol(hex.c_str(), &end, 16);
+                    if (*end || value > 0xff) {
+                        return false;  // only control characters are written this way
+                    }
+                    out += static_cast<char>(value);
+                    pos += 4;
+                    break;
+                }
+                default: out += line[pos]; break;
+            }
+        }
+        return pos++ < line.size();
+    };
+
+    fields.clear();
+    skip_space();
+    if (pos >= line.size() || line[pos++] != '{') {
+        return false;
+    }
+    skip_space();
+    if (pos < line.size() && line[pos] == '}') {
+        return true;
+    }
+    while (true) {
+        std::string key, value;
+        skip_space();
+        if (!parse_string(key)) {
+            return false;
+        }
+        skip_space();
+        if (pos >= line.size() || line[pos++] != ':') {
+            return false;
+        }
+        skip_space();
+        if (pos < line.size() && line[pos] == '"') {
+            if (!parse_string(value)) {
+                return false;
+            }
+        } else {
+            size_t start = pos;
+            while (pos < line.size() && (std::isdigit(static_cast<unsigned char>(line[pos])) || line[pos] == '-')) {
+                pos++;
+            }
+            if (pos == start) {
+                return false;
+            }
+            value = line.substr(start, pos - start);
+        }
+        fields[key] = value;
+        skip_space();
+        if (pos < line.size() && line[pos] == ',') {
+            pos++;
+            continue;
+        }
+        return pos < line.size() && line[pos] == '}';
+    }
+}
+
+bool ResultLog::merge(const std::string& path, Summary& summary, std::string& error) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        error = "Could not open file: " + path;
+        return false;
+    }
+
+    std::unordered_map<std::string, std::string> fields;
+    std::string line;
+    int line_number = 0;
+    bool header = true;
+    bool finished = false;
+    while (std::getline(in, line)) {
+        line_number++;
+        if (!decode(line, fields) || finished) {
+            error = path + ":" + std::to_string(line_number) + ": not a result record";
+            return false;
+        }
+
+        if (header) {
+            header = false;
+            if (!fields.count("fart") || !fields.count("mode")) {
+                error = path + " is not a result log";
+                return false;
+            }
+            if (!summary.mode.empty() && summary.mode != fields["mode"]) {
+                error = path + " is from a " + fields["mode"] + " run, not " + summary.mode;
+                return false;
+            }
+            summary.mode = fields["mode"];
+
+            unsigned shard = 0, count = 0;
+            if (fields.count("shard") && std::sscanf(fields["shard"].c_str(), "%u/%u", &shard, &count) != 2) {
+                error = path + ": bad shard " + fields["shard"];
+                return false;
+            }
+            if (summary.logs++ && count != summary.shard_count) {
+                error = path + " is from a sweep with other shards than the logs before it";
+                return false;
+            }
+            if (count) {
+                summary.shard_count = count;
+                summary.shards.resize(count);
+                if (shard < 1 || shard > count) {
+                    error = path + ": bad shard " + fields["shard"];
+                    return false;
+                }
+                if (summary.shards[shard - 1]) {
+                    error = path + ": shard " + fields["shard"] + " given twice";
+                    return false;
+                }
+                summary.shards[shard - 1] = true;
+            }
+        } else if (fields.count("file")) {
+            const std::string& file = fields["file"];
+            if (!summary.seen_files.insert(file).second) {
+                error = file + " appears in more than one result log";
+                return false;
+            }
+            summary.file_matches.emplace_back(file, std::atoi(fields["matches"].c_str()));
+        } else if (fields.count("files")) {
+            summary.files += std::atoi(fields["files"].c_str());
+            summary.matches += std::atoi(fields["matches"].c_str());
+            finished = true;
+        }
+    }
+
+    if (!finished) {
+        error = path + " was cut short (no totals record)";
+        return false;
+    }
+    return true;
+}
+
+bool ResultLog::complete(const Summary& summary, std::string& error) {
+    for (size_t i = 0; i < summary.shards.size(); i++) {
+        if (!summary.shards[i]) {
+            error = "Missing shard " + std::to_string(i + 1) + "/" + std::to_string(summary.shard_count);
+            return false;
+        }
+    }
+    return true;
+}
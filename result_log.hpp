@@ -0,0 +1,62 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "fart_config.hpp"
+
+// Per-file results of a run as JSON lines (--emit-results), so the runs of a
+// sharded sweep can be combined by --merge into the summary one run prints:
+//
+//   {"fart":"v1.99d","mode":"grep","shard":"1/4"}
+//   {"file":"src/a.c","matches":3}
+//   {"files":1,"matches":3}
+//
+// The last record holds the run's totals; a log without it was cut short.
+class ResultLog {
+public:
+    struct Summary {
+        std::string mode;
+        int files = 0;
+        int matches = 0;
+        std::vector<std::pair<std::string, int>> file_matches;
+
+        // Logs and shards merged so far, to tell a missing or repeated one
+        int logs = 0;
+        unsigned shard_count = 0;
+        std::vector<bool> shards;
+        std::unordered_set<std::string> seen_files;
+    };
+
+    // Writes the header record; false if the file cannot be created
+    bool open(const std::string& path, const FartConfig& config);
+
+    void add(const std::string& file, int matches);
+
+    // Writes the totals and closes the log; false on a write error
+    bool finish(int files, int matches);
+
+    const std::string& path() const { return path_; }
+
+    // Adds the log at path to summary; false with error set if it cannot be
+    // read, was cut short or does not fit the logs merged before it
+    static bool merge(const std::string& path, Summary& summary, std::string& error);
+
+    // Checks that every shard of a sharded sweep was merged
+    static bool complete(const Summary& summary, std::string& error);
+
+    static const char* modeName(const FartConfig& config);
+
+    static std::string encode(std::string_view text);
+
+    // Parses one record into its fields, string values unescaped
+    static bool decode(std::string_view line, std::unordered_map<std::string, std::string>& fields);
+
+private:
+    std::string path_;
+    std::ofstream out_;
+};
@@ -0,0 +1,238 @@
+#include "tar_reader.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// Header fields: offset and length
+constexpr size_t NAME = 0, NAME_SIZE = 100;
+constexpr size_t SIZE = 124, SIZE_SIZE = 12;
+constexpr size_t CHECKSUM = 148, CHECKSUM_SIZE = 8;
+constexpr size_t TYPE = 156;
+constexpr size_t MAGIC = 257;
+constexpr size_t PREFIX = 345, PREFIX_SIZE = 155;
+
+// Longest pax header or GNU long name read; anything longer is corrupt
+constexpr uint64_t MAX_META_SIZE = 1 << 20;
+
+std::string_view field(const char* header, size_t offset, size_t size) {
+    std::string_view text(header + offset, size);
+    return text.substr(0, text.find('\0'));
+}
+
+bool endsWith(std::string_view text, std::string_view suffix) {
+    return text.size() >= suffix.size() && text.substr(text.size() - suffix.size()) == suffix;
+}
+
+}  // namespace
+
+bool TarReader::parseNumber(std::string_view field, uint64_t& value) {
+    value = 0;
+    // GNU base-256 for sizes of 8 GiB and more
+    if (!field.empty() && (static_cast<unsigned char>(field[0]) & 0x80)) {
+        for (size_t i = 1; i < field.size(); i++) {
+            if (value >> 56) {
+                return false;
+            }
+            value = (value << 8) | static_cast<unsigned char>(field[i]);
+        }
+        return true;
+    }
+    size_t i = 0;
+    while (i < field.size() && field[i] == ' ') {
+        i++;
+    }
+    bool digits = false;
+    for (; i < field.size() && field[i] >= '0' && field[i] <= '7'; i++) {
+        value = value * 8 + static_cast<uint64_t>(field[i] - '0');
+        digits = true;
+    }
+    for (; i < field.size(); i++) {
+        if (field[i] != ' ' && field[i] != '\0') {
+            return false;
+        }
+    }
+    return digits;
+}
+
+bool TarReader::isTar(std::string_view head) {
+    if (head.size() < BLOCK_SIZE || head.substr(MAGIC, 5) != "ustar") {
+        return false;
+    }
+    // The checksum counts its own field as spaces
+    uint64_t expected;
+    if (!parseNumber(field(head.data(), CHECKSUM, CHECKSUM_SIZE), expected)) {
+        return false;
+    }
+    uint64_t sum = 0;
+    for (size_t i = 0; i < BLOCK_SIZE; i++) {
+        bool in_checksum = i >= CHECKSUM && i < CHECKSUM + CHECKSUM_SIZE;
+        sum += in_checksum ? ' ' : static_cast<unsigned char>(head[i]);
+    }
+    return sum == expected;
+}
+
+bool TarReader::isArchiveName(std::string_view name) {
+    for (std::string_view suffix : {".tar", ".tar.gz", ".tgz", ".tar.zst", ".tzst"}) {
+        if (endsWith(name, suffix)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void TarReader::readFully(char* buffer, size_t size) {
+    while (size > 0) {
+        size_t bytes = source_(buffer, size);
+        if (bytes == 0) {
+            throw std::runtime_error("truncated tar archive");
+        }
+        buffer += bytes;
+        size -= bytes;
+    }
+}
+
+void TarReader::skip(uint64_t size) {
+    scratch_.resize(64 * 1024);
+    while (size > 0) {
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(size, scratch_.size()));
+        readFully(scratch_.data(), chunk);
+        size -= chunk;
+    }
+}
+
+std::string TarReader::readString(uint64_t size) {
+    if (size > MAX_META_SIZE) {
+        throw std::runtime_error("corrupt tar archive");
+    }
+    std::string text(static_cast<size_t>(size), '\0');
+    readFully(text.data(), text.size());
+    skip((BLOCK_SIZE - size % BLOCK_SIZE) % BLOCK_SIZE);
+    return text;
+}
+
+void TarReader::parsePax(std::string_view records, std::string& path, uint64_t& size, bool& has_size) {
+    // Records are "<length> <key>=<value>\n", the length counting the whole record
+    while (!records.empty()) {
+        size_t space = records.find(' ');
+        uint64_t length = 0;
+        for (size_t i = 0; i < space && i < records.size(); i++) {
+            if (records[i] < '0' || records[i] > '9') {
+                throw std::runtime_error("corrupt tar archive");
+            }
+            length = length * 10 + static_cast<uint64_t>(records[i] - '0');
+        }
+        if (space == std::string_view::npos || length <= space + 1 || length > records.size()) {
+            throw std::runtime_error("corrupt tar archive");
+        }
+        std::string_view record = records.substr(space + 1, static_cast<size_t>(length) - space - 2);
+        records.remove_prefix(static_cast<size_t>(length));
+
+        size_t equals = record.find('=');
+        std::string_view key = record.substr(0, equals);
+        std::string_view value = equals == std::string_view::npos ? std::string_view() : record.substr(equals + 1);
+        if (key == "path") {
+            path = value;
+        } else if (key == "size") {
+            size = 0;
+            for (char c : value) {
+                if (c < '0' || c > '9') {
+                    throw std::runtime_error("corrupt tar archive");
+                }
+                size = size * 10 + static_cast<uint64_t>(c - '0');
+            }
+            has_size = true;
+        }
+    }
+}
+
+bool TarReader::next(Member& member) {
+    skip(remaining_ + padding_);
+    remaining_ = padding_ = 0;
+
+    // Set by pax and GNU headers for the entry that follows them
+    std::string long_name;
+    uint64_t pax_size = 0;
+    bool has_pax_size = false;
+
+    char header[BLOCK_SIZE];
+    while (true) {
+        size_t bytes = source_(header, BLOCK_SIZE);
+        if (bytes == 0) {
+            return false;  // no end-of-archive blocks, as some writers do
+        }
+        if (bytes < BLOCK_SIZE) {
+            readFully(header + bytes, BLOCK_SIZE - bytes);
+        }
+        if (std::all_of(header, header + BLOCK_SIZE, [](char c) { return c == '\0'; })) {
+            return false;
+        }
+        if (!isTar(std::string_view(header, BLOCK_SIZE))) {
+            throw std::runtime_error("corrupt tar archive");
+        }
+
+        uint64_t size;
+        if (!parseNumber(field(header, SIZE, SIZE_SIZE), size)) {
+            throw std::runtime_error("corrupt tar archive");
+        }
+        char type = header[TYPE];
+
+        if (type == 'x') {
+            parsePax(readString(size), long_name, pax_size, has_pax_size);
+            continue;
+        }
+        if (type == 'L') {
+            long_name = readString(size);
+            long_name = long_name.substr(0, long_name.find('\0'));
+            continue;
+        }
+        if (type == 'g' || type == 'K') {
+            // Global pax settings and long link targets do not name anything
+            skip(size + (BLOCK_SIZE - size % BLOCK_SIZE) % BLOCK_SIZE);
+            continue;
+        }
+        if (has_pax_size) {
+            size = pax_size;
+        }
+        if (type >= '1' && type <= '6') {
+            size = 0;  // links, devices, directories and FIFOs have no data
+        }
+        uint64_t padding = (BLOCK_SIZE - size % BLOCK_SIZE) % BLOCK_SIZE;
+
+        // Regular files only: '0', its old spelling '\0', and contiguous files
+        if (type != '0' && type != '\0' && type != '7') {
+            skip(size + padding);
+            long_name.clear();
+            has_pax_size = false;
+            continue;
+        }
+
+        if (!long_name.empty()) {
+            member.name = long_name;
+        } else {
+            // Old GNU archives ("ustar  ") keep other fields where POSIX has the prefix
+            bool posix = std::string_view(header + MAGIC, 6) == std::string_view("ustar\0", 6);
+            std::string_view prefix = posix ? field(header, PREFIX, PREFIX_SIZE) : std::string_view();
+            member.name = prefix.empty() ? std::string() : std::string(prefix) + "/";
+            member.name += field(header, NAME, NAME_SIZE);
+        }
+        member.size = size;
+        remaining_ = size;
+        padding_ = padding;
+        return true;
+    }
+}
+
+size_t TarReader::read(char* buffer, size_t size) {
+    size = static_cast<size_t>(std::min<uint64_t>(size, remaining_));
+    if (size == 0) {
+        return 0;
+    }
+    size_t bytes = source_(buffer, size);
+    if (bytes == 0) {
+        throw std::runtime_error("truncated tar archive");
+    }
+    remaining_ -= bytes;
+    return bytes;
+}
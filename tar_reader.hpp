@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Streams the regular files of a tar archive (ustar, pax and GNU long
+// names) from whatever reads the archive, so --search-archives matches its
+// members without extracting them anywhere.
+class TarReader {
+public:
+    static constexpr size_t BLOCK_SIZE = 512;
+
+    // Reads up to size bytes of the archive; 0 at its end
+    using Source = std::function<size_t(char* buffer, size_t size)>;
+
+    struct Member {
+        std::string name;  // path within the archive
+        uint64_t size = 0;
+    };
+
+    // Whether head, the first block of a stream, is a tar header
+    static bool isTar(std::string_view head);
+
+    // Whether name is that of a tar archive, compressed or not
+    static bool isArchiveName(std::string_view name);
+
+    explicit TarReader(Source source) : source_(std::move(source)) {}
+
+    // Moves to the next regular file, skipping what is left of the current
+    // one; false at the end of the archive. Throws std::runtime_error on a
+    // corrupt or truncated archive.
+    bool next(Member& member);
+
+    // Up to size bytes of the current member; 0 at its end
+    size_t read(char* buffer, size_t size);
+
+private:
+    Source source_;
+    uint64_t remaining_ = 0;  // of the current member's data
+    uint64_t padding_ = 0;    // after it, up to the next block
+    std::vector<char> scratch_;
+
+    void readFully(char* buffer, size_t size);
+    void skip(uint64_t size);
+    std::string readString(uint64_t size);
+
+    static bool parseNumber(std::string_view field, uint64_t& value);
+    static void parsePax(std::string_view records, std::string& path, uint64_t& size, bool& has_size);
+};
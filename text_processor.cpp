@@ -1,6 +1,8 @@
 #include "text_processor.hpp"
+#include "fart_trace.hpp"
 #include <algorithm>
 #include <cctype>
+#include <cstdint>
 #include <sstream>
 #include <iomanip>
 
@@ -9,7 +11,16 @@ TextProcessor::TextProcessor(const FartConfig& config)
     
     find_string_normalized_ = config_.getFindString();
     
-    if (config_.getOptions().c_style) {
+    if (config_.getOptions().regex && !find_string_normalized_.empty()) {
+        // The pattern has its own escapes, so -C does not apply; -w becomes \b
+        std::string pattern = find_string_normalized_;
+        if (config_.getOptions().whole_word) {
+            pattern = "\\b(?:" + pattern + ")\\b";
+        }
+        regex_ = std::make_unique<RegexEngine>(pattern, config_.getOptions().ignore_case);
+        find_string_normalized_ = regex_->requiredLiteral();
+        splitReplacement(config_.getReplaceString());
+    } else if (config_.getOptions().c_style) {
         find_string_normalized_ = expandCStyleEscapes(find_string_normalized_);
     }
     
@@ -17,45 +28,75 @@ TextProcessor::TextProcessor(const FartConfig& config)
         find_string_normalized_ = toLowerCase(find_string_normalized_);
     }
     
+    // With --regex and no groups the replacement is still fixed, once $$ is resolved
+    std::string replacement = config_.getReplaceString();
+    if (regex_ && !replacement_has_groups_) {
+        replacement = replacement_pieces_.empty() ? "" : replacement_pieces_[0].literal;
+    }
+    for (auto& adapted : adapted_replacements_) {
+        adapted = replacement;
+    }
     if (config_.getOptions().adapt_case) {
-        replace_string_lower_ = toLowerCase(config_.getReplaceString());
-        replace_string_upper_ = toUpperCase(config_.getReplaceString());
+        adapted_replacements_[static_cast<size_t>(CaseType::LOWER)] = toLowerCase(replacement);
+        adapted_replacements_[static_cast<size_t>(CaseType::UPPER)] = toUpperCase(replacement);
+        adapted_replacements_[static_cast<size_t>(CaseType::TITLE)] = toTitleCase(replacement);
     }
 }
 
-std::vector<TextProcessor::FindResult> TextProcessor::findMatches(const std::string& text) const {
-    std::vector<FindResult> results;
+template <typename OnMatch>
+void TextProcessor::forEachMatch(std::string_view text, OnMatch&& on_match) const {
+    FART_TRACE_SCOPE("findMatches");
+    
+    if (regex_) {
+        // A line without the required literal cannot match
+        if (!find_string_normalized_.empty() &&
+            normalizeForComparison(text).find(find_string_normalized_) == std::string_view::npos) {
+            return;
+        }
+        size_t from = 0;
+        while (regex_->search(text, from, regex_match_)) {
+            size_t pos = regex_match_.start[0];
+            size_t length = regex_match_.end[0] - pos;
+            on_match(pos, length);
+            from = pos + std::max<size_t>(length, 1);  // step past an empty match
+        }
+        return;
+    }
     
     if (find_string_normalized_.empty()) {
-        return results;
+        return;
     }
     
-    std::string search_text = normalizeForComparison(text);
+    std::string_view search_text = normalizeForComparison(text);
+    const size_t length = find_string_normalized_.length();
     size_t pos = 0;
     
-    while ((pos = search_text.find(find_string_normalized_, pos)) != std::string::npos) {
+    while ((pos = search_text.find(find_string_normalized_, pos)) != std::string_view::npos) {
         if (config_.getOptions().whole_word) {
             if (!isWordBoundary(search_text, pos) || 
-                !isWordBoundary(search_text, pos + find_string_normalized_.length())) {
+                !isWordBoundary(search_text, pos + length)) {
                 pos++;
                 continue;
             }
         }
         
+        on_match(pos, length);
+        pos += length;
+    }
+}
+
+std::vector<TextProcessor::FindResult> TextProcessor::findMatches(const std::string& text) const {
+    std::vector<FindResult> results;
+    
+    forEachMatch(text, [&](size_t pos, size_t length) {
         FindResult result;
         result.position = pos;
-        result.length = find_string_normalized_.length();
+        result.length = length;
         
-        if (config_.getOptions().adapt_case) {
-            std::string original_match = text.substr(pos, result.length);
-            result.replacement = adaptCase(config_.getReplaceString(), original_match);
-        } else {
-            result.replacement = config_.getReplaceString();
-        }
+        appendReplacement(text, pos, length, result.replacement);
         
         results.push_back(result);
-        pos += find_string_normalized_.length();
-    }
+    });
     
     return results;
 }
@@ -68,32 +109,99 @@ std::string TextProcessor::processLine(const std::string& line, int& match_count
         return line;
     }
     
-    auto matches = findMatches(line);
-    match_count = static_cast<int>(matches.size());
-    
-    if (matches.empty()) {
-        return line;
-    }
-    
     std::string result;
+    result.reserve(line.size());
+    match_count = replaceLine(line, result);
+    return result;
+}
+
+int TextProcessor::replaceLine(std::string_view line, std::string& output) const {
+    int count = 0;
     size_t last_pos = 0;
     
-    for (const auto& match : matches) {
-        result += line.substr(last_pos, match.position - last_pos);
-        result += match.replacement;
-        last_pos = match.position + match.length;
+    forEachMatch(line, [&](size_t pos, size_t length) {
+        output.append(line, last_pos, pos - last_pos);
+        appendReplacement(line, pos, length, output);
+        last_pos = pos + length;
+        count++;
+    });
+    
+    output.append(line, last_pos, std::string_view::npos);
+    return count;
+}
+
+int TextProcessor::countMatches(std::string_view text) const {
+    int count = 0;
+    forEachMatch(text, [&](size_t, size_t) { count++; });
+    return count;
+}
+
+void TextProcessor::findMatchingLines(std::string_view text,
+                                      std::vector<std::pair<size_t, size_t>>& lines) const {
+    FART_TRACE_SCOPE("findMatchingLines");
+    
+    if (regex_) {
+        findMatchingRegexLines(text, lines);
+        return;
     }
     
-    result += line.substr(last_pos);
-    return result;
+    if (find_string_normalized_.empty()) {
+        return;
+    }
+    
+    std::string_view search_text = normalizeForComparison(text);
+    const size_t length = find_string_normalized_.length();
+    size_t pos = 0;
+    
+    while ((pos = search_text.find(find_string_normalized_, pos)) != std::string_view::npos) {
+        size_t end = search_text.find('\n', pos);
+        if (end == std::string_view::npos) {
+            end = search_text.size();
+        }
+        // A line end is a word boundary too, so whole-word matches agree with per-line matching
+        if ((end < pos + length) ||
+            (config_.getOptions().whole_word &&
+             (!isWordBoundary(search_text, pos) || !isWordBoundary(search_text, pos + length)))) {
+            pos++;
+            continue;
+        }
+        
+        size_t start = pos == 0 ? std::string_view::npos : search_text.rfind('\n', pos - 1);
+        lines.emplace_back(start == std::string_view::npos ? 0 : start + 1, end);
+        pos = end + 1;
+    }
 }
 
-int TextProcessor::countMatches(const std::string& text) const {
-    auto matches = findMatches(text);
-    return static_cast<int>(matches.size());
+void TextProcessor::findMatchingRegexLines(std::string_view text,
+                                           std::vector<std::pair<size_t, size_t>>& lines) const {
+    auto check = [&](size_t start) {
+        size_t end = text.find('\n', start);
+        if (end == std::string_view::npos) {
+            end = text.size();
+        }
+        if (regex_->contains(text.substr(start, end - start))) {
+            lines.emplace_back(start, end);
+        }
+        return end + 1;
+    };
+    
+    if (find_string_normalized_.empty()) {
+        for (size_t start = 0; start < text.size();) {
+            start = check(start);
+        }
+        return;
+    }
+    
+    // Only lines holding the required literal go to the DFA
+    std::string_view search_text = normalizeForComparison(text);
+    size_t pos = 0;
+    while ((pos = search_text.find(find_string_normalized_, pos)) != std::string_view::npos) {
+        size_t start = pos == 0 ? std::string_view::npos : text.rfind('\n', pos - 1);
+        pos = check(start == std::string_view::npos ? 0 : start + 1);
+    }
 }
 
-bool TextProcessor::isWordBoundary(const std::string& text, size_t pos) const {
+bool TextProcessor::isWordBoundary(std::string_view text, size_t pos) const {
     if (pos == 0 || pos >= text.length()) {
         return true;
     }
@@ -101,18 +209,76 @@ bool TextProcessor::isWordBoundary(const std::string& text, size_t pos) const {
     return !isWordChar(text[pos - 1]) || !isWordChar(text[pos]);
 }
 
-std::string TextProcessor::adaptCase(const std::string& replacement, const std::string& original) const {
-    CaseType case_type = analyzeCaseType(original);
+const std::string& TextProcessor::adaptedReplacement(std::string_view match) const {
+    if (!config_.getOptions().adapt_case) {
+        return adapted_replacements_[static_cast<size_t>(CaseType::NONE)];
+    }
+    return adapted_replacements_[static_cast<size_t>(analyzeCaseType(match))];
+}
+
+void TextProcessor::appendReplacement(std::string_view text, size_t pos, size_t length,
+                                      std::string& output) const {
+    std::string_view match = text.substr(pos, length);
+    if (!replacement_has_groups_) {
+        output += adaptedReplacement(match);
+        return;
+    }
+    
+    // Only valid inside forEachMatch: regex_match_ is the current match
+    size_t mark = output.size();
+    for (const auto& piece : replacement_pieces_) {
+        if (piece.group == RegexEngine::NPOS) {
+            output += piece.literal;
+        } else {
+            output += regex_match_.group(text, piece.group);
+        }
+    }
     
-    switch (case_type) {
+    if (!config_.getOptions().adapt_case) {
+        return;
+    }
+    auto expanded = output.begin() + static_cast<std::ptrdiff_t>(mark);
+    switch (analyzeCaseType(match)) {
         case CaseType::LOWER:
-            return toLowerCase(replacement);
+            std::transform(expanded, output.end(), expanded, ::tolower);
+            break;
         case CaseType::UPPER:
-            return toUpperCase(replacement);
-        case CaseType::MIXED:
-        case CaseType::NONE:
+            std::transform(expanded, output.end(), expanded, ::toupper);
+            break;
+        case CaseType::TITLE: {
+            auto first = std::find_if(expanded, output.end(), [](unsigned char c) { return std::isalpha(c); });
+            if (first != output.end()) {
+                *first = static_cast<char>(std::toupper(static_cast<unsigned char>(*first)));
+            }
+            break;
+        }
         default:
-            return replacement;
+            break;
+    }
+}
+
+void TextProcessor::splitReplacement(const std::string& replacement) {
+    // $0..$9 insert a group (one that did not take part inserts nothing), $$ is a dollar sign
+    std::string literal;
+    for (size_t i = 0; i < replacement.size(); ++i) {
+        char next = i + 1 < replacement.size() ? replacement[i + 1] : '\0';
+        if (replacement[i] == '$' && next >= '0' && next <= '9') {
+            if (!literal.empty()) {
+                replacement_pieces_.push_back({literal, RegexEngine::NPOS});
+                literal.clear();
+            }
+            replacement_pieces_.push_back({"", static_cast<size_t>(next - '0')});
+            replacement_has_groups_ = true;
+            ++i;
+        } else if (replacement[i] == '$' && next == '$') {
+            literal += '$';
+            ++i;
+        } else {
+            literal += replacement[i];
+        }
+    }
+    if (!literal.empty()) {
+        replacement_pieces_.push_back({literal, RegexEngine::NPOS});
     }
 }
 
@@ -194,40 +360,66 @@ std::string TextProcessor::toUpperCase(const std::string& str) {
     return result;
 }
 
-TextProcessor::CaseType TextProcessor::analyzeCaseType(const std::string& text) const {
-    int upper_count = 0;
-    int lower_count = 0;
-    
-    for (char c : text) {
-        if (std::isupper(c)) {
-            upper_count++;
-        } else if (std::islower(c)) {
-            lower_count++;
-        }
+std::string TextProcessor::toTitleCase(const std::string& str) {
+    // Only the first letter changes, so "MyClass" stays as it is
+    std::string result = str;
+    auto first = std::find_if(result.begin(), result.end(), [](unsigned char c) { return std::isalpha(c); });
+    if (first != result.end()) {
+        *first = static_cast<char>(std::toupper(static_cast<unsigned char>(*first)));
     }
-    
-    if (upper_count == 0 && lower_count == 0) {
-        return CaseType::NONE;
+    return result;
+}
+
+namespace {
+
+constexpr uint8_t CASE_UPPER = 1;
+constexpr uint8_t CASE_LOWER = 2;
+
+// Case bits of every byte, for the classifier's inner loop (ASCII letters, as in the C locale)
+constexpr std::array<uint8_t, 256> CASE_TABLE = [] {
+    std::array<uint8_t, 256> table{};
+    for (int c = 'A'; c <= 'Z'; c++) {
+        table[c] = CASE_UPPER;
+        table[c - 'A' + 'a'] = CASE_LOWER;
     }
-    
-    if (upper_count > 0 && lower_count == 0) {
-        return CaseType::UPPER;
+    return table;
+}();
+
+}  // namespace
+
+TextProcessor::CaseType TextProcessor::analyzeCaseType(std::string_view text) {
+    // 'seen' collects the case bits of all letters, 'rest' those after the first letter
+    unsigned seen = 0;
+    unsigned rest = 0;
+    for (char c : text) {
+        unsigned bits = CASE_TABLE[static_cast<unsigned char>(c)];
+        rest |= bits & (0u - (seen != 0));
+        seen |= bits;
     }
     
-    if (lower_count > 0 && upper_count == 0) {
-        return CaseType::LOWER;
+    switch (seen) {
+        case 0:
+            return CaseType::NONE;
+        case CASE_UPPER:
+            return CaseType::UPPER;
+        case CASE_LOWER:
+            return CaseType::LOWER;
+        default:
+            // Mixed; "Word" (an upper-case letter followed only by lower-case ones) is title case
+            return rest == CASE_LOWER ? CaseType::TITLE : CaseType::MIXED;
     }
-    
-    return CaseType::MIXED;
 }
 
 bool TextProcessor::isWordChar(char c) const {
     return std::isalnum(c) || c == '_';
 }
 
-std::string TextProcessor::normalizeForComparison(const std::string& text) const {
-    if (config_.getOptions().ignore_case) {
-        return toLowerCase(text);
+std::string_view TextProcessor::normalizeForComparison(std::string_view text) const {
+    if (!config_.getOptions().ignore_case) {
+        return text;
     }
-    return text;
+    
+    fold_buffer_.assign(text);
+    std::transform(fold_buffer_.begin(), fold_buffer_.end(), fold_buffer_.begin(), ::tolower);
+    return fold_buffer_;
 }
\ No newline at end of file
@@ -1,10 +1,16 @@
 #pragma once
 
+#include <array>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 #include <memory>
 #include "fart_config.hpp"
+#include "regex_engine.hpp"
 
+// Not thread-safe: matching reuses an internal case-folding buffer (and, with
+// --regex, the engine's buffers), so each thread needs its own instance.
 class TextProcessor {
 public:
     explicit TextProcessor(const FartConfig& config);
@@ -19,11 +25,20 @@ public:
     
     std::string processLine(const std::string& line, int& match_count) const;
     
-    int countMatches(const std::string& text) const;
+    // Appends line to output with all matches replaced; returns the number of matches.
+    // Does not allocate once output has enough capacity.
+    int replaceLine(std::string_view line, std::string& output) const;
     
-    bool isWordBoundary(const std::string& text, size_t pos) const;
+    int countMatches(std::string_view text) const;
     
-    std::string adaptCase(const std::string& replacement, const std::string& original) const;
+    // Appends the [start, end) range of every line in text (lines end at '\n')
+    // that contains a match, in one pass over the whole block
+    void findMatchingLines(std::string_view text, std::vector<std::pair<size_t, size_t>>& lines) const;
+    
+    bool isWordBoundary(std::string_view text, size_t pos) const;
+    
+    // The replace string in the case of the matched text (--adapt), or as given
+    const std::string& adaptedReplacement(std::string_view match) const;
     
     std::string expandCStyleEscapes(const std::string& input) const;
     
@@ -35,15 +50,36 @@ private:
         NONE,
         LOWER,
         UPPER, 
-        MIXED
+        MIXED,
+        TITLE,
+        COUNT
     };
     
     const FartConfig& config_;
     std::string find_string_normalized_;
-    std::string replace_string_lower_;
-    std::string replace_string_upper_;
+    // The replace string adapted to each case type, built once up front
+    std::array<std::string, static_cast<size_t>(CaseType::COUNT)> adapted_replacements_;
+    mutable std::string fold_buffer_;
+    
+    // --regex: the compiled pattern and the replace string split around $0..$9
+    struct ReplacementPiece {
+        std::string literal;
+        size_t group;  // RegexEngine::NPOS for literal text
+    };
+    std::unique_ptr<RegexEngine> regex_;
+    std::vector<ReplacementPiece> replacement_pieces_;
+    bool replacement_has_groups_ = false;
+    mutable RegexEngine::Match regex_match_;  // the match on_match is called for
+    
+    template <typename OnMatch>
+    void forEachMatch(std::string_view text, OnMatch&& on_match) const;
+    
+    void appendReplacement(std::string_view text, size_t pos, size_t length, std::string& output) const;
+    void splitReplacement(const std::string& replacement);
+    void findMatchingRegexLines(std::string_view text, std::vector<std::pair<size_t, size_t>>& lines) const;
     
-    CaseType analyzeCaseType(const std::string& text) const;
+    static CaseType analyzeCaseType(std::string_view text);
+    static std::string toTitleCase(const std::string& str);
     bool isWordChar(char c) const;
-    std::string normalizeForComparison(const std::string& text) const;
+    std::string_view normalizeForComparison(std::string_view text) const;
 };
\ No newline at end of file
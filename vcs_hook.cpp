@@ -0,0 +1,152 @@
+#include "vcs_hook.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+VcsHook::VcsHook(const std::string& command, size_t batch_bytes)
+    : command_(splitCommand(command)), batch_bytes_(batch_bytes ? batch_bytes : argumentLimit()) {
+    size_t command_bytes = 0;
+    for (const auto& word : command_) {
+        command_bytes += word.size() + 1 + sizeof(char*);
+    }
+    batch_bytes_ = batch_bytes_ > 2 * command_bytes ? batch_bytes_ - command_bytes : batch_bytes_ / 2;
+}
+
+VcsHook::~VcsHook() {
+    finish();
+}
+
+std::vector<std::string> VcsHook::splitCommand(const std::string& command) {
+    std::vector<std::string> words;
+    std::string word;
+    bool quoted = false, in_word = false;
+    for (char c : command) {
+        if (c == '"') {
+            quoted = !quoted;
+            in_word = true;
+        } else if (!quoted && (c == ' ' || c == '\t')) {
+            if (in_word) {
+                words.push_back(word);
+                word.clear();
+                in_word = false;
+            }
+        } else {
+            word += c;
+            in_word = true;
+        }
+    }
+    if (in_word) {
+        words.push_back(word);
+    }
+    return words;
+}
+
+size_t VcsHook::argumentLimit() {
+    constexpr size_t MARGIN = 4096;
+    constexpr size_t MAXIMUM = 1 << 20;
+#ifdef _WIN32
+    return 32767 - MARGIN;  // CreateProcess command-line limit, in characters
+#else
+    long arg_max = sysconf(_SC_ARG_MAX);
+    size_t limit = arg_max > 0 ? static_cast<size_t>(arg_max) : 128 * 1024;
+    size_t environment = 0;
+    for (char** env = environ; *env; ++env) {
+        environment += std::strlen(*env) + 1 + sizeof(char*);
+    }
+    limit = limit > environment + 2 * MARGIN ? limit - environment - MARGIN : MARGIN;
+    return std::min(limit, MAXIMUM);
+#endif
+}
+
+void VcsHook::add(const std::filesystem::path& file, Commit commit) {
+    std::string name = file.string();
+    size_t bytes = name.size() + 1 + sizeof(char*);
+    if (!pending_.files.empty() && pending_.bytes + bytes > batch_bytes_) {
+        launch();
+    }
+    pending_.files.push_back(std::move(name));
+    pending_.commits.push_back(std::move(commit));
+    pending_.bytes += bytes;
+}
+
+bool VcsHook::finish() {
+    if (!pending_.files.empty()) {
+        launch();
+    }
+    waitRunning();
+    return error_message_.empty();
+}
+
+void VcsHook::launch() {
+    // Only one command runs at a time; the previous batch is committed first
+    waitRunning();
+    running_ = std::move(pending_);
+    pending_ = Batch();
+    if (command_.empty()) {
+        return;
+    }
+
+    std::vector<char*> argv;
+    for (auto& word : command_) {
+        argv.push_back(word.data());
+    }
+    for (auto& file : running_.files) {
+        argv.push_back(file.data());
+    }
+    argv.push_back(nullptr);
+
+    // The command shares our stdout; keep the output in order
+    std::cout.flush();
+    std::fflush(stdout);
+#ifdef _WIN32
+    running_process_ = _spawnvp(_P_NOWAIT, argv[0], argv.data());
+#else
+    pid_t pid;
+    running_process_ = posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ) == 0 ? pid : -1;
+#endif
+    if (running_process_ == -1) {
+        error_message_ += "Could not run " + command_[0] + "\n";
+    }
+}
+
+void VcsHook::waitRunning() {
+    if (running_.files.empty()) {
+        return;
+    }
+
+    bool succeeded = running_process_ != -1 || command_.empty();
+    if (running_process_ != -1) {
+        int status = 0;
+#ifdef _WIN32
+        succeeded = _cwait(&status, running_process_, 0) != -1 && status == 0;
+#else
+        pid_t pid = static_cast<pid_t>(running_process_);
+        while (waitpid(pid, &status, 0) == -1 && errno == EINTR) {
+        }
+        succeeded = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+        running_process_ = -1;
+    }
+
+    if (!succeeded) {
+        error_message_ += command_[0] + " failed; " + std::to_string(running_.files.size()) +
+                          " file(s) left unchanged\n";
+    }
+    for (size_t i = 0; i < running_.files.size(); ++i) {
+        if (!running_.commits[i](succeeded) && succeeded) {
+            error_message_ += "Could not write to file: " + running_.files[i] + "\n";
+        }
+    }
+    running_ = Batch();
+}
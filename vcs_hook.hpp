@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Runs a version-control command such as "cvs edit" or "p4 edit" on changed
+// files before they are replaced. Files are collected into batches that fit
+// the argument-list limit and the command runs once per batch. While one
+// batch's command is running, the next batch is collected. After a batch's
+// command succeeds, the deferred write for each of its files is committed.
+class VcsHook {
+public:
+    // Called with true to perform the deferred write of one file, or with false
+    // to discard it because the command failed; returns false on failure
+    using Commit = std::function<bool(bool apply)>;
+
+    // batch_bytes of 0 sizes batches from the system's argument-list limit
+    explicit VcsHook(const std::string& command, size_t batch_bytes = 0);
+    ~VcsHook();
+
+    VcsHook(const VcsHook&) = delete;
+    VcsHook& operator=(const VcsHook&) = delete;
+
+    void add(const std::filesystem::path& file, Commit commit);
+
+    // Runs the remaining batches and waits for them; returns false if a
+    // command or a commit failed (error_message() says which)
+    bool finish();
+
+    const std::string& errorMessage() const { return error_message_; }
+
+    // Splits a command line on whitespace; double quotes group words
+    static std::vector<std::string> splitCommand(const std::string& command);
+
+    // Bytes available for file arguments after the environment and a margin
+    static size_t argumentLimit();
+
+private:
+    struct Batch {
+        std::vector<std::string> files;
+        std::vector<Commit> commits;
+        size_t bytes = 0;
+    };
+
+    std::vector<std::string> command_;
+    size_t batch_bytes_;
+    Batch pending_;
+    Batch running_;
+    intptr_t running_process_ = -1;
+    std::string error_message_;
+
+    void launch();
+    void waitRunning();
+};
@@ -35,8 +35,21 @@
 **  itself).  I think it would be unwise to try to get this into a
 **  released version unless you have a good test data base to try it out
 **  on.
+**
+**  The star-loop is now kept explicitly: only the most recent star can
+**  need to absorb more text, so remembering it is enough and DoMatch no
+**  longer recurses.  Patterns that are matched against many names can be
+**  compiled once into a glob set (see globset_compile below).
 */
 
+#include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fart_shared.h"
+
 #define TRUE			1
 #define FALSE			0
 #define ABORT			-1
@@ -51,67 +64,92 @@
 
 
 /*
-**  Match text and p, return TRUE, FALSE, or ABORT.
+**  Match one non-star pattern element at p against c.  Returns TRUE or
+**  FALSE and sets *next to the element after it.  A '[' without a closing
+**  ']' and a trailing '\' are taken literally.
 */
 static int
-DoMatch (text, p)
-     register const char *text;
-     register const char *p;
+MatchOne (const char *p, int c, const char **next)
 {
-	register int last;
-	register int matched;
-	register int reverse;
+	int last, matched, reverse;
+	const char *end;
 
-	for (; *p; text++, p++)
+	switch (*p)
 	{
-		if (*text == '\0' && *p != '*')
-			return ABORT;
-		switch (*p)
-		{
-		case '\\':
-			/* Literal match with following character. */
+	case '\\':
+		if (p[1])
 			p++;
-			/* FALLTHROUGH */
-		default:
-			if (*text != *p)
-				return FALSE;
-			continue;
-		case '?':
-			/* Match anything. */
-			continue;
-		case '*':
+		*next = p + 1;
+		return c == (unsigned char)*p;
+	case '?':
+		*next = p + 1;
+		return TRUE;
+	case '[':
+		end = strchr (p + 1, ']');
+		if (!end)
+			break;
+		reverse = p[1] == NEGATE_CLASS ? TRUE : FALSE;
+		if (reverse)
+			/* Inverted character class. */
+			p++;
+		for (last = 0400, matched = FALSE; ++p < end; last = (unsigned char)*p)
+			if (*p == '-' && p + 1 < end && last != 0400 ? c <= (unsigned char)*++p
+			    && c >= last : c == (unsigned char)*p)
+				matched = TRUE;
+		*next = end + 1;
+		return matched != reverse;
+	}
+	*next = p + 1;
+	return c == (unsigned char)*p;
+}
+
+
+/*
+**  Match text and p, return TRUE or FALSE.
+*/
+static int
+DoMatch (const char *text, const char *p)
+{
+	const char *star_p = NULL;		/* pattern right after the last star */
+	const char *star_text = NULL;	/* text that star has absorbed up to */
+	const char *next;
+
+	for (;;)
+	{
+		if (*p == '*')
+		{
 			while (*++p == '*')
 				/* Consecutive stars act just like one. */
 				continue;
 			if (*p == '\0')
 				/* Trailing star matches everything. */
 				return TRUE;
-			while (*text)
-				if ((matched = DoMatch (text++, p)) != FALSE)
-					return matched;
-			return ABORT;
-		case '[':
-			reverse = p[1] == NEGATE_CLASS ? TRUE : FALSE;
-			if (reverse)
-				/* Inverted character class. */
-				p++;
-			for (last = 0400, matched = FALSE; *++p && *p != ']';
-			     last = *p)
-				/* This next line requires a good C compiler. */
-				if (*p == '-' ? *text <= *++p
-				    && *text >= last : *text == *p)
-					matched = TRUE;
-			if (matched == reverse)
-				return FALSE;
+			star_p = p;
+			star_text = text;
 			continue;
 		}
-	}
-
+		if (*p == '\0')
+		{
 #ifdef	MATCH_TAR_PATTERN
-	if (*text == '/')
-		return TRUE;
-#endif /* MATCH_TAR_ATTERN */
-	return *text == '\0';
+			if (*text == '/')
+				return TRUE;
+#endif /* MATCH_TAR_PATTERN */
+			if (*text == '\0')
+				return TRUE;
+		}
+		else
+		if (*text != '\0' && MatchOne (p, (unsigned char)*text, &next))
+		{
+			text++;
+			p = next;
+			continue;
+		}
+		/* Mismatch: let the last star absorb one more character */
+		if (!star_p || *star_text == '\0')
+			return FALSE;
+		p = star_p;
+		text = ++star_text;
+	}
 }
 
 
@@ -119,9 +157,7 @@ DoMatch (text, p)
 **  User-level routine.  Returns TRUE or FALSE.
 */
 int
-wildmat (text, p)
-     const char *text;
-     const char *p;
+wildmat (const char *text, const char *p)
 {
 #ifdef	OPTIMIZE_JUST_STAR
 	if (p[0] == '*' && p[1] == '\0')
@@ -129,3 +165,360 @@ wildmat (text, p)
 #endif /* OPTIMIZE_JUST_STAR */
 	return DoMatch (text, p) == TRUE;
 }
+
+
+/*
+**  Glob sets: several patterns compiled once and matched against a name
+**  in a single call.  Each pattern becomes a list of single-character
+**  elements and stars, with its literal prefix and suffix kept aside so
+**  most names are rejected by a length check and a memcmp.  Patterns are
+**  bucketed by the last character they require, so a name only visits
+**  the patterns that can end the way it does.
+*/
+
+#define GLOB_CHAR	0		/* literal character */
+#define GLOB_ANY	1		/* ? */
+#define GLOB_CLASS	2		/* [...] */
+#define GLOB_STAR	3		/* * */
+
+typedef struct
+{
+	unsigned char	op;
+	unsigned char	ch;				/* GLOB_CHAR */
+	int				cls;			/* GLOB_CLASS: index into the class table */
+} glob_elem_t;
+
+typedef struct
+{
+	const char		*source;		/* for the exact-name check */
+	int				exact;			/* source contains [ or \ */
+	glob_elem_t		*elems;
+	int				num_elems;
+	int				min_len;		/* number of non-star elements */
+	int				has_star;
+	const char		*prefix, *suffix;	/* literal head and tail */
+	int				prefix_len, suffix_len;
+} glob_t;
+
+struct globset_s
+{
+	glob_t			*globs;
+	int				count;
+	int				foldcase;
+	int				match_all;		/* one of the patterns is "*" */
+	unsigned char	(*classes)[32];	/* 256-bit character sets */
+	int				*bucket_start;	/* 257 offsets into bucket */
+	int				*bucket;		/* pattern indices by last character */
+	int				*any_end;		/* patterns without a required last character */
+	int				num_any_end;
+};
+
+static int
+GlobFold (const globset_t *set, int c)
+{
+	return set->foldcase ? tolower (c) : c;
+}
+
+static void
+GlobClassSet (unsigned char *cls, int c, int foldcase)
+{
+	cls[c >> 3] |= 1 << (c & 7);
+	if (foldcase)
+	{
+		cls[tolower (c) >> 3] |= 1 << (tolower (c) & 7);
+		cls[toupper (c) >> 3] |= 1 << (toupper (c) & 7);
+	}
+}
+
+/* Parses one pattern; returns FALSE when out of memory */
+static int
+GlobCompile (globset_t *set, glob_t *g, const char *p, int *num_classes)
+{
+	glob_elem_t *e;
+	const char *end, *q;
+	char *lit;
+	int c, last, reverse, t, n;
+	size_t len = strlen (p);
+
+	g->source = p;
+	g->exact = strchr (p, '[') || strchr (p, '\\');
+	g->elems = (glob_elem_t *) malloc ((len + 1) * sizeof (glob_elem_t));
+	lit = (char *) malloc (len + 1);
+	if (!g->elems || !lit)
+	{
+		free (lit);
+		return FALSE;
+	}
+
+	for (e = g->elems; *p; e++)
+	{
+		switch (*p)
+		{
+		case '*':
+			while (*++p == '*')
+				continue;
+			e->op = GLOB_STAR;
+			g->has_star = TRUE;
+			continue;
+		case '?':
+			e->op = GLOB_ANY;
+			p++;
+			continue;
+		case '[':
+			end = strchr (p + 1, ']');
+			if (!end)
+				break;
+			e->op = GLOB_CLASS;
+			e->cls = (*num_classes)++;
+			memset (set->classes[e->cls], 0, 32);
+			reverse = p[1] == NEGATE_CLASS;
+			if (reverse)
+				p++;
+			for (last = 0400; ++p < end; last = (unsigned char)*p)
+				if (*p == '-' && p + 1 < end && last < 0400)
+					for (c = last, p++; c <= (unsigned char)*p; c++)
+						GlobClassSet (set->classes[e->cls], c, set->foldcase);
+				else
+					GlobClassSet (set->classes[e->cls], (unsigned char)*p, set->foldcase);
+			if (reverse)
+				for (t = 0; t < 32; t++)
+					set->classes[e->cls][t] ^= 0xff;
+			p = end + 1;
+			continue;
+		case '\\':
+			if (p[1])
+				p++;
+			break;
+		}
+		e->op = GLOB_CHAR;
+		e->ch = (unsigned char) GlobFold (set, (unsigned char)*p++);
+	}
+	g->num_elems = (int) (e - g->elems);
+
+	/* Literal prefix and suffix; the suffix only matters after a star */
+	for (n = 0; n < g->num_elems && g->elems[n].op == GLOB_CHAR; n++)
+		lit[n] = (char) g->elems[n].ch;
+	g->prefix = lit;
+	g->prefix_len = n;
+	for (t = g->num_elems; t > n && g->elems[t - 1].op == GLOB_CHAR; t--)
+		continue;
+	g->suffix_len = g->num_elems - t;
+	if (g->suffix_len)
+	{
+		/* Stored after the prefix; both fit since they don't overlap */
+		for (q = lit + n, c = t; c < g->num_elems; c++)
+			lit[n + c - t] = (char) g->elems[c].ch;
+		g->suffix = q;
+	}
+	for (t = 0; t < g->num_elems; t++)
+		if (g->elems[t].op != GLOB_STAR)
+			g->min_len++;
+	return TRUE;
+}
+
+/* The exact-name check for patterns that may not match themselves */
+static int
+GlobExact (const globset_t *set, const glob_t *g, const char *name)
+{
+	return g->exact && !(set->foldcase ? stricmp (name, g->source) : strcmp (name, g->source));
+}
+
+static int
+GlobElemMatch (const globset_t *set, const glob_elem_t *e, int c)
+{
+	switch (e->op)
+	{
+	case GLOB_CHAR:
+		return e->ch == c;
+	case GLOB_CLASS:
+		return (set->classes[e->cls][c >> 3] >> (c & 7)) & 1;
+	}
+	return TRUE;						/* GLOB_ANY */
+}
+
+/* 'name' is already case-folded if the set folds case */
+static int
+GlobMatch (const globset_t *set, const glob_t *g, const unsigned char *name, int len)
+{
+	const glob_elem_t *e = g->elems, *end = g->elems + g->num_elems;
+	const glob_elem_t *star_e = NULL;
+	int t = 0, star_t = 0;
+
+	if (len < g->min_len || (!g->has_star && len != g->min_len))
+		return FALSE;
+	if (memcmp (name, g->prefix, g->prefix_len))
+		return FALSE;
+	if (g->suffix_len && memcmp (name + len - g->suffix_len, g->suffix, g->suffix_len))
+		return FALSE;
+
+	for (;;)
+	{
+		if (e < end && e->op == GLOB_STAR)
+		{
+			if (++e == end)
+				return TRUE;
+			star_e = e;
+			star_t = t;
+			continue;
+		}
+		if (e == end)
+		{
+			if (t == len)
+				return TRUE;
+		}
+		else
+		if (t < len && GlobElemMatch (set, e, name[t]))
+		{
+			t++;
+			e++;
+			continue;
+		}
+		if (!star_e || star_t == len)
+			return FALSE;
+		e = star_e;
+		t = ++star_t;
+	}
+}
+
+globset_t *
+globset_compile (const char *const *patterns, int count, int foldcase)
+{
+	globset_t *set;
+	int fill[256];
+	int t, c, num_classes = 0;
+	size_t max_classes = 0;
+
+	for (t = 0; t < count; t++)
+		for (c = 0; patterns[t][c]; c++)
+			max_classes += patterns[t][c] == '[';
+	if (!max_classes)
+		max_classes = 1;
+	if (max_classes > INT_MAX || max_classes > SIZE_MAX / 32)
+		return NULL;
+
+	set = (globset_t *) calloc (1, sizeof (globset_t));
+	if (!set)
+		return NULL;
+	set->count = count;
+	set->foldcase = foldcase;
+	set->globs = (glob_t *) calloc (count ? count : 1, sizeof (glob_t));
+	set->classes = (unsigned char (*)[32]) malloc (max_classes * 32);
+	set->bucket_start = (int *) calloc (257, sizeof (int));
+	set->bucket = (int *) malloc ((count ? count : 1) * sizeof (int));
+	set->any_end = (int *) malloc ((count ? count : 1) * sizeof (int));
+	if (!set->globs || !set->classes || !set->bucket_start || !set->bucket || !set->any_end)
+	{
+		globset_free (set);
+		return NULL;
+	}
+
+	for (t = 0; t < count; t++)
+	{
+		glob_t *g = &set->globs[t];
+		if (!GlobCompile (set, g, patterns[t], &num_classes))
+		{
+			globset_free (set);
+			return NULL;
+		}
+		if (g->num_elems == 1 && g->elems[0].op == GLOB_STAR)
+			set->match_all = TRUE;
+		/* Bucket by the required last character (counting pass) */
+		if (g->num_elems && g->elems[g->num_elems - 1].op == GLOB_CHAR)
+			set->bucket_start[g->elems[g->num_elems - 1].ch + 1]++;
+		else
+			set->any_end[set->num_any_end++] = t;
+	}
+	for (c = 0; c < 256; c++)
+		set->bucket_start[c + 1] += set->bucket_start[c];
+
+	/* Second pass: place each pattern in its bucket */
+	memcpy (fill, set->bucket_start, sizeof (fill));
+	for (t = 0; t < count; t++)
+	{
+		glob_t *g = &set->globs[t];
+		if (g->num_elems && g->elems[g->num_elems - 1].op == GLOB_CHAR)
+			set->bucket[fill[g->elems[g->num_elems - 1].ch]++] = t;
+	}
+	return set;
+}
+
+void
+globset_free (globset_t *set)
+{
+	int t;
+	if (!set)
+		return;
+	if (set->globs)
+		for (t = 0; t < set->count; t++)
+		{
+			free (set->globs[t].elems);
+			free ((char *) set->globs[t].prefix);
+		}
+	free (set->globs);
+	free (set->classes);
+	free (set->bucket_start);
+	free (set->bucket);
+	free (set->any_end);
+	free (set);
+}
+
+/* 'text' is 'name', case-folded if the set folds case */
+static int
+GlobsetMatch (const globset_t *set, const char *name, const unsigned char *text, int len, unsigned char *hits)
+{
+	int found = 0, t, n, c;
+
+	/* Patterns that must end with the name's last character, then the rest */
+	c = len ? text[len - 1] : -1;
+	for (n = c < 0 ? 0 : set->bucket_start[c]; c >= 0 && n < set->bucket_start[c + 1]; n++)
+	{
+		t = set->bucket[n];
+		if (GlobMatch (set, &set->globs[t], text, len) || GlobExact (set, &set->globs[t], name))
+		{
+			found++;
+			if (!hits)
+				return found;
+			hits[t] = 1;
+		}
+	}
+	for (n = 0; n < set->num_any_end; n++)
+	{
+		t = set->any_end[n];
+		if (GlobMatch (set, &set->globs[t], text, len) || GlobExact (set, &set->globs[t], name))
+		{
+			found++;
+			if (!hits)
+				return found;
+			hits[t] = 1;
+		}
+	}
+	return found;
+}
+
+int
+globset_match (const globset_t *set, const char *name, unsigned char *hits)
+{
+	unsigned char buffer[1024], *folded;
+	size_t size = strlen (name), t;
+	int found;
+
+	if (set->match_all && !hits)
+		return 1;
+	if (hits)
+		memset (hits, 0, set->count);
+	if (size > INT_MAX)
+		return 0;
+	if (!set->foldcase)
+		return GlobsetMatch (set, name, (const unsigned char *) name, (int) size, hits);
+
+	/* Names are short and folded on the stack; longer ones on the heap */
+	folded = size < sizeof (buffer) ? buffer : (unsigned char *) malloc (size + 1);
+	if (!folded)
+		return 0;
+	for (t = 0; t <= size; t++)
+		folded[t] = (unsigned char) tolower ((unsigned char) name[t]);
+	found = GlobsetMatch (set, name, folded, (int) size, hits);
+	if (folded != buffer)
+		free (folded);
+	return found;
+}
@@ -0,0 +1,532 @@
+#include "work_server.hpp"
+#include "argument_parser.hpp"
+#include "file_processor.hpp"
+#include "result_log.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr const char* UNIX_PREFIX = "unix:";
+constexpr const char* TOKEN_VARIABLE = "FART_WORK_TOKEN";
+constexpr int CONNECT_ATTEMPTS = 100;  // 10 s for the coordinator to come up
+constexpr std::chrono::milliseconds CONNECT_RETRY_DELAY(100);
+
+using Fields = std::unordered_map<std::string, std::string>;
+
+std::string record(const char* key, const std::string& value) {
+    return "{\"" + std::string(key) + "\":" + ResultLog::encode(value) + "}\n";
+}
+
+std::string record(const char* key, size_t value) {
+    return "{\"" + std::string(key) + "\":" + std::to_string(value) + "}\n";
+}
+
+#ifndef _WIN32
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+std::string systemError(const std::string& what) {
+    return what + ": " + std::strerror(errno);
+}
+
+bool isUnixAddress(const std::string& address) {
+    return address.compare(0, std::strlen(UNIX_PREFIX), UNIX_PREFIX) == 0;
+}
+
+std::string sharedToken() {
+    const char* token = std::getenv(TOKEN_VARIABLE);
+    return token ? token : "";
+}
+
+// Compares in time independent of where the strings differ
+bool sameToken(const std::string& a, const std::string& b) {
+    unsigned char diff = a.size() != b.size();
+    for (size_t i = 0; i < a.size() && i < b.size(); i++) {
+        diff |= static_cast<unsigned char>(a[i] ^ b[i]);
+    }
+    return diff == 0;
+}
+
+// Creates a socket for address, then binds and listens or connects it
+int openSocket(const std::string& address, bool server, std::string& unix_path, std::string& error) {
+    if (isUnixAddress(address)) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::string path = address.substr(std::strlen(UNIX_PREFIX));
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            error = "Invalid socket path: " + path;
+            return -1;
+        }
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1) {
+            error = systemError("socket");
+            return -1;
+        }
+        if (server) {
+            // A socket left over from an earlier coordinator is replaced; anything else stays
+            struct stat info;
+            if (lstat(path.c_str(), &info) == 0) {
+                if (!S_ISSOCK(info.st_mode)) {
+                    error = "Could not listen on " + address + ": address in use";
+                    close(fd);
+                    return -1;
+                }
+                unlink(path.c_str());
+            }
+            if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1 || ::listen(fd, SOMAXCONN) == -1) {
+                error = systemError("Could not listen on " + address);
+                close(fd);
+                return -1;
+            }
+            unix_path = path;
+        } else if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
+            error = systemError("Could not connect to " + address);
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    auto colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        error = "Invalid address (expected unix:<path> or [host]:port): " + address;
+        return -1;
+    }
+    std::string host = address.substr(0, colon);
+    std::string port = address.substr(colon + 1);
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+
+    // Without a host both ends use the loopback interface; listening on every
+    // interface takes an explicit host such as 0.0.0.0 or [::]
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    int status = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &addresses);
+    if (status != 0) {
+        error = "Invalid address " + address + ": " + gai_strerror(status);
+        return -1;
+    }
+
+    int fd = -1;
+    for (addrinfo* ai = addresses; ai && fd == -1; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd == -1) {
+            continue;
+        }
+        bool ok;
+        if (server) {
+            int on = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            ok = bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && ::listen(fd, SOMAXCONN) == 0;
+        } else {
+            ok = connect(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+        }
+        if (!ok) {
+            error = systemError((server ? "Could not listen on " : "Could not connect to ") + address);
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    return fd;
+}
+
+bool writeAll(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t bytes = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (bytes == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            return false;
+        }
+        written += static_cast<size_t>(bytes);
+    }
+    return true;
+}
+
+// Reads what is available into buffer; false at end of stream or on an error
+bool readSome(int fd, std::string& buffer) {
+    char chunk[64 * 1024];
+    ssize_t bytes;
+    while ((bytes = read(fd, chunk, sizeof(chunk))) == -1 && errno == EINTR) {
+    }
+    if (bytes <= 0) {
+        return false;
+    }
+    buffer.append(chunk, static_cast<size_t>(bytes));
+    return true;
+}
+
+// Takes the next complete line out of buffer
+bool takeLine(std::string& buffer, size_t& consumed, std::string& line) {
+    size_t eol = buffer.find('\n', consumed);
+    if (eol == std::string::npos) {
+        buffer.erase(0, consumed);
+        consumed = 0;
+        return false;
+    }
+    line.assign(buffer, consumed, eol - consumed);
+    consumed = eol + 1;
+    return true;
+}
+
+#endif
+
+}  // namespace
+
+WorkServer::WorkServer(std::vector<std::string> args) : args_(std::move(args)) {
+}
+
+WorkServer::~WorkServer() {
+#ifndef _WIN32
+    for (auto& worker : workers_) {
+        close(worker.fd);
+    }
+    for (int fd : {listen_fd_, wake_fds_[0], wake_fds_[1]}) {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+    if (!unix_path_.empty()) {
+        unlink(unix_path_.c_str());
+    }
+#endif
+}
+
+#ifdef _WIN32
+
+bool WorkServer::listen(const std::string&, std::string& error) {
+    error = "--serve-work is not supported on this platform";
+    return false;
+}
+
+void WorkServer::add(const std::filesystem::path&) {
+}
+
+void WorkServer::finish() {
+}
+
+void WorkServer::run(std::ostream&) {
+}
+
+bool WorkClient::run(const std::string&, std::string& error) {
+    error = "--worker is not supported on this platform";
+    return false;
+}
+
+#else
+
+bool WorkServer::listen(const std::string& address, std::string& error) {
+    token_ = sharedToken();
+    if (token_.empty() && !isUnixAddress(address)) {
+        error = std::string("--serve-work on a TCP address needs a shared token in $") + TOKEN_VARIABLE;
+        return false;
+    }
+    listen_fd_ = openSocket(address, true, unix_path_, error);
+    if (listen_fd_ == -1) {
+        return false;
+    }
+    if (pipe(wake_fds_) == -1) {
+        error = systemError("pipe");
+        return false;
+    }
+    fcntl(wake_fds_[0], F_SETFL, O_NONBLOCK);
+    return true;
+}
+
+void WorkServer::add(const std::filesystem::path& file) {
+    current_.push_back(file.string());
+    if (current_.size() >= BATCH_FILES) {
+        flushBatch();
+    }
+}
+
+void WorkServer::finish() {
+    if (!current_.empty()) {
+        flushBatch();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        walk_done_ = true;
+    }
+    char wake = 0;
+    (void)!write(wake_fds_[1], &wake, 1);
+}
+
+void WorkServer::flushBatch() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        incoming_.push_back(std::move(current_));
+    }
+    current_.clear();
+    char wake = 0;
+    (void)!write(wake_fds_[1], &wake, 1);
+}
+
+bool WorkServer::sendBatch(Worker& worker, size_t index) {
+    std::string message = record("batch", index);
+    for (const auto& file : batches_[index].files) {
+        message += record("file", file);
+    }
+    message += record("end", index);
+    worker.batches.push_back(index);
+    return writeAll(worker.fd, message);
+}
+
+bool WorkServer::readWorker(Worker& worker) {
+    if (!readSome(worker.fd, worker.input)) {
+        return false;
+    }
+    Fields fields;
+    std::string line;
+    size_t consumed = 0;
+    while (takeLine(worker.input, consumed, line)) {
+        if (!worker.accepted) {
+            // Nothing, not even the command line, goes to a peer without the token
+            if (!ResultLog::decode(line, fields) || !fields.count("token") || !sameToken(fields["token"], token_)) {
+                return false;
+            }
+            std::string hello;
+            for (const auto& arg : args_) {
+                hello += record("arg", arg);
+            }
+            hello += record("start", size_t{1});
+            if (!writeAll(worker.fd, hello)) {
+                return false;
+            }
+            worker.accepted = true;
+            continue;
+        }
+        if (!ResultLog::decode(line, fields) || !fields.count("batch")) {
+            return false;
+        }
+        size_t index = std::strtoull(fields["batch"].c_str(), nullptr, 10);
+        auto it = std::find(worker.batches.begin(), worker.batches.end(), index);
+        if (it == worker.batches.end()) {
+            return false;  // not a batch this worker was given
+        }
+        worker.batches.erase(it);
+
+        Batch& batch = batches_[index];
+        batch.done = true;
+        batch.output = std::move(fields["output"]);
+        batch.files.clear();
+        batch.files.shrink_to_fit();
+        files_ += std::atoi(fields["files"].c_str());
+        matches_ += std::atoi(fields["matches"].c_str());
+        error_message_ += fields["error"];
+    }
+    return true;
+}
+
+void WorkServer::dropWorker(size_t index) {
+    // Its unanswered batches go first to whoever asks next
+    Worker& worker = workers_[index];
+    for (auto it = worker.batches.rbegin(); it != worker.batches.rend(); ++it) {
+        pending_.push_front(*it);
+    }
+    close(worker.fd);
+    workers_.erase(workers_.begin() + static_cast<std::ptrdiff_t>(index));
+}
+
+void WorkServer::run(std::ostream& out) {
+    size_t next_output = 0;
+    bool walk_done = false;
+    std::vector<pollfd> fds;
+
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& files : incoming_) {
+                pending_.push_back(batches_.size());
+                batches_.push_back({std::move(files), "", false});
+            }
+            incoming_.clear();
+            walk_done = walk_done_;
+        }
+
+        for (size_t w = 0; w < workers_.size();) {
+            bool alive = true;
+            while (alive && workers_[w].accepted && !pending_.empty() &&
+                   workers_[w].batches.size() < BATCHES_PER_WORKER) {
+                size_t index = pending_.front();
+                pending_.pop_front();
+                alive = sendBatch(workers_[w], index);
+            }
+            if (alive) {
+                w++;
+            } else {
+                dropWorker(w);
+            }
+        }
+
+        bool wrote = false;
+        while (next_output < batches_.size() && batches_[next_output].done) {
+            out << batches_[next_output].output;
+            std::string().swap(batches_[next_output].output);
+            next_output++;
+            wrote = true;
+        }
+        if (wrote) {
+            out.flush();
+        }
+        if (walk_done && next_output == batches_.size()) {
+            break;
+        }
+
+        fds.clear();
+        fds.push_back({listen_fd_, POLLIN, 0});
+        fds.push_back({wake_fds_[0], POLLIN, 0});
+        for (const auto& worker : workers_) {
+            fds.push_back({worker.fd, POLLIN, 0});
+        }
+        if (poll(fds.data(), fds.size(), -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error_message_ += systemError("poll") + "\n";
+            break;
+        }
+
+        if (fds[1].revents) {
+            char drain[256];
+            while (read(wake_fds_[0], drain, sizeof(drain)) > 0) {
+            }
+        }
+        // Back to front, so dropping a worker leaves the indices still to visit alone
+        for (size_t i = fds.size(); i-- > 2;) {
+            if (fds[i].revents && !readWorker(workers_[i - 2])) {
+                dropWorker(i - 2);
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd != -1) {
+                workers_.push_back({fd, "", {}, false});  // told the command line once it sends the token
+            }
+        }
+    }
+
+    for (auto& worker : workers_) {
+        writeAll(worker.fd, record("done", size_t{1}));
+    }
+}
+
+bool WorkClient::run(const std::string& address, std::string& error) {
+    std::string unix_path;
+    int fd = -1;
+    for (int attempt = 0; fd == -1 && attempt < CONNECT_ATTEMPTS; attempt++) {
+        if (attempt) {
+            std::this_thread::sleep_for(CONNECT_RETRY_DELAY);
+        }
+        fd = openSocket(address, false, unix_path, error);
+    }
+    if (fd == -1) {
+        return false;
+    }
+    if (!writeAll(fd, record("token", sharedToken()))) {
+        error = "Connection to " + address + " closed";
+        close(fd);
+        return false;
+    }
+
+    FartConfig config;
+    std::unique_ptr<FileProcessor> processor;
+    std::vector<std::string> args{"fart"};
+    std::vector<std::filesystem::path> files;
+    size_t batch = 0;
+
+    std::string input, line;
+    size_t consumed = 0;
+    Fields fields;
+    bool done = false;
+    while (!done) {
+        if (!takeLine(input, consumed, line)) {
+            if (!readSome(fd, input)) {
+                error = "Connection to " + address + " closed";
+                break;
+            }
+            continue;
+        }
+        if (!ResultLog::decode(line, fields)) {
+            error = "Unexpected message from " + address;
+            break;
+        }
+
+        if (fields.count("arg")) {
+            args.push_back(fields["arg"]);
+        } else if (fields.count("start")) {
+            // The coordinator's command line, parsed the same way
+            std::vector<char*> argv;
+            for (auto& arg : args) {
+                argv.push_back(arg.data());
+            }
+            ArgumentParser parser;
+            auto parsed = parser.parse(static_cast<int>(argv.size()), argv.data(), config);
+            if (!parsed.success) {
+                error = parsed.error_message;
+                break;
+            }
+            processor = std::make_unique<FileProcessor>(config);
+        } else if (fields.count("batch")) {
+            batch = std::strtoull(fields["batch"].c_str(), nullptr, 10);
+            files.clear();
+        } else if (fields.count("file")) {
+            files.emplace_back(fields["file"]);
+        } else if (fields.count("end") && processor) {
+            int files_before = config.getStats().total_files;
+            int matches_before = config.getStats().total_matches;
+
+            // What a single run would print for these files, in their order
+            std::ostringstream output;
+            auto* stdout_buffer = std::cout.rdbuf(output.rdbuf());
+            auto result = processor->processFileList(files);
+            std::cout.flush();
+            std::cout.rdbuf(stdout_buffer);
+
+            std::string reply = "{\"batch\":" + std::to_string(batch) +
+                                ",\"files\":" + std::to_string(config.getStats().total_files - files_before) +
+                                ",\"matches\":" + std::to_string(config.getStats().total_matches - matches_before) +
+                                ",\"output\":" + ResultLog::encode(output.str()) +
+                                ",\"error\":" + ResultLog::encode(result.success ? "" : result.error_message) + "}\n";
+            if (!writeAll(fd, reply)) {
+                error = "Connection to " + address + " closed";
+                break;
+            }
+        } else if (fields.count("done")) {
+            done = true;
+        }
+    }
+
+    close(fd);
+    return done;
+}
+
+#endif
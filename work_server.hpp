@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// --serve-work and --worker: a coordinator walks the tree and hands out
+// batches of paths over a Unix or TCP socket to worker processes, which run
+// the normal FileProcessor pipeline on them and send back each batch's output
+// and totals. Workers take a new batch whenever they finish one, so a few
+// huge files hold up one worker rather than a whole shard. The coordinator
+// prints batches in walk order, so the output reads as from a single run, and
+// hands the batches of a worker that goes away to another one.
+//
+// Addresses are "unix:<path>" or "[host]:port"; without a host the coordinator
+// listens on the loopback interface only. Workers must send the coordinator's
+// $FART_WORK_TOKEN, which TCP addresses require, before they are given anything.
+// The protocol is one JSON record per line (as in result logs):
+//
+//   worker:      {"token":...}                   once, first
+//   coordinator: {"arg":...}... {"start":1}      the command line, once
+//                {"batch":N} {"file":...}... {"end":N}
+//                {"done":1}
+//   worker:      {"batch":N,"files":F,"matches":M,"output":...,"error":...}
+class WorkServer {
+public:
+    static constexpr size_t BATCH_FILES = 32;
+    static constexpr size_t BATCHES_PER_WORKER = 2;  // one in progress, one on its way
+
+    // args is the command line workers run, without --serve-work
+    explicit WorkServer(std::vector<std::string> args);
+    ~WorkServer();
+
+    WorkServer(const WorkServer&) = delete;
+    WorkServer& operator=(const WorkServer&) = delete;
+
+    bool listen(const std::string& address, std::string& error);
+
+    // Called by the walk, which may run on another thread than run()
+    void add(const std::filesystem::path& file);
+    void finish();
+
+    // Serves workers until every batch is done, writing their output to out in walk order
+    void run(std::ostream& out);
+
+    int files() const { return files_; }
+    int matches() const { return matches_; }
+    const std::string& errorMessage() const { return error_message_; }
+
+private:
+    struct Batch {
+        std::vector<std::string> files;
+        std::string output;
+        bool done = false;
+    };
+
+    struct Worker {
+        int fd = -1;
+        std::string input;
+        std::deque<size_t> batches;  // sent, not answered yet
+        bool accepted = false;       // sent the token
+    };
+
+    std::vector<std::string> args_;
+    std::string token_;
+    int listen_fd_ = -1;
+    int wake_fds_[2] = {-1, -1};  // the walk wakes run() through this pipe
+    std::string unix_path_;
+
+    // Shared with the walk
+    std::mutex mutex_;
+    std::vector<std::vector<std::string>> incoming_;
+    bool walk_done_ = false;
+
+    std::vector<std::string> current_;  // the batch being filled by the walk
+    std::vector<Batch> batches_;
+    std::deque<size_t> pending_;
+    std::vector<Worker> workers_;
+
+    int files_ = 0;
+    int matches_ = 0;
+    std::string error_message_;
+
+    void flushBatch();
+    bool sendBatch(Worker& worker, size_t index);
+    bool readWorker(Worker& worker);
+    void dropWorker(size_t index);
+};
+
+// A worker: connects to the coordinator at address, retrying for a while in
+// case it is still starting, and processes batches until told it is done
+class WorkClient {
+public:
+    static bool run(const std::string& address, std::string& error);
+};